@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Throughput of the compressed framing, for each packet size class and a
+ * few kinds of payloads. Run with : node bench/compress.js [seconds]
+ */
+
+var crypto = require('crypto');
+var tuntap = require('../index.js');
+
+var sizes = [64, 128, 256, 512, 1024, 1500, 4096, 9000];
+var duration = (parseFloat(process.argv[2]) || 0.5) * 1000;
+
+var payloads = {
+	// Mostly text, as in HTTP or JSON traffic
+	text: function(size) {
+		var words = ['GET ', 'HTTP/1.1', 'Host: ', 'example.com', '"value": ', '{"id": ', '123', '\r\n'];
+		var ret = '';
+		
+		while(ret.length < size)
+			ret += words[Math.floor(Math.random() * words.length)];
+		
+		return(new Buffer(ret.slice(0, size)));
+	},
+	// Protocol headers followed by zeros
+	sparse: function(size) {
+		var ret = Buffer.alloc(size);
+		
+		crypto.randomBytes(Math.min(40, size)).copy(ret);
+		return(ret);
+	},
+	// Already compressed or encrypted
+	random: function(size) {
+		return(crypto.randomBytes(size));
+	},
+};
+
+function run(name, size) {
+	var packets = [];
+	var mux = tuntap.muxer(9000, { compress: true });
+	var demux = tuntap.demuxer(9000);
+	var noop = function() {};
+	var bytes = 0;
+	var framed = 0;
+	var count = 0;
+	var start;
+	var elapsed;
+	var i;
+	
+	for(i = 0 ; i < 64 ; i++)
+		packets.push(payloads[name](size));
+	
+	// Frames go straight from the muxer to the demuxer, without buffering
+	mux.push = function(frame) {
+		framed += frame.length;
+		demux._transform(frame, null, noop);
+	};
+	demux.push = function(packet) {
+		bytes += packet.length;
+	};
+	
+	start = process.hrtime();
+	do {
+		for(i = 0 ; i < packets.length ; i++)
+			mux._transform(packets[i], null, noop);
+		count += packets.length;
+		elapsed = process.hrtime(start);
+		elapsed = elapsed[0] * 1e3 + elapsed[1] / 1e6;
+	} while(elapsed < duration);
+	
+	console.log(
+		name + '\t' + size + '\t' +
+		(count / elapsed / 1e3).toFixed(2) + '\t' +
+		(bytes / elapsed / 1e3).toFixed(1) + '\t' +
+		(framed / (bytes + count * 2)).toFixed(3)
+	);
+}
+
+console.log('payload\tsize\tMpps\tMB/s\tratio');
+for(var name in payloads) {
+	for(var i = 0 ; i < sizes.length ; i++)
+		run(name, sizes[i]);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Rates achieved by the native generator writing to a tun interface, for a
+ * few target rates and datagram sizes. Needs the rights to create 
+ * interfaces. Run with : node bench/generator.js [milliseconds]
+ */
+
+var tuntap = require('../index.js');
+
+var duration = parseInt(process.argv[2]) || 500;
+var rates = [50000, 100000, 200000, 400000, 0];
+var sizes = [64, 512, 1400];
+
+var tt = tuntap({
+	type: 'tun',
+	name: 'benchgen',
+	addr: '10.210.0.1',
+	dest: '10.210.0.2',
+	mask: '255.255.255.255',
+	persist: false,
+});
+
+var runs = [];
+sizes.forEach(function(size) {
+	rates.forEach(function(rate) {
+		runs.push({ size: size, rate: rate });
+	});
+});
+
+tt.on('error', function(e) {
+	console.log(e.message);
+	process.exit(1);
+});
+
+function next() {
+	var run = runs.shift();
+	
+	if(!run) {
+		tt.close();
+		return;
+	}
+	
+	// Sent to a port nobody listens on, the host drops them
+	tt.generate({
+		src: '10.210.0.2',
+		dst: '10.210.0.1',
+		dport: 9,
+		size: run.size,
+		rate: run.rate,
+		duration: duration,
+	});
+	
+	tt.once('generated', function(st) {
+		console.log(
+			'size ' + ('    ' + run.size).slice(-4) +
+			'  target ' + (run.rate ? ('       ' + run.rate).slice(-7) + ' pps' : '    max    ') +
+			'  achieved ' + ('       ' + Math.round(st.pps)).slice(-7) + ' pps' +
+			'  ' + (st.bps / 1e6).toFixed(1) + ' Mbit/s' +
+			(st.errors ? '  errors ' + st.errors : '') +
+			(st.eagain ? '  eagain ' + st.eagain : '')
+		);
+		next();
+	});
+}
+
+setTimeout(next, 200);
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Memory used by each idle interface (opened, never read nor written), as 
+ * seen from the process. Each mode is measured in its own process, since 
+ * the freed memory is not given back. Needs the rights to create interfaces.
+ * Run with : node bench/idle.js [interfaces] [mode...]
+ */
+
+var child_process = require('child_process');
+var tuntap = require('../index.js');
+
+var count = parseInt(process.argv[2]) || 1000;
+var modes = process.argv.slice(3);
+var child = modes[0] == '--child';
+
+var options = {
+	'default': {},
+	'reactor': { reactor: true },
+	'lean': { lean: true },
+	'lean+reactor': { lean: true, reactor: true },
+};
+
+function gc() {
+	if(global.gc)
+		global.gc();
+}
+
+function open(mode, prefix, n) {
+	var tts = [];
+	
+	for(var i = 0 ; i < n ; i++) {
+		var opts = {
+			type: 'tun',
+			name: prefix + i,
+			mask: '255.255.255.255',
+			persist: false,
+		};
+		
+		for(var key in options[mode])
+			opts[key] = options[mode][key];
+		tts.push(tuntap(opts));
+	}
+	
+	return(tts);
+}
+
+function measure(mode) {
+	var warm = open(mode, 'warm', 16);
+	var tts;
+	var before, after;
+	
+	gc();
+	before = process.memoryUsage();
+	
+	tts = open(mode, 'idle', count);
+	
+	setTimeout(function() {
+		gc();
+		after = process.memoryUsage();
+		
+		tts.concat(warm).forEach(function(tt) {
+			tt.close();
+		});
+		
+		console.log(JSON.stringify({
+			rss: (after.rss - before.rss) / count,
+			heap: (after.heapUsed - before.heapUsed) / count,
+			external: (after.external - before.external) / count,
+		}));
+	}, 200);
+}
+
+if(child) {
+	measure(modes[1]);
+	return;
+}
+
+if(modes.length == 0)
+	modes = Object.keys(options);
+
+modes.forEach(function(mode) {
+	var res = JSON.parse(child_process.execFileSync(
+		process.execPath,
+		['--expose-gc', __filename, count, '--child', mode]
+	));
+	
+	console.log(
+		('            ' + mode).slice(-12) +
+		'  rss ' + res.rss.toFixed(0) + ' B' +
+		'  js heap ' + res.heap.toFixed(0) + ' B' +
+		'  external ' + res.external.toFixed(0) + ' B' +
+		'  (per interface)'
+	);
+});
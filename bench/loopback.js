@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Datagrams read through the loopback backend, the native generator writing
+ * at full speed to one interface of a wire while the other one is read with
+ * a few batch sizes, with and without an emulated link. Needs no privilege.
+ * Run with : node bench/loopback.js [milliseconds]
+ */
+
+var tuntap = require('../index.js');
+
+var duration = parseInt(process.argv[2]) || 500;
+var batches = [1, 16, 64];
+var links = [
+	{ name: 'direct', wire: {} },
+	{ name: 'latency 1ms', wire: { latency: 1 } },
+	{ name: 'loss 1%', wire: { loss: 0.01 } },
+];
+
+var runs = [];
+links.forEach(function(link) {
+	batches.forEach(function(batch) {
+		runs.push({ link: link, batch: batch });
+	});
+});
+
+function next(i) {
+	var run = runs[i];
+	var wire = 'bench' + i;
+	var received = 0;
+	var cpu;
+	var tx, rx;
+	
+	if(!run)
+		return;
+	
+	tx = tuntap({
+		type: 'tun',
+		loopback: Object.assign({ wire: wire }, run.link.wire),
+	});
+	
+	rx = tuntap({
+		type: 'tun',
+		loopback: wire,
+		read_batch: run.batch,
+	});
+	
+	rx.on('data', function() {
+		received++;
+	});
+	
+	tx.generate({
+		src: '10.211.0.1',
+		dst: '10.211.0.2',
+		dport: 9,
+		size: 64,
+		rate: 0,
+		duration: duration,
+	});
+	
+	cpu = process.cpuUsage();
+	
+	tx.once('generated', function(st) {
+		// The datagrams still on their way
+		setTimeout(function() {
+			var used = process.cpuUsage(cpu);
+			var kernel = rx.stats().kernel;
+			
+			console.log(
+				(run.link.name + '            ').slice(0, 12) +
+				'  batch ' + ('  ' + run.batch).slice(-2) +
+				'  sent ' + ('       ' + Math.round(st.pps)).slice(-7) + ' pps' +
+				'  read ' + ('       ' + Math.round(received * 1000 / duration)).slice(-7) + ' pps' +
+				'  cpu ' + ('    ' + Math.round((used.user + used.system) / 1000)).slice(-4) + ' ms' +
+				(kernel.tx_dropped ? '  dropped ' + kernel.tx_dropped : '') +
+				(tx.stats().kernel.lost ? '  lost ' + tx.stats().kernel.lost : '')
+			);
+			
+			tx.close();
+			rx.close();
+			next(i + 1);
+		}, 50);
+	});
+}
+
+next(0);
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Per interface watchers against the shared reactor, with a growing number 
+ * of interfaces receiving the same total traffic. Needs the rights to create 
+ * interfaces. Run with : node bench/reactor.js [packets] [counts...]
+ */
+
+var dgram = require('dgram');
+var tuntap = require('../index.js');
+
+var packets = parseInt(process.argv[2]) || 20000;
+var counts = process.argv.slice(3).map(Number);
+
+if(counts.length == 0)
+	counts = [10, 100, 250];
+
+function addr(i, host) {
+	return('10.' + (200 + (i >> 8)) + '.' + (i & 0xFF) + '.' + host);
+}
+
+function run(count, reactor, cb) {
+	var tts = [];
+	var received = 0;
+	var sock = dgram.createSocket('udp4');
+	var payload = Buffer.alloc(64);
+	var start, cpu, idle, last;
+	
+	for(var i = 0 ; i < count ; i++) {
+		var tt = tuntap({
+			type: 'tun',
+			name: 'bench' + i,
+			addr: addr(i, 1),
+			dest: addr(i, 2),
+			mask: '255.255.255.255',
+			persist: false,
+			ethtype_comp: 'none',
+			read_batch: 16,
+			reactor: reactor,
+		});
+		
+		// Only count the benchmark datagrams (IPv4, 4 bytes of header)
+		tt.on('data', function(data) {
+			if(!start || data.length != payload.length + 32 || (data[4] >> 4) != 4)
+				return;
+			last = process.hrtime();
+			if(++received == packets)
+				done();
+		});
+		tts.push(tt);
+	}
+	
+	function done() {
+		if(!idle)
+			return;
+		var elapsed = [last[0] - start[0], last[1] - start[1]];
+		var used = process.cpuUsage(cpu);
+		var stats = tts[0].stats();
+		
+		clearInterval(idle);
+		idle = null;
+		elapsed = elapsed[0] * 1e3 + elapsed[1] / 1e6;
+		tts.forEach(function(tt) {
+			tt.close();
+		});
+		sock.close();
+		cb({
+			received: received,
+			ms: elapsed,
+			cpu: (used.user + used.system) / 1e3,
+			wakeups: reactor ? stats.reactor.wakeups : undefined,
+		});
+	}
+	
+	// Let the interfaces settle (IPv6 autoconfiguration, ...)
+	setTimeout(function() {
+		var sent = 0;
+		
+		received = 0;
+		start = last = process.hrtime();
+		cpu = process.cpuUsage();
+		
+		// The kernel may drop some datagrams : stop when nothing comes
+		idle = setInterval(function() {
+			if(process.hrtime(last)[0] >= 1)
+				done();
+		}, 100);
+		
+		function send() {
+			for(var i = 0 ; i < 256 && sent < packets ; i++, sent++)
+				sock.send(payload, 9, addr(sent % count, 2));
+			if(sent < packets)
+				setImmediate(send);
+		}
+		send();
+	}, 500);
+}
+
+var modes = [];
+counts.forEach(function(count) {
+	modes.push([count, false]);
+	modes.push([count, true]);
+});
+
+function next() {
+	var mode = modes.shift();
+	
+	if(!mode)
+		return;
+	run(mode[0], mode[1], function(res) {
+		console.log(
+			'interfaces ' + ('    ' + mode[0]).slice(-4) +
+			(mode[1] ? ' reactor' : ' watcher') +
+			'  ' + res.received + ' packets' +
+			'  ' + res.ms.toFixed(1) + ' ms' +
+			'  cpu ' + res.cpu.toFixed(1) + ' ms' +
+			(res.wakeups !== undefined ? '  wakeups ' + res.wakeups : '')
+		);
+		setTimeout(next, 100);
+	});
+}
+next();
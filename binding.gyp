@@ -9,7 +9,42 @@
 				"src/tuntap.hh",
 				"src/ethertypes.cc",
 				"src/ethertypes.hh",
+				"src/inet.cc",
+				"src/inet.hh",
+				"src/ipfrag.cc",
+				"src/ipfrag.hh",
+				"src/offload.cc",
+				"src/offload.hh",
+				"src/capture.cc",
+				"src/capture.hh",
+				"src/histogram.cc",
+				"src/histogram.hh",
+				"src/aead.cc",
+				"src/aead.hh",
+				"src/lz4.cc",
+				"src/lz4.hh",
+				"src/ring.cc",
+				"src/ring.hh",
+				"src/shaper.cc",
+				"src/shaper.hh",
+				"src/fqcodel.cc",
+				"src/fqcodel.hh",
+				"src/reactor.cc",
+				"src/reactor.hh",
+				"src/bufpool.cc",
+				"src/bufpool.hh",
+				"src/generator.cc",
+				"src/generator.hh",
+				"src/flowmeter.cc",
+				"src/flowmeter.hh",
+				"src/neighbor.cc",
+				"src/neighbor.hh",
+				"src/autotune.cc",
+				"src/autotune.hh",
+				"src/vlan.cc",
+				"src/vlan.hh",
 				"src/tuntap-itf/tuntap-itf.cc",
+				"src/tuntap-itf/tuntap-itf-loopback.cc",
 				"src/tuntap-itf/tuntap-itf.hh",
 			]
 		}
@@ -0,0 +1,170 @@
+# This file is generated by gyp; do not edit.
+
+TOOLSET := target
+TARGET := tuntap
+DEFS_Debug := \
+	'-DNODE_GYP_MODULE_NAME=tuntap' \
+	'-DUSING_UV_SHARED=1' \
+	'-DUSING_V8_SHARED=1' \
+	'-DV8_DEPRECATION_WARNINGS=1' \
+	'-D_LARGEFILE_SOURCE' \
+	'-D_FILE_OFFSET_BITS=64' \
+	'-DOPENSSL_NO_PINSHARED' \
+	'-DBUILDING_NODE_EXTENSION' \
+	'-DDEBUG' \
+	'-D_DEBUG' \
+	'-DV8_ENABLE_CHECKS'
+
+# Flags passed to all source files.
+CFLAGS_Debug := \
+	-fPIC \
+	-pthread \
+	-Wall \
+	-Wextra \
+	-Wno-unused-parameter \
+	-m64 \
+	-g \
+	-O0
+
+# Flags passed to only C files.
+CFLAGS_C_Debug :=
+
+# Flags passed to only C++ files.
+CFLAGS_CC_Debug := \
+	-fno-rtti \
+	-fno-exceptions \
+	-std=gnu++1y
+
+INCS_Debug := \
+	-I/root/.nvm/versions/node/v10.24.1/include/node \
+	-I/root/.nvm/versions/node/v10.24.1/src \
+	-I/root/.nvm/versions/node/v10.24.1/deps/openssl/config \
+	-I/root/.nvm/versions/node/v10.24.1/deps/openssl/openssl/include \
+	-I/root/.nvm/versions/node/v10.24.1/deps/uv/include \
+	-I/root/.nvm/versions/node/v10.24.1/deps/zlib \
+	-I/root/.nvm/versions/node/v10.24.1/deps/v8/include
+
+DEFS_Release := \
+	'-DNODE_GYP_MODULE_NAME=tuntap' \
+	'-DUSING_UV_SHARED=1' \
+	'-DUSING_V8_SHARED=1' \
+	'-DV8_DEPRECATION_WARNINGS=1' \
+	'-D_LARGEFILE_SOURCE' \
+	'-D_FILE_OFFSET_BITS=64' \
+	'-DOPENSSL_NO_PINSHARED' \
+	'-DBUILDING_NODE_EXTENSION'
+
+# Flags passed to all source files.
+CFLAGS_Release := \
+	-fPIC \
+	-pthread \
+	-Wall \
+	-Wextra \
+	-Wno-unused-parameter \
+	-m64 \
+	-O3 \
+	-fno-omit-frame-pointer
+
+# Flags passed to only C files.
+CFLAGS_C_Release :=
+
+# Flags passed to only C++ files.
+CFLAGS_CC_Release := \
+	-fno-rtti \
+	-fno-exceptions \
+	-std=gnu++1y
+
+INCS_Release := \
+	-I/root/.nvm/versions/node/v10.24.1/include/node \
+	-I/root/.nvm/versions/node/v10.24.1/src \
+	-I/root/.nvm/versions/node/v10.24.1/deps/openssl/config \
+	-I/root/.nvm/versions/node/v10.24.1/deps/openssl/openssl/include \
+	-I/root/.nvm/versions/node/v10.24.1/deps/uv/include \
+	-I/root/.nvm/versions/node/v10.24.1/deps/zlib \
+	-I/root/.nvm/versions/node/v10.24.1/deps/v8/include
+
+OBJS := \
+	$(obj).target/$(TARGET)/src/module.o \
+	$(obj).target/$(TARGET)/src/tuntap.o \
+	$(obj).target/$(TARGET)/src/ethertypes.o \
+	$(obj).target/$(TARGET)/src/inet.o \
+	$(obj).target/$(TARGET)/src/ipfrag.o \
+	$(obj).target/$(TARGET)/src/offload.o \
+	$(obj).target/$(TARGET)/src/capture.o \
+	$(obj).target/$(TARGET)/src/histogram.o \
+	$(obj).target/$(TARGET)/src/aead.o \
+	$(obj).target/$(TARGET)/src/lz4.o \
+	$(obj).target/$(TARGET)/src/ring.o \
+	$(obj).target/$(TARGET)/src/shaper.o \
+	$(obj).target/$(TARGET)/src/fqcodel.o \
+	$(obj).target/$(TARGET)/src/reactor.o \
+	$(obj).target/$(TARGET)/src/bufpool.o \
+	$(obj).target/$(TARGET)/src/generator.o \
+	$(obj).target/$(TARGET)/src/flowmeter.o \
+	$(obj).target/$(TARGET)/src/neighbor.o \
+	$(obj).target/$(TARGET)/src/autotune.o \
+	$(obj).target/$(TARGET)/src/vlan.o \
+	$(obj).target/$(TARGET)/src/tuntap-itf/tuntap-itf.o \
+	$(obj).target/$(TARGET)/src/tuntap-itf/tuntap-itf-loopback.o
+
+# Add to the list of files we specially track dependencies for.
+all_deps += $(OBJS)
+
+# CFLAGS et al overrides must be target-local.
+# See "Target-specific Variable Values" in the GNU Make manual.
+$(OBJS): TOOLSET := $(TOOLSET)
+$(OBJS): GYP_CFLAGS := $(DEFS_$(BUILDTYPE)) $(INCS_$(BUILDTYPE))  $(CFLAGS_$(BUILDTYPE)) $(CFLAGS_C_$(BUILDTYPE))
+$(OBJS): GYP_CXXFLAGS := $(DEFS_$(BUILDTYPE)) $(INCS_$(BUILDTYPE))  $(CFLAGS_$(BUILDTYPE)) $(CFLAGS_CC_$(BUILDTYPE))
+
+# Suffix rules, putting all outputs into $(obj).
+
+$(obj).$(TOOLSET)/$(TARGET)/%.o: $(srcdir)/%.cc FORCE_DO_CMD
+	@$(call do_cmd,cxx,1)
+
+# Try building from generated source, too.
+
+$(obj).$(TOOLSET)/$(TARGET)/%.o: $(obj).$(TOOLSET)/%.cc FORCE_DO_CMD
+	@$(call do_cmd,cxx,1)
+
+$(obj).$(TOOLSET)/$(TARGET)/%.o: $(obj)/%.cc FORCE_DO_CMD
+	@$(call do_cmd,cxx,1)
+
+# End of this set of suffix rules
+### Rules for final target.
+LDFLAGS_Debug := \
+	-pthread \
+	-rdynamic \
+	-m64
+
+LDFLAGS_Release := \
+	-pthread \
+	-rdynamic \
+	-m64
+
+LIBS :=
+
+$(obj).target/tuntap.node: GYP_LDFLAGS := $(LDFLAGS_$(BUILDTYPE))
+$(obj).target/tuntap.node: LIBS := $(LIBS)
+$(obj).target/tuntap.node: TOOLSET := $(TOOLSET)
+$(obj).target/tuntap.node: $(OBJS) FORCE_DO_CMD
+	$(call do_cmd,solink_module)
+
+all_deps += $(obj).target/tuntap.node
+# Add target alias
+.PHONY: tuntap
+tuntap: $(builddir)/tuntap.node
+
+# Copy this to the executable output path.
+$(builddir)/tuntap.node: TOOLSET := $(TOOLSET)
+$(builddir)/tuntap.node: $(obj).target/tuntap.node FORCE_DO_CMD
+	$(call do_cmd,copy)
+
+all_deps += $(builddir)/tuntap.node
+# Short alias for building this executable.
+.PHONY: tuntap.node
+tuntap.node: $(obj).target/tuntap.node $(builddir)/tuntap.node
+
+# Add executable to "all" target.
+.PHONY: all
+all: $(builddir)/tuntap.node
+
@@ -24,6 +24,7 @@ var tuntapBind = require('./build/Release/tuntap');
 var util = require('util');
 
 util.inherits(tuntap, stream.Duplex);
+util.inherits(tuntapVlan, stream.Duplex);
 
 function tuntap(params, options) {
 	if(!(this instanceof tuntap)) {
@@ -44,6 +45,55 @@ function tuntap(params, options) {
 			self.handle_.stopRead();
 	}
 	
+	this.handle_._on_read_batch = function(buffers, times) {
+		var paused = false;
+		
+		if(self.listenerCount('batch') > 0)
+			self.emit('batch', buffers, times);
+		
+		for(var i = 0 ; i < buffers.length ; i++) {
+			if(!self.push(buffers[i]))
+				paused = true;
+		}
+		
+		if(paused)
+			self.handle_.stopRead();
+	}
+	
+	this.handle_._on_vlan_batch = function(buffers, ids) {
+		var paused = false;
+		var vlan;
+		
+		for(var i = 0 ; i < buffers.length ; i++) {
+			vlan = self.vlans_[ids[i]];
+			if(vlan && !vlan.push(buffers[i]))
+				paused = true;
+		}
+		
+		if(paused)
+			self.handle_.stopRead();
+	}
+	
+	this.handle_._on_ring = function(count) {
+		self.emit('ring', count);
+	}
+	
+	this.handle_._on_available = function() {
+		self.emit('available');
+	}
+	
+	this.handle_._on_generated = function() {
+		self.emit('generated', self.handle_.stats().generator);
+	}
+	
+	this.handle_._on_flows = function(records) {
+		self.emit('flows', records);
+	}
+	
+	this.handle_._on_tune = function(change) {
+		self.emit('tune', change);
+	}
+	
 	this.handle_._on_error = function(error) {
 		self.emit('error', error);
 	}
@@ -70,6 +120,28 @@ tuntap.prototype._write = function(buffer, encoding, callback) {
 	callback();
 }
 
+tuntap.prototype._writev = function(chunks, callback) {
+	var buffers = [];
+	
+	if(this.is_open) {
+		for(var i = 0 ; i < chunks.length ; i++) {
+			if(!Buffer.isBuffer(chunks[i].chunk))
+				buffers.push(new Buffer(chunks[i].chunk, chunks[i].encoding));
+			else
+				buffers.push(chunks[i].chunk);
+		}
+		
+		try {
+			this.handle_.writeBuffers(buffers);
+		}
+		catch(e) {
+			this.emit('error', e);
+		}
+	}
+	
+	callback();
+}
+
 tuntap.prototype.open = function(arg) {
 	var ret;
 	
@@ -101,9 +173,28 @@ tuntap.prototype.close = function() {
 		this.emit('error', e);
 	}
 	
+	// Wake up the pending readers, which will find the interface closed
+	if(this.pulling_)
+		this.emit('available');
+	
 	return(this);
 }
 
+tuntap.prototype.detach = function() {
+	var fd;
+	
+	this.is_open = false;
+	
+	try {
+		fd = this.handle_.detach();
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(fd);
+}
+
 tuntap.prototype.set = function(params) {
 	try {
 		this.handle_.set(params);
@@ -126,13 +217,445 @@ tuntap.prototype.unset = function(params) {
 	return(this);
 }
 
+tuntap.prototype.stats = function() {
+	return(this.handle_.stats());
+}
+
+tuntap.prototype.latency = function(reset) {
+	return(this.handle_.latency(reset));
+}
+
+tuntap.prototype.capture = function(options) {
+	try {
+		this.handle_.capture(options);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.aeadPeer = function(id, options) {
+	try {
+		this.handle_.aeadPeer(id, options);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.send = function(buffer, mark) {
+	try {
+		this.handle_.writeBuffer(buffer, mark);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.shaper = function(options) {
+	try {
+		this.handle_.shaper(options);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.ring = function(options) {
+	var ret = null;
+	
+	try {
+		ret = this.handle_.ring(options);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	if(!ret)
+		return(null);
+	
+	return({
+		rx: new tuntap.ring(ret.rx),
+		tx: new tuntap.ring(ret.tx),
+	});
+}
+
+tuntap.prototype.ringWrite = function() {
+	return(this.handle_.ringWrite());
+}
+
+tuntap.prototype.generate = function(options) {
+	try {
+		this.handle_.generate(options);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.flows = function(options) {
+	try {
+		this.handle_.flows(options);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.flushFlows = function() {
+	this.handle_.flushFlows();
+	return(this);
+}
+
+tuntap.prototype.neighbors = function(options) {
+	try {
+		this.handle_.neighbors(options);
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.proxyNeighbor = function(ip, mac) {
+	return(this.handle_.proxyNeighbor(ip, mac));
+}
+
+tuntap.prototype.vlans = function(options) {
+	if(options === false) {
+		for(var id in this.vlans_)
+			this.vlans_[id].close();
+	}
+	
+	this.vlanOptions_ = options || {};
+	this.vlanUpdate_();
+	
+	return(this);
+}
+
+// The stream of the frames of a VLAN, created on first use
+tuntap.prototype.vlan = function(id, options) {
+	if(!this.vlans_)
+		this.vlans_ = {};
+	
+	if(!this.vlans_[id]) {
+		this.vlans_[id] = new tuntapVlan(this, id, options);
+		this.vlanUpdate_();
+	}
+	
+	return(this.vlans_[id]);
+}
+
+tuntap.prototype.vlanUpdate_ = function() {
+	var ids = Object.keys(this.vlans_ || {}).map(Number);
+	
+	try {
+		if(ids.length == 0)
+			this.handle_.vlans(false);
+		else
+			this.handle_.vlans(Object.assign({}, this.vlanOptions_, { ids: ids }));
+	}
+	catch(e) {
+		this.emit('error', e);
+	}
+}
+
+/*
+ * Duplex stream of the frames of a VLAN, read without their 802.1Q tag and
+ * tagged when written. The reads of all the VLANs share the interface.
+ */
+function tuntapVlan(parent, id, options) {
+	stream.Duplex.call(this, options);
+	
+	this.parent_ = parent;
+	this.id = id;
+}
+
+tuntapVlan.prototype._read = function(size) {
+	this.parent_.handle_.startRead();
+}
+
+tuntapVlan.prototype._write = function(buffer, encoding, callback) {
+	if(this.parent_.is_open && this.parent_.vlans_[this.id] === this) {
+		if(!Buffer.isBuffer(buffer)) {
+			buffer = new Buffer(buffer, encoding);
+		}
+		
+		try {
+			this.parent_.handle_.writeVlan(this.id, buffer);
+		}
+		catch(e) {
+			this.emit('error', e);
+		}
+	}
+	
+	callback();
+}
+
+tuntapVlan.prototype._writev = function(chunks, callback) {
+	var buffers = [];
+	
+	if(this.parent_.is_open && this.parent_.vlans_[this.id] === this) {
+		for(var i = 0 ; i < chunks.length ; i++) {
+			if(!Buffer.isBuffer(chunks[i].chunk))
+				buffers.push(new Buffer(chunks[i].chunk, chunks[i].encoding));
+			else
+				buffers.push(chunks[i].chunk);
+		}
+		
+		try {
+			this.parent_.handle_.writeVlan(this.id, buffers);
+		}
+		catch(e) {
+			this.emit('error', e);
+		}
+	}
+	
+	callback();
+}
+
+// Leaves the VLAN, whose frames are then handled as the other VLANs ones
+tuntapVlan.prototype.close = function() {
+	if(this.parent_.vlans_[this.id] === this) {
+		delete this.parent_.vlans_[this.id];
+		this.parent_.vlanUpdate_();
+		this.push(null);
+	}
+	
+	return(this);
+}
+
+tuntap.prototype.pull = function(enable) {
+	this.pulling_ = enable !== false;
+	return(this.handle_.pull(this.pulling_));
+}
+
+tuntap.prototype.readInto = function(buffer, offset) {
+	this.pulling_ = true;
+	return(this.handle_.readInto(buffer, offset));
+}
+
+tuntap.prototype.readManyInto = function(buffer, maxPackets, headroom) {
+	this.pulling_ = true;
+	return(this.handle_.readManyInto(buffer, maxPackets, headroom));
+}
+
+/*
+ * Readable byte stream (WHATWG streams) reading the datagrams into the views
+ * given by BYOB readers, one datagram for each read.
+ */
+tuntap.prototype.readableByteStream = function(options) {
+	var self = this;
+	var RS = (options && options.ReadableStream) || global.ReadableStream;
+	var room;
+	
+	if(!RS) {
+		try {
+			RS = require('stream/web').ReadableStream;
+		}
+		catch(e) {
+			throw new TypeError('No ReadableStream implementation available');
+		}
+	}
+	
+	room = this.pull(true);
+	
+	return(new RS({
+		type: 'bytes',
+		autoAllocateChunkSize: room,
+		
+		pull: function(controller) {
+			return(new Promise(function(resolve) {
+				function attempt() {
+					var request = controller.byobRequest;
+					var len;
+					
+					try {
+						len = self.readInto(request.view);
+					}
+					catch(e) {
+						if(self.is_open) {
+							controller.error(e);
+						}
+						else {
+							controller.close();
+							request.respond(0);
+						}
+						return(resolve());
+					}
+					
+					if(len > 0) {
+						request.respond(len);
+						return(resolve());
+					}
+					
+					self.once('available', attempt);
+				}
+				
+				attempt();
+			}));
+		},
+		
+		cancel: function() {
+			self.pull(false);
+		},
+	}));
+}
+
+/*
+ * View of a packet ring, from its SharedArrayBuffer (which can be sent to a
+ * worker). The read ring is consumed with available(), offset(), length(),
+ * flags() and consume(), the write ring is filled with space(), slot(),
+ * produce() and commit(). None of them allocates.
+ */
+tuntap.ring = function(sab) {
+	if(!(this instanceof tuntap.ring)) {
+		return(new tuntap.ring(sab));
+	}
+	
+	this.buffer = sab;
+	this.index = new Int32Array(sab, 0, 48);
+	this.slots = this.index[32];
+	this.slotSize = this.index[33];
+	this.mask = this.slots - 1;
+	this.desc = new Uint32Array(sab, this.index[34], this.slots * 4);
+	this.data = new Uint8Array(sab);
+}
+
+// Number of datagrams ready to be read
+tuntap.ring.prototype.available = function() {
+	return((Atomics.load(this.index, 0) - Atomics.load(this.index, 16)) | 0);
+}
+
+// Offset in `data` of the i-th datagram to read
+tuntap.ring.prototype.offset = function(i) {
+	return(this.desc[((this.index[16] + i) & this.mask) << 2]);
+}
+
+tuntap.ring.prototype.length = function(i) {
+	return(this.desc[(((this.index[16] + i) & this.mask) << 2) + 1]);
+}
+
+tuntap.ring.prototype.flags = function(i) {
+	return(this.desc[(((this.index[16] + i) & this.mask) << 2) + 2]);
+}
+
+// Releases the n first datagrams read
+tuntap.ring.prototype.consume = function(n) {
+	Atomics.add(this.index, 16, n);
+}
+
+// Number of free slots to write to
+tuntap.ring.prototype.space = function() {
+	return(this.slots - ((Atomics.load(this.index, 0) - Atomics.load(this.index, 16)) | 0));
+}
+
+// Offset in `data` of the i-th free slot
+tuntap.ring.prototype.slot = function(i) {
+	return(this.desc[((this.index[0] + i) & this.mask) << 2]);
+}
+
+// Sets the length and flags of the datagram written in the i-th free slot
+tuntap.ring.prototype.produce = function(i, length, flags) {
+	var d = ((this.index[0] + i) & this.mask) << 2;
+	
+	this.desc[d + 1] = length;
+	this.desc[d + 2] = flags || 0;
+}
+
+// Publishes the n first slots written
+tuntap.ring.prototype.commit = function(n) {
+	Atomics.add(this.index, 0, n);
+}
+
+tuntap.ring.SEALED = 0x1;
+tuntap.ring.RAW = 0x2;
+
+function flowAddress(buffer, offset, family) {
+	var words = [];
+	var best = -1;
+	var bestLen = 1;
+	var run = 0;
+	var i;
+	
+	if(family == 4)
+		return(Array.prototype.slice.call(buffer, offset, offset + 4).join('.'));
+	
+	for(i = 0 ; i < 8 ; i++) {
+		words.push(buffer.readUInt16BE(offset + i * 2).toString(16));
+		run = words[i] == '0' ? run + 1 : 0;
+		if(run > bestLen) {
+			best = i - run + 1;
+			bestLen = run;
+		}
+	}
+	
+	if(best < 0)
+		return(words.join(':'));
+	
+	return(words.slice(0, best).join(':') + '::' + words.slice(best + bestLen).join(':'));
+}
+
+/*
+ * Decodes the records of a 'flows' event. Each record takes 80 bytes, little
+ * endian : family, protocol, TCP flags, direction (0 read, 1 write), end
+ * reason (IPFIX flowEndReason) and DSCP on a byte each, source and
+ * destination ports at 8 and 10, source and destination addresses at 16 and
+ * 32, then packets, bytes, first and last times (milliseconds since the
+ * epoch) on 8 bytes each from 48.
+ */
+tuntap.flowRecords = function(buffer) {
+	var ret = [];
+	var u64 = function(o) {
+		return(buffer.readUInt32LE(o) + buffer.readUInt32LE(o + 4) * 0x100000000);
+	};
+	
+	for(var o = 0 ; o + 80 <= buffer.length ; o += 80) {
+		ret.push({
+			family: buffer[o],
+			proto: buffer[o + 1],
+			tcp_flags: buffer[o + 2],
+			direction: buffer[o + 3] ? 'write' : 'read',
+			end_reason: tuntap.flowRecords.END_REASONS[buffer[o + 4]],
+			dscp: buffer[o + 5],
+			sport: buffer.readUInt16LE(o + 8),
+			dport: buffer.readUInt16LE(o + 10),
+			src: flowAddress(buffer, o + 16, buffer[o]),
+			dst: flowAddress(buffer, o + 32, buffer[o]),
+			packets: u64(o + 48),
+			bytes: u64(o + 56),
+			first: u64(o + 64),
+			last: u64(o + 72),
+		});
+	}
+	
+	return(ret);
+}
+
+tuntap.flowRecords.END_REASONS = [ undefined, 'idle', 'active', 'end', 'forced', 'evicted' ];
+
 tuntap.muxer = function(mtu, options) {
 	if(!(this instanceof tuntap.muxer)) {
 		return(new tuntap.muxer(mtu, options));
 	}
 	
 	this.mtu = mtu;
-	this.encBuffer = new Buffer(mtu + 2);
+	this.encBuffer = new Buffer(mtu + 4);
+	this.compress = !!(options && options.compress) && mtu <= 0x7FFF;
+	this.minSize = (options && options.min_size) || 64;
 	
 	stream.Transform.call(this, options);
 }
@@ -144,9 +667,11 @@ tuntap.demuxer = function(mtu, options) {
 	
 	this.mtu = mtu;
 	this.decBuffer = new Buffer(mtu + 2);
+	this.outBuffer = new Buffer(mtu);
 	this.length = 0;
 	this.header = 0;
 	this.remain = 0;
+	this.compressed = false;
 	
 	stream.Transform.call(this, options);
 }
@@ -155,14 +680,24 @@ util.inherits(tuntap.muxer, stream.Transform);
 util.inherits(tuntap.demuxer, stream.Transform);
 
 tuntap.muxer.prototype._transform = function(buffer, encoding, callback) {
+	var length = 0;
+	
 	if(!Buffer.isBuffer(buffer)) {
 		buffer = new Buffer(buffer, encoding);
 	}
 	
-	this.encBuffer.writeUInt16LE(buffer.length, 0);
-	buffer.copy(this.encBuffer, 2);
+	if(this.compress)
+		length = tuntapBind.compress(buffer, this.encBuffer, this.minSize);
 	
-	this.push(this.encBuffer.slice(0, buffer.length + 2));
+	if(length > 0) {
+		this.push(this.encBuffer.slice(0, length));
+	}
+	else {
+		this.encBuffer.writeUInt16LE(buffer.length, 0);
+		buffer.copy(this.encBuffer, 2);
+		
+		this.push(this.encBuffer.slice(0, buffer.length + 2));
+	}
 	
 	callback();
 }
@@ -174,35 +709,51 @@ tuntap.demuxer.prototype._transform = function(buffer, encoding, callback) {
 	
 	var cursor = 0;
 	var copy;
+	var length;
 	
 	while(buffer.length - cursor > 0) {
 		if(this.header < 2) {
-			if(buffer.length >= (2 - this.header))
+			if(buffer.length - cursor >= (2 - this.header))
 				copy = (2 - this.header);
 			else
-				copy = buffer.length;
+				copy = buffer.length - cursor;
 				
-			buffer.copy(this.decBuffer, this.header, cursor);
+			buffer.copy(this.decBuffer, this.header, cursor, cursor + copy);
 			this.header += copy;
 			cursor += copy;
 			
-			if(this.header == 2)
+			if(this.header == 2) {
 				this.length = this.remain = this.decBuffer.readUInt16LE(0);
+				
+				// The flag bit is only meaningful below 32 KiB frames
+				this.compressed = this.mtu <= 0x7FFF && (this.length & 0x8000) != 0;
+				if(this.compressed)
+					this.length = this.remain = this.length & 0x7FFF;
+			}
 			
 			continue;
 		}
 		
-		if(buffer.length >= this.remain)
+		if(buffer.length - cursor >= this.remain)
 			copy = this.remain;
 		else
-			copy = buffer.length;
+			copy = buffer.length - cursor;
 		
 		buffer.copy(this.decBuffer, this.length - this.remain, cursor, cursor + copy);
 		this.remain -= copy;
 		cursor += copy;
 		
 		if(this.remain == 0) {
-			this.push(this.decBuffer.slice(0, this.length));
+			if(!this.compressed) {
+				this.push(this.decBuffer.slice(0, this.length));
+			}
+			else {
+				length = tuntapBind.decompress(this.decBuffer, 2, this.length, this.outBuffer);
+				if(length >= 0 && length == this.decBuffer.readUInt16LE(0))
+					this.push(this.outBuffer.slice(0, length));
+				else
+					this.emit('error', new Error('Invalid compressed frame'));
+			}
 			this.header = 0;
 		}
 	}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "module.hh"
+
+Aead::Aead() :
+		dft_peer(NULL)
+	{
+	this->seal_buff = new uint8_t[AEAD_MAX_DATAGRAM + AEAD_OVERHEAD];
+	this->open_buff = new uint8_t[AEAD_MAX_DATAGRAM + AEAD_OVERHEAD];
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+Aead::~Aead() {
+	std::map<uint32_t, peer_t*>::iterator it;
+	
+	for(it = this->peers.begin() ; it != this->peers.end() ; it++)
+		this->freePeer(it->second);
+	
+	delete[] this->seal_buff;
+	delete[] this->open_buff;
+}
+
+bool Aead::parseCipher(const std::string &name, cipher_e *cipher) {
+	if(name == "chacha20-poly1305")
+		*cipher = CIPHER_CHACHA20_POLY1305;
+	else if(name == "aes-gcm" || name == "aes-128-gcm" || name == "aes-256-gcm")
+		*cipher = CIPHER_AES_GCM;
+	else
+		return(false);
+	
+	return(true);
+}
+
+EVP_CIPHER_CTX *Aead::makeCtx(cipher_e cipher, const uint8_t *key, int key_len, bool enc) {
+	const EVP_CIPHER *evp;
+	EVP_CIPHER_CTX *ctx;
+	
+	/* AES-GCM uses the AES-NI instructions by itself when available */
+	if(cipher == CIPHER_CHACHA20_POLY1305)
+		evp = key_len == 32 ? EVP_chacha20_poly1305() : NULL;
+	else if(key_len == 16)
+		evp = EVP_aes_128_gcm();
+	else if(key_len == 32)
+		evp = EVP_aes_256_gcm();
+	else
+		evp = NULL;
+	
+	if(!evp)
+		return(NULL);
+	
+	ctx = EVP_CIPHER_CTX_new();
+	if(!ctx)
+		return(NULL);
+	
+	if(
+		EVP_CipherInit_ex(ctx, evp, NULL, NULL, NULL, enc ? 1 : 0) != 1 ||
+		EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, 12, NULL) != 1 ||
+		EVP_CipherInit_ex(ctx, NULL, NULL, key, NULL, enc ? 1 : 0) != 1
+	) {
+		EVP_CIPHER_CTX_free(ctx);
+		return(NULL);
+	}
+	
+	return(ctx);
+}
+
+void Aead::makeNonce(uint8_t *nonce, uint64_t counter) {
+	inetWrite32(nonce, 0);
+	inetWrite32(nonce + 4, counter >> 32);
+	inetWrite32(nonce + 8, counter);
+}
+
+bool Aead::setPeer(uint32_t id, cipher_e cipher, const uint8_t *tx_key, const uint8_t *rx_key, int key_len, const uint8_t *addr, int addr_len, bool dft, std::string *err) {
+	std::map<uint32_t, peer_t*>::iterator it = this->peers.find(id);
+	peer_t *old = it != this->peers.end() ? it->second : NULL;
+	peer_t *peer = new peer_t();
+	
+	peer->id = id;
+	peer->cipher = cipher;
+	peer->tx_key.assign((const char*) tx_key, key_len);
+	peer->rx_key.assign((const char*) rx_key, key_len);
+	peer->enc = makeCtx(cipher, tx_key, key_len, true);
+	peer->dec = makeCtx(cipher, rx_key, key_len, false);
+	peer->tx_counter = 0;
+	peer->rx_max = 0;
+	memset(peer->rx_bitmap, 0, sizeof(peer->rx_bitmap));
+	if(addr_len > 0)
+		peer->addr.assign((const char*) addr, addr_len);
+	
+	if(!peer->enc || !peer->dec) {
+		this->freePeer(peer);
+		if(err)
+			*err = "Invalid key length for this cipher";
+		return(false);
+	}
+	
+	/* With the same tx key, the counter goes on : a nonce is never used twice */
+	if(old && old->tx_key == peer->tx_key) {
+		if(old->cipher != cipher) {
+			this->freePeer(peer);
+			if(err)
+				*err = "The cipher of a peer cannot change without a new tx key";
+			return(false);
+		}
+		
+		peer->tx_counter = old->tx_counter;
+		if(old->rx_key == peer->rx_key) {
+			peer->rx_max = old->rx_max;
+			memcpy(peer->rx_bitmap, old->rx_bitmap, sizeof(peer->rx_bitmap));
+		}
+	}
+	
+	this->removePeer(id);
+	
+	this->peers[id] = peer;
+	if(peer->addr.size() > 0)
+		this->routes[peer->addr] = peer;
+	if(dft || !this->dft_peer)
+		this->dft_peer = peer;
+	
+	return(true);
+}
+
+bool Aead::removePeer(uint32_t id) {
+	std::map<uint32_t, peer_t*>::iterator it = this->peers.find(id);
+	peer_t *peer;
+	
+	if(it == this->peers.end())
+		return(false);
+	
+	peer = it->second;
+	this->peers.erase(it);
+	
+	if(peer->addr.size() > 0 && this->routes[peer->addr] == peer)
+		this->routes.erase(peer->addr);
+	
+	if(this->dft_peer == peer)
+		this->dft_peer = this->peers.size() > 0 ? this->peers.begin()->second : NULL;
+	
+	this->freePeer(peer);
+	
+	return(true);
+}
+
+void Aead::freePeer(peer_t *peer) {
+	if(peer->enc)
+		EVP_CIPHER_CTX_free(peer->enc);
+	if(peer->dec)
+		EVP_CIPHER_CTX_free(peer->dec);
+	delete peer;
+}
+
+Aead::peer_t *Aead::routePeer(const uint8_t *l3, int l3_size) {
+	std::map<std::string, peer_t*>::iterator it;
+	
+	if(this->routes.size() == 0 || !l3)
+		return(this->dft_peer);
+	
+	if(l3_size >= 20 && (l3[0] >> 4) == 4)
+		it = this->routes.find(std::string((const char*) l3 + 16, 4));
+	else if(l3_size >= 40 && (l3[0] >> 4) == 6)
+		it = this->routes.find(std::string((const char*) l3 + 24, 16));
+	else
+		return(this->dft_peer);
+	
+	if(it == this->routes.end())
+		return(this->dft_peer);
+	
+	return(it->second);
+}
+
+uint8_t *Aead::seal(const uint8_t *data, int size, const uint8_t *l3, int l3_size, int *out_size) {
+	peer_t *peer = this->routePeer(l3, l3_size);
+	uint8_t nonce[12];
+	uint8_t *out = this->seal_buff;
+	int len;
+	
+	if(!peer) {
+		this->stats.no_peer++;
+		return(NULL);
+	}
+	
+	if(size > AEAD_MAX_DATAGRAM) {
+		this->stats.malformed++;
+		return(NULL);
+	}
+	
+	if(peer->tx_counter == UINT64_MAX) {
+		this->stats.exhausted++;
+		return(NULL);
+	}
+	
+	inetWrite32(out, peer->id);
+	inetWrite32(out + 4, peer->tx_counter >> 32);
+	inetWrite32(out + 8, peer->tx_counter);
+	makeNonce(nonce, peer->tx_counter);
+	peer->tx_counter++;
+	
+	if(
+		EVP_EncryptInit_ex(peer->enc, NULL, NULL, NULL, nonce) != 1 ||
+		EVP_EncryptUpdate(peer->enc, NULL, &len, out, AEAD_HDR_LEN) != 1 ||
+		EVP_EncryptUpdate(peer->enc, out + AEAD_HDR_LEN, &len, data, size) != 1 ||
+		EVP_EncryptFinal_ex(peer->enc, out + AEAD_HDR_LEN + len, &len) != 1 ||
+		EVP_CIPHER_CTX_ctrl(peer->enc, EVP_CTRL_AEAD_GET_TAG, AEAD_TAG_LEN, out + AEAD_HDR_LEN + size) != 1
+	) {
+		this->stats.malformed++;
+		return(NULL);
+	}
+	
+	this->stats.sealed++;
+	*out_size = AEAD_HDR_LEN + size + AEAD_TAG_LEN;
+	
+	return(out);
+}
+
+uint8_t *Aead::open(const uint8_t *data, int size, int *out_size) {
+	std::map<uint32_t, peer_t*>::iterator it;
+	peer_t *peer;
+	uint8_t nonce[12];
+	uint8_t tag[AEAD_TAG_LEN];
+	uint64_t counter;
+	int plain = size - AEAD_OVERHEAD;
+	int len;
+	
+	if(plain < 0 || plain > AEAD_MAX_DATAGRAM) {
+		this->stats.malformed++;
+		return(NULL);
+	}
+	
+	it = this->peers.find(inetRead32(data));
+	if(it == this->peers.end()) {
+		this->stats.no_peer++;
+		return(NULL);
+	}
+	peer = it->second;
+	
+	counter = ((uint64_t) inetRead32(data + 4) << 32) | inetRead32(data + 8);
+	
+	/* Cheap check first, the window is only updated once authenticated */
+	if(!this->replayCheck(peer, counter)) {
+		this->stats.replayed++;
+		return(NULL);
+	}
+	
+	makeNonce(nonce, counter);
+	memcpy(tag, data + AEAD_HDR_LEN + plain, AEAD_TAG_LEN);
+	
+	if(
+		EVP_DecryptInit_ex(peer->dec, NULL, NULL, NULL, nonce) != 1 ||
+		EVP_DecryptUpdate(peer->dec, NULL, &len, data, AEAD_HDR_LEN) != 1 ||
+		EVP_DecryptUpdate(peer->dec, this->open_buff, &len, data + AEAD_HDR_LEN, plain) != 1 ||
+		EVP_CIPHER_CTX_ctrl(peer->dec, EVP_CTRL_AEAD_SET_TAG, AEAD_TAG_LEN, tag) != 1 ||
+		EVP_DecryptFinal_ex(peer->dec, this->open_buff + len, &len) != 1
+	) {
+		this->stats.auth_failed++;
+		return(NULL);
+	}
+	
+	this->replayUpdate(peer, counter);
+	
+	this->stats.opened++;
+	*out_size = plain;
+	
+	return(this->open_buff);
+}
+
+bool Aead::replayCheck(peer_t *peer, uint64_t counter) const {
+	if(counter > peer->rx_max)
+		return(true);
+	
+	if(peer->rx_max - counter >= AEAD_REPLAY_BITS - 64)
+		return(false);
+	
+	return(!((peer->rx_bitmap[(counter / 64) % AEAD_REPLAY_WORDS] >> (counter % 64)) & 1));
+}
+
+void Aead::replayUpdate(peer_t *peer, uint64_t counter) {
+	uint64_t cur;
+	uint64_t diff;
+	uint64_t i;
+	
+	if(counter > peer->rx_max) {
+		cur = peer->rx_max / 64;
+		diff = counter / 64 - cur;
+		if(diff > AEAD_REPLAY_WORDS)
+			diff = AEAD_REPLAY_WORDS;
+		
+		for(i = 1 ; i <= diff ; i++)
+			peer->rx_bitmap[(cur + i) % AEAD_REPLAY_WORDS] = 0;
+		
+		peer->rx_max = counter;
+	}
+	
+	peer->rx_bitmap[(counter / 64) % AEAD_REPLAY_WORDS] |= 1ULL << (counter % 64);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _H_NODETUNTAP_AEAD
+#define _H_NODETUNTAP_AEAD
+
+#include <openssl/evp.h>
+
+#define AEAD_HDR_LEN			12
+#define AEAD_TAG_LEN			16
+#define AEAD_OVERHEAD			(AEAD_HDR_LEN + AEAD_TAG_LEN)
+#define AEAD_REPLAY_WORDS		32
+#define AEAD_REPLAY_BITS		(AEAD_REPLAY_WORDS * 64)
+#define AEAD_MAX_DATAGRAM		(65535 + INET_TAP_L3_OFF)
+
+/*
+ * Authenticated encryption of the tunnel datagrams.
+ * 
+ * Each sealed datagram starts with a 12 bytes header, made of the peer id
+ * (4 bytes) and the sender counter (8 bytes), both big endian. The header is
+ * authenticated, and the counter is the nonce. The ciphertext follows, then
+ * the 16 bytes tag.
+ * 
+ * Each peer has a key for each direction, so that the two ends never use
+ * the same key and nonce pair. Received counters go through a sliding
+ * window replay check (RFC 6479).
+ * 
+ * Replacing a peer with the same tx key keeps its counter, so that no nonce
+ * is used twice. A removed peer loses its counter : it must come back with
+ * new keys.
+ */
+class Aead {
+	public:
+		Aead();
+		~Aead();
+		
+		enum cipher_e {
+			CIPHER_CHACHA20_POLY1305,
+			CIPHER_AES_GCM,
+		};
+		
+		struct stats_t {
+			uint64_t sealed;
+			uint64_t opened;
+			uint64_t no_peer;
+			uint64_t auth_failed;
+			uint64_t replayed;
+			uint64_t malformed;
+			uint64_t exhausted;
+		};
+		
+		static bool parseCipher(const std::string &name, cipher_e *cipher);
+		
+		bool setPeer(uint32_t id, cipher_e cipher, const uint8_t *tx_key, const uint8_t *rx_key, int key_len, const uint8_t *addr, int addr_len, bool dft, std::string *err);
+		bool removePeer(uint32_t id);
+		const stats_t &getStats() const { return(this->stats); }
+		
+		/*
+		 * `l3` is the network header of the plain datagram (NULL if unknown),
+		 * used to select the peer from its destination address. Returns a
+		 * pointer to the sealed datagram, valid until the next call, or NULL.
+		 */
+		uint8_t *seal(const uint8_t *data, int size, const uint8_t *l3, int l3_size, int *out_size);
+		uint8_t *open(const uint8_t *data, int size, int *out_size);
+		
+	private:
+		struct peer_t {
+			uint32_t id;
+			cipher_e cipher;
+			std::string tx_key;
+			std::string rx_key;
+			EVP_CIPHER_CTX *enc;
+			EVP_CIPHER_CTX *dec;
+			uint64_t tx_counter;
+			uint64_t rx_max;
+			uint64_t rx_bitmap[AEAD_REPLAY_WORDS];
+			std::string addr;
+		};
+		
+		static EVP_CIPHER_CTX *makeCtx(cipher_e cipher, const uint8_t *key, int key_len, bool enc);
+		static void makeNonce(uint8_t *nonce, uint64_t counter);
+		
+		void freePeer(peer_t *peer);
+		peer_t *routePeer(const uint8_t *l3, int l3_size);
+		bool replayCheck(peer_t *peer, uint64_t counter) const;
+		void replayUpdate(peer_t *peer, uint64_t counter);
+		
+		std::map<uint32_t, peer_t*> peers;
+		std::map<std::string, peer_t*> routes;
+		peer_t *dft_peer;
+		
+		uint8_t *seal_buff;
+		uint8_t *open_buff;
+		
+		stats_t stats;
+};
+
+#endif
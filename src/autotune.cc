@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+Autotune::Autotune(const opts_t &opts) :
+	opts(opts),
+	has_last(false),
+	sndbuf_calm(0),
+	txqueuelen_calm(0),
+	txqueuelen_shrunk(false)
+{
+	memset(&this->last, 0, sizeof(this->last));
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+int Autotune::clamp(int val, int min, int max) const {
+	if(val < min)
+		return(min);
+	if(val > max)
+		return(max);
+	return(val);
+}
+
+int Autotune::step(const sample_t &sample, change_t *changes) {
+	bool rx_dropped = this->has_last && sample.rx_dropped > this->last.rx_dropped;
+	bool tx_dropped = this->has_last && sample.tx_dropped > this->last.tx_dropped;
+	bool held = sample.write_queued > 0 || (this->has_last && sample.write_eagain > this->last.write_eagain);
+	int sndbuf = sample.sndbuf;
+	int txqueuelen = sample.txqueuelen;
+	const char *sndbuf_reason = "bounds";
+	const char *txqueuelen_reason = "bounds";
+	int count = 0;
+	
+	this->stats.samples++;
+	
+	/* Shrinking the queue drops the datagrams beyond its new length */
+	if(this->txqueuelen_shrunk)
+		tx_dropped = false;
+	this->txqueuelen_shrunk = false;
+	
+	/* The datagrams sent to the device overflowed its queue */
+	if(tx_dropped) {
+		txqueuelen = txqueuelen > this->opts.txqueuelen_max / 2 ? this->opts.txqueuelen_max : txqueuelen * 2;
+		txqueuelen_reason = "tx_dropped";
+		this->txqueuelen_calm = 0;
+	}
+	else if(++this->txqueuelen_calm >= this->opts.calm) {
+		txqueuelen = txqueuelen - txqueuelen / 4;
+		txqueuelen_reason = "calm";
+		this->txqueuelen_calm = 0;
+	}
+	
+	/* Drops after the writes : less in flight. Held writes : more in flight */
+	if(rx_dropped) {
+		sndbuf = sndbuf / 2;
+		sndbuf_reason = "rx_dropped";
+		this->sndbuf_calm = 0;
+	}
+	else if(held) {
+		sndbuf = sndbuf > this->opts.sndbuf_max / 2 ? this->opts.sndbuf_max : sndbuf * 2;
+		sndbuf_reason = "write_backlog";
+		this->sndbuf_calm = 0;
+	}
+	else if(++this->sndbuf_calm >= this->opts.calm) {
+		sndbuf = sndbuf - sndbuf / 4;
+		sndbuf_reason = "calm";
+		this->sndbuf_calm = 0;
+	}
+	
+	txqueuelen = this->clamp(txqueuelen, this->opts.txqueuelen_min, this->opts.txqueuelen_max);
+	sndbuf = this->clamp(sndbuf, this->opts.sndbuf_min, this->opts.sndbuf_max);
+	
+	if(txqueuelen != sample.txqueuelen) {
+		this->txqueuelen_shrunk = txqueuelen < sample.txqueuelen;
+		changes[count].param = PARAM_TXQUEUELEN;
+		changes[count].from = sample.txqueuelen;
+		changes[count].to = txqueuelen;
+		changes[count].reason = txqueuelen_reason;
+		count++;
+	}
+	
+	if(sndbuf != sample.sndbuf) {
+		changes[count].param = PARAM_SNDBUF;
+		changes[count].from = sample.sndbuf;
+		changes[count].to = sndbuf;
+		changes[count].reason = sndbuf_reason;
+		count++;
+	}
+	
+	this->last = sample;
+	this->has_last = true;
+	this->stats.adjustments += count;
+	
+	return(count);
+}
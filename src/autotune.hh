@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_AUTOTUNE
+#define _H_NODETUNTAP_AUTOTUNE
+
+#define AUTOTUNE_DFT_INTERVAL		1000
+#define AUTOTUNE_DFT_CALM		10
+#define AUTOTUNE_DFT_SNDBUF_MIN		(64 * 1024)
+#define AUTOTUNE_DFT_SNDBUF_MAX		(16 * 1024 * 1024)
+#define AUTOTUNE_DFT_TXQLEN_MIN		64
+#define AUTOTUNE_DFT_TXQLEN_MAX		10000
+
+/*
+ * Kernel queue tuner. At each sample, the device queue length (the datagrams
+ * waiting to be read) doubles when the kernel dropped datagrams sent to the
+ * device, and the send buffer (the datagrams written but not processed yet)
+ * doubles when writes are held back, or halves when the kernel drops what
+ * was written. Both shrink by a quarter after `calm` samples without any
+ * pressure, as big queues only add latency. They always stay within their
+ * bounds.
+ */
+class Autotune {
+	public:
+		enum param_e {
+			PARAM_SNDBUF,
+			PARAM_TXQUEUELEN,
+		};
+		
+		struct opts_t {
+			opts_t() :
+				interval(AUTOTUNE_DFT_INTERVAL),
+				calm(AUTOTUNE_DFT_CALM),
+				sndbuf_min(AUTOTUNE_DFT_SNDBUF_MIN),
+				sndbuf_max(AUTOTUNE_DFT_SNDBUF_MAX),
+				txqueuelen_min(AUTOTUNE_DFT_TXQLEN_MIN),
+				txqueuelen_max(AUTOTUNE_DFT_TXQLEN_MAX)
+			{}
+			
+			int interval;
+			int calm;
+			int sndbuf_min;
+			int sndbuf_max;
+			int txqueuelen_min;
+			int txqueuelen_max;
+		};
+		
+		/* The current limits and the counters since the device was opened */
+		struct sample_t {
+			int sndbuf;
+			int txqueuelen;
+			uint64_t rx_dropped;
+			uint64_t tx_dropped;
+			uint64_t write_eagain;
+			size_t write_queued;
+		};
+		
+		struct change_t {
+			param_e param;
+			int from;
+			int to;
+			const char *reason;
+		};
+		
+		struct stats_t {
+			uint64_t samples;
+			uint64_t adjustments;
+			uint64_t errors;
+		};
+		
+		Autotune(const opts_t &opts);
+		
+		const opts_t &getOpts() const { return(this->opts); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+		/* Forgets the previous sample, when the device changes */
+		void reset() { this->has_last = false; }
+		
+		/* Returns the number of changes (at most 2) to apply */
+		int step(const sample_t &sample, change_t *changes);
+		
+		/* A change could not be applied */
+		void failed() { this->stats.adjustments--; this->stats.errors++; }
+		
+	private:
+		int clamp(int val, int min, int max) const;
+		
+		opts_t opts;
+		sample_t last;
+		bool has_last;
+		int sndbuf_calm;
+		int txqueuelen_calm;
+		bool txqueuelen_shrunk;
+		
+		stats_t stats;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+BufPool::BufPool() {
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+BufPool::~BufPool() {
+	for(size_t i = 0 ; i < this->free_list.size() ; i++)
+		delete[] this->free_list[i].first;
+}
+
+/* Freed when the thread (main thread or worker) exits */
+BufPool *BufPool::local() {
+	static thread_local BufPool pool;
+	
+	return(&pool);
+}
+
+uint8_t *BufPool::acquire(int *size) {
+	uint8_t *data;
+	
+	this->stats.leases++;
+	
+	/* The free list is kept sorted, the biggest buffer last */
+	if(this->free_list.size() > 0 && this->free_list.back().second >= *size) {
+		data = this->free_list.back().first;
+		*size = this->free_list.back().second;
+		this->free_list.pop_back();
+		return(data);
+	}
+	
+	this->stats.buffers++;
+	this->stats.bytes += *size;
+	this->stats.allocs++;
+	return(new uint8_t[*size]);
+}
+
+void BufPool::release(uint8_t *data, int size) {
+	std::vector<std::pair<uint8_t*, int> >::iterator it;
+	
+	if(this->free_list.size() >= BUFPOOL_MAX_FREE) {
+		/* Drop the smallest one */
+		if(this->free_list.front().second >= size) {
+			this->stats.buffers--;
+			this->stats.bytes -= size;
+			delete[] data;
+			return;
+		}
+		
+		this->stats.buffers--;
+		this->stats.bytes -= this->free_list.front().second;
+		delete[] this->free_list.front().first;
+		this->free_list.erase(this->free_list.begin());
+	}
+	
+	it = this->free_list.begin();
+	while(it != this->free_list.end() && it->second <= size)
+		it++;
+	this->free_list.insert(it, std::make_pair(data, size));
+}
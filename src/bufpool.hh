@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_BUFPOOL
+#define _H_NODETUNTAP_BUFPOOL
+
+#define BUFPOOL_MAX_FREE		8
+
+/*
+ * Per thread pool of read buffers. The interfaces in lean mode have no read
+ * buffer of their own, and borrow one from the pool of their thread for the
+ * duration of a read round only, so that idle interfaces hold none. A few
+ * buffers are kept for reuse, the biggest ones first.
+ */
+class BufPool {
+	public:
+		struct stats_t {
+			uint64_t buffers;
+			uint64_t bytes;
+			uint64_t leases;
+			uint64_t allocs;
+		};
+		
+		/* Borrows a buffer for the current scope */
+		class Lease {
+			public:
+				Lease(uint8_t *own, int size) :
+						pool(NULL),
+						size(size)
+					{
+					if(own) {
+						this->data = own;
+					}
+					else {
+						this->pool = BufPool::local();
+						this->data = this->pool->acquire(&this->size);
+					}
+				}
+				
+				~Lease() {
+					if(this->pool)
+						this->pool->release(this->data, this->size);
+				}
+				
+				uint8_t *data;
+				
+			private:
+				Lease(const Lease &);
+				Lease &operator=(const Lease &);
+				
+				BufPool *pool;
+				int size;
+		};
+		
+		~BufPool();
+		
+		static BufPool *local();
+		
+		/* `size` is updated to the real size of the buffer */
+		uint8_t *acquire(int *size);
+		void release(uint8_t *data, int size);
+		
+		const stats_t &getStats() const { return(this->stats); }
+		
+	private:
+		BufPool();
+		
+		std::vector<std::pair<uint8_t*, int> > free_list;
+		stats_t stats;
+};
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "module.hh"
+
+#include <fcntl.h>
+#include <time.h>
+
+#define CAPTURE_RECORD_WRAP		0xFFFFFFFF
+#define CAPTURE_ALIGN			4096
+#define CAPTURE_FLUSH_DELAY		(100 * 1000000ULL)
+
+#define PCAPNG_SHB			0x0A0D0D0A
+#define PCAPNG_IDB			0x00000001
+#define PCAPNG_EPB			0x00000006
+#define PCAPNG_MAGIC			0x1A2B3C4D
+
+Capture::Capture() :
+		fd(-1),
+		ring(NULL),
+		ring_mask(0),
+		head(0),
+		tail(0),
+		running(false),
+		out(NULL),
+		out_size(0),
+		sample_cnt(0),
+		packets(0),
+		dropped(0),
+		written(0)
+	{
+}
+
+Capture::~Capture() {
+	this->stop();
+}
+
+bool Capture::start(const opts_t &opts, std::string *err) {
+	uint64_t ring_size = 4096;
+	int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	
+	this->stop();
+	
+	this->opts = opts;
+	if(this->opts.snaplen <= 0)
+		this->opts.snaplen = CAPTURE_DFT_SNAPLEN;
+	if(this->opts.sample <= 0)
+		this->opts.sample = 1;
+	
+	/* The ring size is rounded to a power of two, and must hold a full packet */
+	while(ring_size < (uint64_t) this->opts.ring_size || ring_size < (uint64_t) this->opts.snaplen * 4)
+		ring_size <<= 1;
+	
+	if(this->opts.direct)
+		flags |= O_DIRECT;
+	
+	this->fd = ::open(this->opts.path.c_str(), flags, 0644);
+	if(this->fd < 0) {
+		if(err)
+			*err = std::string("Cannot open ") + this->opts.path + " : " + strerror(errno);
+		return(false);
+	}
+	
+	if(posix_memalign((void**) &this->out, CAPTURE_ALIGN, CAPTURE_WRITE_BUFF) != 0) {
+		::close(this->fd);
+		this->fd = -1;
+		if(err)
+			*err = "Cannot allocate the capture buffer";
+		return(false);
+	}
+	
+	this->ring = new uint8_t[ring_size];
+	this->ring_mask = ring_size - 1;
+	this->head = 0;
+	this->tail = 0;
+	this->out_size = 0;
+	this->sample_cnt = 0;
+	this->packets = 0;
+	this->dropped = 0;
+	this->written = 0;
+	
+	this->write_headers();
+	
+	this->running = true;
+	if(uv_thread_create(&this->thread, writer_main, this) != 0) {
+		this->running = false;
+		this->stop();
+		if(err)
+			*err = "Cannot start the capture thread";
+		return(false);
+	}
+	
+	return(true);
+}
+
+void Capture::stop() {
+	if(this->running) {
+		this->running = false;
+		uv_thread_join(&this->thread);
+	}
+	
+	if(this->fd >= 0) {
+		this->out_flush(true);
+		::close(this->fd);
+		this->fd = -1;
+	}
+	
+	if(this->out) {
+		free(this->out);
+		this->out = NULL;
+	}
+	
+	if(this->ring) {
+		delete[] this->ring;
+		this->ring = NULL;
+	}
+}
+
+void Capture::push(const uint8_t *data, int size, direction_e dir) {
+	struct timespec ts;
+	uint64_t head = this->head.load(std::memory_order_relaxed);
+	uint64_t tail = this->tail.load(std::memory_order_acquire);
+	uint64_t ring_size = this->ring_mask + 1;
+	uint64_t contig;
+	uint64_t needed;
+	record_t *rec;
+	int caplen;
+	
+	if(size <= 0)
+		return;
+	
+	caplen = size < this->opts.snaplen ? size : this->opts.snaplen;
+	needed = (sizeof(record_t) + caplen + 7) & ~7;
+	contig = ring_size - (head & this->ring_mask);
+	
+	/* Records never wrap, the end of the ring is skipped instead */
+	if(contig < needed) {
+		if(head + contig + needed - tail > ring_size) {
+			this->dropped++;
+			return;
+		}
+		
+		*(uint32_t*) (this->ring + (head & this->ring_mask)) = CAPTURE_RECORD_WRAP;
+		head += contig;
+	}
+	else if(head + needed - tail > ring_size) {
+		this->dropped++;
+		return;
+	}
+	
+	clock_gettime(CLOCK_REALTIME, &ts);
+	
+	rec = (record_t*) (this->ring + (head & this->ring_mask));
+	rec->size = size;
+	rec->caplen = caplen;
+	rec->dir = dir;
+	rec->ts = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	memcpy(rec + 1, data, caplen);
+	
+	this->packets++;
+	this->head.store(head + needed, std::memory_order_release);
+}
+
+void Capture::writer_main(void *arg) {
+	static_cast<Capture*>(arg)->writer_loop();
+}
+
+void Capture::writer_loop() {
+	struct timespec idle = { 0, 1000000 };
+	uint64_t last_flush = uv_hrtime();
+	uint64_t now;
+	
+	while(this->running.load()) {
+		if(this->writer_drain())
+			continue;
+		
+		/* Do not keep a slow capture in memory for too long */
+		now = uv_hrtime();
+		if(now - last_flush > CAPTURE_FLUSH_DELAY) {
+			this->out_flush(false);
+			last_flush = now;
+		}
+		
+		nanosleep(&idle, NULL);
+	}
+	
+	this->writer_drain();
+}
+
+bool Capture::writer_drain() {
+	uint64_t head = this->head.load(std::memory_order_acquire);
+	uint64_t tail = this->tail.load(std::memory_order_relaxed);
+	uint32_t hdr[7];
+	uint32_t trailer[4];
+	record_t *rec;
+	uint32_t block_size;
+	uint32_t pad;
+	
+	if(head == tail)
+		return(false);
+	
+	while(tail != head) {
+		rec = (record_t*) (this->ring + (tail & this->ring_mask));
+		
+		if(rec->size == CAPTURE_RECORD_WRAP) {
+			tail += this->ring_mask + 1 - (tail & this->ring_mask);
+			continue;
+		}
+		
+		pad = (4 - (rec->caplen & 3)) & 3;
+		block_size = 28 + rec->caplen + pad + 12 + 4;
+		
+		hdr[0] = PCAPNG_EPB;
+		hdr[1] = block_size;
+		hdr[2] = 0;
+		hdr[3] = rec->ts >> 32;
+		hdr[4] = rec->ts;
+		hdr[5] = rec->caplen;
+		hdr[6] = rec->size;
+		
+		/* epb_flags option with the direction, end of options, block size */
+		trailer[0] = 2 | (4 << 16);
+		trailer[1] = rec->dir;
+		trailer[2] = 0;
+		trailer[3] = block_size;
+		
+		this->out_append(hdr, sizeof(hdr));
+		this->out_append(rec + 1, rec->caplen);
+		this->out_append("\0\0\0", pad);
+		this->out_append(trailer, sizeof(trailer));
+		
+		tail += (sizeof(record_t) + rec->caplen + 7) & ~7;
+	}
+	
+	this->tail.store(tail, std::memory_order_release);
+	
+	return(true);
+}
+
+void Capture::out_append(const void *data, int size) {
+	int copy;
+	
+	while(size > 0) {
+		copy = CAPTURE_WRITE_BUFF - this->out_size;
+		if(copy > size)
+			copy = size;
+		
+		memcpy(this->out + this->out_size, data, copy);
+		this->out_size += copy;
+		data = (const uint8_t*) data + copy;
+		size -= copy;
+		
+		if(this->out_size == CAPTURE_WRITE_BUFF)
+			this->out_flush(false);
+	}
+}
+
+void Capture::out_flush(bool final) {
+	int size = this->out_size;
+	int ret;
+	
+	/* Direct I/O only writes whole blocks, the tail is kept for later */
+	if(this->opts.direct) {
+		if(final)
+			fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) & ~O_DIRECT);
+		else
+			size &= ~(CAPTURE_ALIGN - 1);
+	}
+	
+	if(size == 0)
+		return;
+	
+	ret = write(this->fd, this->out, size);
+	if(ret > 0)
+		this->written += ret;
+	
+	memmove(this->out, this->out + size, this->out_size - size);
+	this->out_size -= size;
+}
+
+void Capture::write_headers() {
+	uint32_t shb[7];
+	uint32_t idb[4];
+	uint32_t opt[2];
+	int name_len = this->opts.itf_name.size();
+	int name_pad = (4 - (name_len & 3)) & 3;
+	uint32_t idb_size;
+	uint32_t linktype = this->opts.linktype ? this->opts.linktype : CAPTURE_LINKTYPE_RAW;
+	
+	shb[0] = PCAPNG_SHB;
+	shb[1] = sizeof(shb);
+	shb[2] = PCAPNG_MAGIC;
+	shb[3] = 1;
+	shb[4] = 0xFFFFFFFF;
+	shb[5] = 0xFFFFFFFF;
+	shb[6] = sizeof(shb);
+	this->out_append(shb, sizeof(shb));
+	
+	/* if_name, if_tsresol (nanoseconds), end of options */
+	idb_size = 16 + (name_len ? 4 + name_len + name_pad : 0) + 8 + 4 + 4;
+	
+	idb[0] = PCAPNG_IDB;
+	idb[1] = idb_size;
+	idb[2] = linktype;
+	idb[3] = this->opts.snaplen;
+	this->out_append(idb, sizeof(idb));
+	
+	if(name_len) {
+		opt[0] = 2 | (name_len << 16);
+		this->out_append(opt, 4);
+		this->out_append(this->opts.itf_name.c_str(), name_len);
+		this->out_append("\0\0\0", name_pad);
+	}
+	
+	opt[0] = 9 | (1 << 16);
+	opt[1] = 9;
+	this->out_append(opt, 8);
+	
+	opt[0] = 0;
+	opt[1] = idb_size;
+	this->out_append(opt, 8);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _H_NODETUNTAP_CAPTURE
+#define _H_NODETUNTAP_CAPTURE
+
+#define CAPTURE_DFT_RING		(4 * 1024 * 1024)
+#define CAPTURE_DFT_SNAPLEN		65535
+#define CAPTURE_WRITE_BUFF		(1024 * 1024)
+
+#define CAPTURE_LINKTYPE_ETHERNET	1
+#define CAPTURE_LINKTYPE_RAW		101
+
+/*
+ * Packet capture to a pcapng file.
+ * 
+ * The packets are copied by the event loop thread into a single producer /
+ * single consumer lock-free ring, and a background thread writes the ring to
+ * the file with large writes. When the ring is full, packets are dropped from
+ * the capture (never from the interface).
+ */
+class Capture {
+	public:
+		Capture();
+		~Capture();
+		
+		enum direction_e {
+			DIR_IN = 1,
+			DIR_OUT = 2,
+		};
+		
+		struct opts_t {
+			opts_t() :
+				snaplen(CAPTURE_DFT_SNAPLEN),
+				sample(1),
+				ring_size(CAPTURE_DFT_RING),
+				direct(false),
+				rx(true),
+				tx(true),
+				linktype(0)
+			{}
+			
+			std::string path;
+			std::string itf_name;
+			int snaplen;
+			int sample;
+			int ring_size;
+			bool direct;
+			bool rx;
+			bool tx;
+			int linktype;
+		};
+		
+		bool start(const opts_t &opts, std::string *err);
+		void stop();
+		
+		/*
+		 * Called from the event loop thread with a raw datagram, read from
+		 * the device (`rx`) or written to it. Datagrams read from the device
+		 * were sent by the host, so they are flagged as outbound.
+		 */
+		inline void packet(const uint8_t *data, int size, bool rx) {
+			if(!(rx ? this->opts.rx : this->opts.tx))
+				return;
+			if(this->opts.sample > 1 && (++this->sample_cnt % this->opts.sample) != 0)
+				return;
+			this->push(data + INET_PI_LEN, size - INET_PI_LEN, rx ? DIR_OUT : DIR_IN);
+		}
+		
+		uint64_t getPackets() const { return(this->packets); }
+		uint64_t getDropped() const { return(this->dropped); }
+		uint64_t getWritten() const { return(this->written.load()); }
+		
+	private:
+		struct record_t {
+			uint32_t size;
+			uint32_t caplen;
+			uint32_t dir;
+			uint32_t pad;
+			uint64_t ts;
+		};
+		
+		void push(const uint8_t *data, int size, direction_e dir);
+		
+		static void writer_main(void *arg);
+		void writer_loop();
+		bool writer_drain();
+		void out_append(const void *data, int size);
+		void out_flush(bool final);
+		void write_headers();
+		
+		opts_t opts;
+		int fd;
+		
+		uint8_t *ring;
+		uint64_t ring_mask;
+		std::atomic<uint64_t> head;
+		std::atomic<uint64_t> tail;
+		std::atomic<bool> running;
+		
+		uint8_t *out;
+		int out_size;
+		
+		uint64_t sample_cnt;
+		uint64_t packets;
+		uint64_t dropped;
+		std::atomic<uint64_t> written;
+		
+		uv_thread_t thread;
+};
+
+#endif
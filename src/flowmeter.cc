@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+#include <sys/time.h>
+
+/* Little endian writers, for the records given to JS */
+static inline void flowWrite16(uint8_t *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void flowWrite64(uint8_t *p, uint64_t v) {
+	for(int i = 0 ; i < 8 ; i++)
+		p[i] = v >> (i * 8);
+}
+
+static inline void flowWrite64BE(uint8_t *p, uint64_t v) {
+	inetWrite32(p, v >> 32);
+	inetWrite32(p + 4, v);
+}
+
+/* The IPFIX templates, as (element, length) pairs after the addresses */
+static const uint16_t ipfixFields[][2] = {
+	{ 7, 2 },	/* sourceTransportPort */
+	{ 11, 2 },	/* destinationTransportPort */
+	{ 4, 1 },	/* protocolIdentifier */
+	{ 6, 2 },	/* tcpControlBits */
+	{ 5, 1 },	/* ipClassOfService */
+	{ 61, 1 },	/* flowDirection */
+	{ 136, 1 },	/* flowEndReason */
+	{ 2, 8 },	/* packetDeltaCount */
+	{ 1, 8 },	/* octetDeltaCount */
+	{ 152, 8 },	/* flowStartMilliseconds */
+	{ 153, 8 },	/* flowEndMilliseconds */
+};
+
+#define IPFIX_FIELDS			(sizeof(ipfixFields) / sizeof(ipfixFields[0]))
+#define IPFIX_TEMPLATE_V4		256
+#define IPFIX_TEMPLATE_V6		257
+#define IPFIX_FIXED_LEN			42
+
+FlowMeter::FlowMeter() :
+	table(NULL),
+	mask(0),
+	active(0),
+	seed((uint32_t) uv_hrtime()),
+	sample_cnt(0),
+	epoch(0),
+	now(0),
+	sock(-1),
+	collector_len(0),
+	msg_len(0),
+	set_off(0),
+	set_family(0),
+	msg_records(0),
+	sequence(0),
+	template_sent(0)
+{
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+FlowMeter::~FlowMeter() {
+	if(this->table)
+		delete[] this->table;
+	if(this->sock >= 0)
+		::close(this->sock);
+}
+
+bool FlowMeter::configure(const opts_t &opts, uint64_t now, std::string *err) {
+	struct timeval tv;
+	std::string host;
+	int port = FLOWMETER_IPFIX_PORT;
+	size_t sep;
+	uint32_t size = 1;
+	
+	this->opts = opts;
+	if(this->opts.sampling < 1)
+		this->opts.sampling = 1;
+	if(this->opts.entries < FLOWMETER_MAX_PROBE)
+		this->opts.entries = FLOWMETER_MAX_PROBE;
+	
+	if(this->opts.collector.size() > 0) {
+		/* host:port, [v6]:port, or a host alone */
+		host = this->opts.collector;
+		sep = host.rfind(':');
+		if(host[0] == '[') {
+			sep = host.find("]:");
+			if(sep != std::string::npos)
+				port = atoi(host.c_str() + sep + 2);
+			host = host.substr(1, host.find(']') - 1);
+		}
+		else if(sep != std::string::npos && host.find(':') == sep) {
+			port = atoi(host.c_str() + sep + 1);
+			host = host.substr(0, sep);
+		}
+		
+		memset(&this->collector, 0, sizeof(this->collector));
+		if(uv_ip4_addr(host.c_str(), port, (struct sockaddr_in*) &this->collector) == 0) {
+			this->collector_len = sizeof(struct sockaddr_in);
+		}
+		else if(uv_ip6_addr(host.c_str(), port, (struct sockaddr_in6*) &this->collector) == 0) {
+			this->collector_len = sizeof(struct sockaddr_in6);
+		}
+		else {
+			*err = "Invalid collector address";
+			return(false);
+		}
+		
+		this->sock = socket(this->collector.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(this->sock < 0) {
+			*err = std::string("Cannot create the collector socket : ") + strerror(errno);
+			return(false);
+		}
+	}
+	
+	while(size < (uint32_t) this->opts.entries)
+		size <<= 1;
+	this->table = new entry_t[size];
+	this->mask = size - 1;
+	for(uint32_t i = 0 ; i < size ; i++)
+		this->table[i].used = false;
+	
+	gettimeofday(&tv, NULL);
+	this->epoch = (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000 - now;
+	this->now = now;
+	
+	return(true);
+}
+
+/* Jenkins one-at-a-time, seeded so that flows cannot be aimed at a slot */
+uint32_t FlowMeter::hash(const inet_flow_t &flow, int dir) const {
+	uint32_t h = this->seed;
+	int len = flow.family == 4 ? 4 : 16;
+	int i;
+	
+#define HASH_BYTE(_b_) { h += (_b_); h += h << 10; h ^= h >> 6; }
+	for(i = 0 ; i < len ; i++) {
+		HASH_BYTE(flow.src[i])
+		HASH_BYTE(flow.dst[i])
+	}
+	HASH_BYTE(flow.proto)
+	HASH_BYTE(flow.sport >> 8)
+	HASH_BYTE(flow.sport & 0xFF)
+	HASH_BYTE(flow.dport >> 8)
+	HASH_BYTE(flow.dport & 0xFF)
+	HASH_BYTE(dir)
+#undef HASH_BYTE
+	
+	h += h << 3;
+	h ^= h >> 11;
+	h += h << 15;
+	
+	return(h);
+}
+
+void FlowMeter::account(const uint8_t *data, int size, int l3_off, direction_e dir, uint64_t now) {
+	inet_flow_t flow;
+	entry_t *entry;
+	entry_t *victim = NULL;
+	uint32_t h;
+	int i;
+	
+	if(!inetFlow(data, size, l3_off, &flow)) {
+		this->stats.unparsed++;
+		return;
+	}
+	
+	this->stats.packets++;
+	h = this->hash(flow, dir);
+	
+	for(i = 0 ; i < FLOWMETER_MAX_PROBE ; i++) {
+		entry = &this->table[(h + i) & this->mask];
+		
+		if(!entry->used)
+			break;
+		
+		if(
+			entry->hash == h &&
+			entry->dir == dir &&
+			entry->proto == flow.proto &&
+			entry->sport == flow.sport &&
+			entry->dport == flow.dport &&
+			entry->family == flow.family &&
+			memcmp(entry->src, flow.src, 16) == 0 &&
+			memcmp(entry->dst, flow.dst, 16) == 0
+		) {
+			entry->last = now;
+			entry->packets++;
+			entry->bytes += size - l3_off;
+			entry->tcp_flags |= flow.tcp_flags;
+			if(flow.tcp_flags & 0x05)
+				entry->ended = true;
+			return;
+		}
+		
+		if(!victim || entry->last < victim->last)
+			victim = entry;
+	}
+	
+	/* No room in the probe window : the least recently seen flow goes */
+	if(i == FLOWMETER_MAX_PROBE) {
+		this->exportEntry(victim, END_EVICTED);
+		this->stats.evicted++;
+		this->active--;
+		entry = victim;
+	}
+	
+	entry->used = true;
+	entry->ended = (flow.tcp_flags & 0x05) != 0;
+	entry->family = flow.family;
+	entry->proto = flow.proto;
+	entry->dir = dir;
+	entry->dscp = flow.dscp;
+	entry->tcp_flags = flow.tcp_flags;
+	entry->sport = flow.sport;
+	entry->dport = flow.dport;
+	memcpy(entry->src, flow.src, 16);
+	memcpy(entry->dst, flow.dst, 16);
+	entry->hash = h;
+	entry->first = now;
+	entry->last = now;
+	entry->packets = 1;
+	entry->bytes = size - l3_off;
+	
+	this->active++;
+	this->stats.created++;
+}
+
+/* Linear probing removal : the next entries are moved back when they can */
+void FlowMeter::remove(uint32_t idx) {
+	uint32_t next = idx;
+	uint32_t home;
+	
+	this->table[idx].used = false;
+	this->active--;
+	
+	for(;;) {
+		next = (next + 1) & this->mask;
+		if(!this->table[next].used)
+			return;
+		
+		home = this->table[next].hash & this->mask;
+		
+		/* Stays if its home slot is cyclically in (idx, next] */
+		if(((next - home) & this->mask) < ((next - idx) & this->mask))
+			continue;
+		
+		this->table[idx] = this->table[next];
+		this->table[next].used = false;
+		idx = next;
+	}
+}
+
+void FlowMeter::expire(uint64_t now, bool all) {
+	entry_t *entry;
+	uint32_t i;
+	
+	this->now = now;
+	
+	for(i = 0 ; i <= this->mask ; i++) {
+		entry = &this->table[i];
+		if(!entry->used)
+			continue;
+		
+		if(all) {
+			if(entry->packets > 0)
+				this->exportEntry(entry, END_FORCED);
+			this->remove(i);
+		}
+		else if(entry->ended) {
+			this->exportEntry(entry, END_FIN);
+			this->remove(i);
+		}
+		else if(now - entry->last >= (uint64_t) this->opts.idle) {
+			if(entry->packets > 0)
+				this->exportEntry(entry, END_IDLE);
+			this->remove(i);
+		}
+		else if(now - entry->first >= (uint64_t) this->opts.active && entry->packets > 0) {
+			this->exportEntry(entry, END_ACTIVE);
+			entry->first = now;
+			entry->packets = 0;
+			entry->bytes = 0;
+			entry->tcp_flags = 0;
+			continue;
+		}
+		else {
+			continue;
+		}
+		
+		/* An entry may have been moved back to this slot */
+		i--;
+	}
+	
+	if(this->msg_records > 0)
+		this->ipfixSend();
+}
+
+int FlowMeter::takeRecords(std::vector<uint8_t> *out, int max) {
+	int count = this->records.size() / FLOWMETER_RECORD_LEN;
+	
+	if(count > max)
+		count = max;
+	
+	out->assign(this->records.begin(), this->records.begin() + count * FLOWMETER_RECORD_LEN);
+	this->records.erase(this->records.begin(), this->records.begin() + count * FLOWMETER_RECORD_LEN);
+	
+	return(count);
+}
+
+void FlowMeter::exportEntry(const entry_t *entry, end_reason_e reason) {
+	uint8_t *rec;
+	
+	this->stats.exported++;
+	
+	if(this->opts.records) {
+		this->records.resize(this->records.size() + FLOWMETER_RECORD_LEN);
+		rec = &this->records[this->records.size() - FLOWMETER_RECORD_LEN];
+		memset(rec, 0, FLOWMETER_RECORD_LEN);
+		
+		rec[0] = entry->family;
+		rec[1] = entry->proto;
+		rec[2] = entry->tcp_flags;
+		rec[3] = entry->dir;
+		rec[4] = reason;
+		rec[5] = entry->dscp;
+		flowWrite16(rec + 8, entry->sport);
+		flowWrite16(rec + 10, entry->dport);
+		memcpy(rec + 16, entry->src, 16);
+		memcpy(rec + 32, entry->dst, 16);
+		flowWrite64(rec + 48, entry->packets);
+		flowWrite64(rec + 56, entry->bytes);
+		flowWrite64(rec + 64, this->epoch + entry->first);
+		flowWrite64(rec + 72, this->epoch + entry->last);
+	}
+	
+	if(this->sock >= 0)
+		this->ipfixRecord(entry, reason);
+}
+
+/*
+ * IPFIX export
+ */
+void FlowMeter::ipfixBegin() {
+	uint64_t ms = this->epoch + this->now;
+	uint8_t *p;
+	size_t i;
+	int family;
+	
+	inetWrite16(this->msg, 10);
+	inetWrite32(this->msg + 4, ms / 1000);
+	inetWrite32(this->msg + 8, this->sequence);
+	inetWrite32(this->msg + 12, this->opts.domain);
+	this->msg_len = 16;
+	this->set_off = 0;
+	this->set_family = 0;
+	this->msg_records = 0;
+	
+	/* Over UDP, the templates are sent again periodically */
+	if(this->template_sent && this->now - this->template_sent < FLOWMETER_IPFIX_TEMPLATE)
+		return;
+	this->template_sent = this->now ? this->now : 1;
+	
+	p = this->msg + this->msg_len;
+	inetWrite16(p, 2);
+	inetWrite16(p + 2, 4 + 2 * (4 + (IPFIX_FIELDS + 2) * 4));
+	p += 4;
+	
+	for(family = 4 ; family <= 6 ; family += 2) {
+		inetWrite16(p, family == 4 ? IPFIX_TEMPLATE_V4 : IPFIX_TEMPLATE_V6);
+		inetWrite16(p + 2, IPFIX_FIELDS + 2);
+		p += 4;
+		
+		/* source and destination IPv4 (8, 12) or IPv6 (27, 28) addresses */
+		inetWrite16(p, family == 4 ? 8 : 27);
+		inetWrite16(p + 2, family == 4 ? 4 : 16);
+		inetWrite16(p + 4, family == 4 ? 12 : 28);
+		inetWrite16(p + 6, family == 4 ? 4 : 16);
+		p += 8;
+		
+		for(i = 0 ; i < IPFIX_FIELDS ; i++) {
+			inetWrite16(p, ipfixFields[i][0]);
+			inetWrite16(p + 2, ipfixFields[i][1]);
+			p += 4;
+		}
+	}
+	
+	this->msg_len = p - this->msg;
+}
+
+void FlowMeter::ipfixRecord(const entry_t *entry, end_reason_e reason) {
+	int addr_len = entry->family == 4 ? 4 : 16;
+	int rec_len = 2 * addr_len + IPFIX_FIXED_LEN;
+	uint8_t *p;
+	
+	if(this->msg_len == 0)
+		this->ipfixBegin();
+	
+	if(this->msg_len + rec_len + (this->set_family != entry->family ? 4 : 0) > FLOWMETER_IPFIX_MTU) {
+		this->ipfixSend();
+		this->ipfixBegin();
+	}
+	
+	/* A data set for each run of records of the same family */
+	if(this->set_family != entry->family) {
+		if(this->set_off)
+			inetWrite16(this->msg + this->set_off + 2, this->msg_len - this->set_off);
+		this->set_off = this->msg_len;
+		this->set_family = entry->family;
+		inetWrite16(this->msg + this->msg_len, entry->family == 4 ? IPFIX_TEMPLATE_V4 : IPFIX_TEMPLATE_V6);
+		this->msg_len += 4;
+	}
+	
+	p = this->msg + this->msg_len;
+	memcpy(p, entry->src, addr_len);
+	memcpy(p + addr_len, entry->dst, addr_len);
+	p += 2 * addr_len;
+	
+	inetWrite16(p, entry->sport);
+	inetWrite16(p + 2, entry->dport);
+	p[4] = entry->proto;
+	inetWrite16(p + 5, entry->tcp_flags);
+	p[7] = entry->dscp << 2;
+	p[8] = entry->dir;
+	p[9] = reason;
+	flowWrite64BE(p + 10, entry->packets);
+	flowWrite64BE(p + 18, entry->bytes);
+	flowWrite64BE(p + 26, this->epoch + entry->first);
+	flowWrite64BE(p + 34, this->epoch + entry->last);
+	
+	this->msg_len += rec_len;
+	this->msg_records++;
+}
+
+void FlowMeter::ipfixSend() {
+	if(this->msg_len == 0)
+		return;
+	
+	if(this->set_off)
+		inetWrite16(this->msg + this->set_off + 2, this->msg_len - this->set_off);
+	inetWrite16(this->msg + 2, this->msg_len);
+	
+	if(sendto(this->sock, this->msg, this->msg_len, 0, (struct sockaddr*) &this->collector, this->collector_len) == this->msg_len)
+		this->stats.ipfix_messages++;
+	else
+		this->stats.ipfix_errors++;
+	
+	/* The sequence counts the data records */
+	this->sequence += this->msg_records;
+	this->msg_len = 0;
+	this->msg_records = 0;
+}
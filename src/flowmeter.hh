@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_FLOWMETER
+#define _H_NODETUNTAP_FLOWMETER
+
+#include <sys/socket.h>
+
+#define FLOWMETER_DFT_ENTRIES		65536
+#define FLOWMETER_DFT_ACTIVE		60000
+#define FLOWMETER_DFT_IDLE		15000
+#define FLOWMETER_DFT_BATCH		1024
+#define FLOWMETER_MAX_PROBE		16
+#define FLOWMETER_RECORD_LEN		80
+
+#define FLOWMETER_IPFIX_MTU		1400
+#define FLOWMETER_IPFIX_TEMPLATE	30000
+#define FLOWMETER_IPFIX_PORT		4739
+
+/*
+ * Flow meter. The datagrams read from and written to the device are
+ * accounted (optionally 1 in N) into a fixed size open addressing table,
+ * keyed by their addresses, protocol, ports and direction. The flows are
+ * exported when idle, periodically while active, after a TCP FIN or RST,
+ * or when the table has no room for a new flow (evicting the least recently
+ * seen flow of the probe window).
+ * 
+ * The exported records are given back in FLOWMETER_RECORD_LEN bytes binary
+ * records (see index.js for the layout), and/or sent to an IPFIX collector
+ * over UDP, with one template for IPv4 and one for IPv6.
+ * 
+ * Times are given by the caller in milliseconds of the event loop clock, and
+ * exported as milliseconds since the epoch.
+ */
+class FlowMeter {
+	public:
+		enum direction_e {
+			DIR_READ = 0,
+			DIR_WRITE = 1,
+		};
+		
+		/* IPFIX flowEndReason */
+		enum end_reason_e {
+			END_IDLE = 1,
+			END_ACTIVE = 2,
+			END_FIN = 3,
+			END_FORCED = 4,
+			END_EVICTED = 5,
+		};
+		
+		struct opts_t {
+			opts_t() :
+				entries(FLOWMETER_DFT_ENTRIES),
+				sampling(1),
+				active(FLOWMETER_DFT_ACTIVE),
+				idle(FLOWMETER_DFT_IDLE),
+				domain(0),
+				records(true)
+			{}
+			
+			int entries;
+			int sampling;
+			int active;
+			int idle;
+			std::string collector;
+			uint32_t domain;
+			bool records;
+		};
+		
+		struct stats_t {
+			uint64_t packets;
+			uint64_t sampled_out;
+			uint64_t unparsed;
+			uint64_t created;
+			uint64_t exported;
+			uint64_t evicted;
+			uint64_t ipfix_messages;
+			uint64_t ipfix_errors;
+		};
+		
+		FlowMeter();
+		~FlowMeter();
+		
+		bool configure(const opts_t &opts, uint64_t now, std::string *err);
+		
+		inline void packet(const uint8_t *data, int size, int l3_off, direction_e dir, uint64_t now) {
+			if(this->opts.sampling > 1 && (++this->sample_cnt % this->opts.sampling) != 0) {
+				this->stats.sampled_out++;
+				return;
+			}
+			this->account(data, size, l3_off, dir, now);
+		}
+		
+		/* Exports the finished flows, or all of them */
+		void expire(uint64_t now, bool all);
+		
+		/* Moves up to `max` exported records to `out`, returns their number */
+		int takeRecords(std::vector<uint8_t> *out, int max);
+		
+		int getActive() const { return(this->active); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+	private:
+		struct entry_t {
+			bool used;
+			bool ended;
+			uint8_t family;
+			uint8_t proto;
+			uint8_t dir;
+			uint8_t dscp;
+			uint8_t tcp_flags;
+			uint16_t sport;
+			uint16_t dport;
+			uint8_t src[16];
+			uint8_t dst[16];
+			uint32_t hash;
+			uint64_t first;
+			uint64_t last;
+			uint64_t packets;
+			uint64_t bytes;
+		};
+		
+		void account(const uint8_t *data, int size, int l3_off, direction_e dir, uint64_t now);
+		uint32_t hash(const inet_flow_t &flow, int dir) const;
+		void remove(uint32_t idx);
+		void exportEntry(const entry_t *entry, end_reason_e reason);
+		
+		void ipfixBegin();
+		void ipfixRecord(const entry_t *entry, end_reason_e reason);
+		void ipfixSend();
+		
+		opts_t opts;
+		entry_t *table;
+		uint32_t mask;
+		int active;
+		uint32_t seed;
+		uint64_t sample_cnt;
+		uint64_t epoch;
+		uint64_t now;
+		
+		std::vector<uint8_t> records;
+		
+		int sock;
+		struct sockaddr_storage collector;
+		socklen_t collector_len;
+		uint8_t msg[FLOWMETER_IPFIX_MTU];
+		int msg_len;
+		int set_off;
+		int set_family;
+		uint32_t msg_records;
+		uint32_t sequence;
+		uint64_t template_sent;
+		
+		stats_t stats;
+};
+
+#endif
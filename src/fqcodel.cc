@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+FqCodel::FqCodel(const opts_t &opts, free_cb_t free_cb) :
+	opts(opts),
+	free_cb(free_cb),
+	seed((uint32_t) uv_hrtime()),
+	target((uint64_t) opts.target * 1000),
+	interval((uint64_t) opts.interval * 1000),
+	backlog(0)
+{
+	this->flows = new flow_t[opts.flows];
+	for(int i = 0 ; i < opts.flows ; i++) {
+		this->flows[i].bytes = 0;
+		this->flows[i].deficit = 0;
+		this->flows[i].list = LIST_NONE;
+		this->flows[i].dropping = false;
+		this->flows[i].count = 0;
+		this->flows[i].lastcount = 0;
+		this->flows[i].first_above = 0;
+		this->flows[i].drop_next = 0;
+	}
+	
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+FqCodel::~FqCodel() {
+	for(int i = 0 ; i < this->opts.flows ; i++) {
+		for(size_t j = 0 ; j < this->flows[i].queue.size() ; j++)
+			this->free_cb(this->flows[i].queue[j].pkt);
+	}
+	
+	delete[] this->flows;
+}
+
+/* Jenkins one-at-a-time, seeded so that flows cannot be aimed at a queue */
+uint32_t FqCodel::hash(const uint8_t *data, int size, int l3_off) const {
+	inet_flow_t flow;
+	uint32_t h = this->seed;
+	int len;
+	int i;
+	
+	if(!inetFlow(data, size, l3_off, &flow))
+		return(0);
+	
+	len = flow.family == 4 ? 4 : 16;
+	
+#define HASH_BYTE(_b_) { h += (_b_); h += h << 10; h ^= h >> 6; }
+	for(i = 0 ; i < len ; i++) {
+		HASH_BYTE(flow.src[i])
+		HASH_BYTE(flow.dst[i])
+	}
+	HASH_BYTE(flow.proto)
+	HASH_BYTE(flow.sport >> 8)
+	HASH_BYTE(flow.sport & 0xFF)
+	HASH_BYTE(flow.dport >> 8)
+	HASH_BYTE(flow.dport & 0xFF)
+#undef HASH_BYTE
+	
+	h += h << 3;
+	h ^= h >> 11;
+	h += h << 15;
+	
+	return(h);
+}
+
+void FqCodel::enqueue(void *pkt, uint8_t *data, int size, int l3_off, uint64_t now) {
+	flow_t *flow = &this->flows[this->hash(data, size, l3_off) % this->opts.flows];
+	item_t item;
+	
+	item.pkt = pkt;
+	item.data = data;
+	item.size = size;
+	item.l3_off = l3_off;
+	item.ts = now;
+	
+	flow->queue.push_back(item);
+	flow->bytes += size;
+	this->backlog++;
+	
+	if(flow->list == LIST_NONE) {
+		flow->list = LIST_NEW;
+		flow->deficit = this->opts.quantum;
+		this->new_list.push_back(flow);
+		this->stats.new_flows++;
+	}
+	
+	if(this->backlog > (size_t) this->opts.limit)
+		this->drop_fattest();
+}
+
+void FqCodel::drop(const item_t &item) {
+	this->free_cb(item.pkt);
+}
+
+/* Over the limit, the head of the biggest queue goes */
+void FqCodel::drop_fattest() {
+	flow_t *fat = NULL;
+	item_t item;
+	
+	for(int i = 0 ; i < this->opts.flows ; i++) {
+		if(!fat || this->flows[i].bytes > fat->bytes)
+			fat = &this->flows[i];
+	}
+	
+	if(!fat || fat->queue.empty())
+		return;
+	
+	item = fat->queue.front();
+	fat->queue.pop_front();
+	fat->bytes -= item.size;
+	this->backlog--;
+	this->stats.overlimit++;
+	this->drop(item);
+}
+
+uint64_t FqCodel::control_law(uint64_t t, uint32_t count) const {
+	return(t + (uint64_t) (this->interval / sqrt((double) count)));
+}
+
+/* Dequeues the head of a flow, and tells if its sojourn time allows a drop */
+bool FqCodel::pop(flow_t *flow, uint64_t now, item_t *item) {
+	bool ok_to_drop = false;
+	
+	if(flow->queue.empty()) {
+		flow->first_above = 0;
+		item->pkt = NULL;
+		return(false);
+	}
+	
+	*item = flow->queue.front();
+	flow->queue.pop_front();
+	flow->bytes -= item->size;
+	this->backlog--;
+	
+	if(now - item->ts < this->target || flow->bytes <= this->opts.quantum) {
+		flow->first_above = 0;
+	}
+	else if(flow->first_above == 0) {
+		flow->first_above = now + this->interval;
+	}
+	else if(now >= flow->first_above) {
+		ok_to_drop = true;
+	}
+	
+	return(ok_to_drop);
+}
+
+/* Sets the CE codepoint of an ECN capable datagram */
+bool FqCodel::mark(item_t *item) {
+	uint8_t *l3 = item->data + item->l3_off;
+	uint32_t sum;
+	
+	if(!this->opts.ecn || item->size < item->l3_off + 20)
+		return(false);
+	
+	switch(inetEtherType(item->data, item->size, item->l3_off)) {
+		case INET_ETHTYPE_IPV4:
+			if((l3[1] & 0x03) == 0)
+				return(false);
+			if((l3[1] & 0x03) != 0x03) {
+				/* Incremental checksum update (RFC 1624) */
+				sum = (uint16_t) ~inetRead16(l3 + 10);
+				sum += (uint16_t) ~inetRead16(l3);
+				l3[1] |= 0x03;
+				sum += inetRead16(l3);
+				inetWrite16(l3 + 10, inetChecksumFold(sum));
+			}
+			return(true);
+		
+		case INET_ETHTYPE_IPV6:
+			if((l3[1] & 0x30) == 0)
+				return(false);
+			l3[1] |= 0x30;
+			return(true);
+	}
+	
+	return(false);
+}
+
+/* CoDel dequeue (RFC 8289), returns false when the flow is empty */
+bool FqCodel::codel(flow_t *flow, uint64_t now, item_t *item) {
+	bool ok_to_drop = this->pop(flow, now, item);
+	uint32_t delta;
+	
+	if(!item->pkt) {
+		flow->dropping = false;
+		return(false);
+	}
+	
+	if(flow->dropping) {
+		if(!ok_to_drop) {
+			flow->dropping = false;
+		}
+		
+		while(flow->dropping && now >= flow->drop_next) {
+			flow->count++;
+			
+			if(this->mark(item)) {
+				this->stats.marked++;
+				flow->drop_next = this->control_law(flow->drop_next, flow->count);
+				break;
+			}
+			
+			this->stats.dropped++;
+			this->drop(*item);
+			ok_to_drop = this->pop(flow, now, item);
+			
+			if(!item->pkt) {
+				flow->dropping = false;
+				return(false);
+			}
+			
+			if(!ok_to_drop)
+				flow->dropping = false;
+			else
+				flow->drop_next = this->control_law(flow->drop_next, flow->count);
+		}
+	}
+	else if(ok_to_drop) {
+		if(this->mark(item)) {
+			this->stats.marked++;
+		}
+		else {
+			this->stats.dropped++;
+			this->drop(*item);
+			this->pop(flow, now, item);
+		}
+		
+		flow->dropping = true;
+		delta = flow->count - flow->lastcount;
+		if(delta > 1 && now - flow->drop_next < 16 * this->interval)
+			flow->count = delta;
+		else
+			flow->count = 1;
+		flow->lastcount = flow->count;
+		flow->drop_next = this->control_law(now, flow->count);
+		
+		if(!item->pkt)
+			return(false);
+	}
+	
+	return(true);
+}
+
+void *FqCodel::dequeue(uint64_t now) {
+	std::deque<flow_t*> *list;
+	flow_t *flow;
+	item_t item;
+	
+	for(;;) {
+		if(!this->new_list.empty())
+			list = &this->new_list;
+		else if(!this->old_list.empty())
+			list = &this->old_list;
+		else
+			return(NULL);
+		
+		flow = list->front();
+		
+		if(flow->deficit <= 0) {
+			flow->deficit += this->opts.quantum;
+			list->pop_front();
+			flow->list = LIST_OLD;
+			this->old_list.push_back(flow);
+			continue;
+		}
+		
+		if(!this->codel(flow, now, &item)) {
+			list->pop_front();
+			
+			/* An emptied new flow goes through the old ones, against starvation */
+			if(list == &this->new_list && !this->old_list.empty()) {
+				flow->list = LIST_OLD;
+				this->old_list.push_back(flow);
+			}
+			else {
+				flow->list = LIST_NONE;
+			}
+			continue;
+		}
+		
+		flow->deficit -= item.size;
+		return(item.pkt);
+	}
+}
+
+void *FqCodel::drain() {
+	std::deque<flow_t*> *list;
+	flow_t *flow;
+	item_t item;
+	
+	while(!this->new_list.empty() || !this->old_list.empty()) {
+		list = !this->new_list.empty() ? &this->new_list : &this->old_list;
+		flow = list->front();
+		
+		if(flow->queue.empty()) {
+			list->pop_front();
+			flow->list = LIST_NONE;
+			continue;
+		}
+		
+		item = flow->queue.front();
+		flow->queue.pop_front();
+		flow->bytes -= item.size;
+		this->backlog--;
+		return(item.pkt);
+	}
+	
+	return(NULL);
+}
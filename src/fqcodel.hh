@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_FQCODEL
+#define _H_NODETUNTAP_FQCODEL
+
+#include <stdint.h>
+
+#define FQCODEL_DFT_FLOWS		1024
+#define FQCODEL_DFT_LIMIT		10240
+#define FQCODEL_DFT_QUANTUM		1514
+#define FQCODEL_DFT_TARGET		5000
+#define FQCODEL_DFT_INTERVAL		100000
+
+/*
+ * Flow queuing with CoDel (RFC 8290) : the packets are hashed on their
+ * 5-tuple into per flow queues, served by deficit round robin with the new
+ * flows first, and each queue drops (or ECN marks) its packets once their
+ * sojourn time stays above the target for an interval. The packets are
+ * opaque pointers, freed with the given callback when dropped.
+ */
+class FqCodel {
+	public:
+		typedef void (*free_cb_t)(void *pkt);
+		
+		struct opts_t {
+			opts_t() :
+				flows(FQCODEL_DFT_FLOWS),
+				limit(FQCODEL_DFT_LIMIT),
+				quantum(FQCODEL_DFT_QUANTUM),
+				target(FQCODEL_DFT_TARGET),
+				interval(FQCODEL_DFT_INTERVAL),
+				ecn(true)
+			{}
+			
+			int flows;
+			int limit;
+			int quantum;
+			/* In microseconds */
+			int target;
+			int interval;
+			bool ecn;
+		};
+		
+		struct stats_t {
+			uint64_t dropped;
+			uint64_t marked;
+			uint64_t overlimit;
+			uint64_t new_flows;
+		};
+		
+		FqCodel(const opts_t &opts, free_cb_t free_cb);
+		~FqCodel();
+		
+		/* data and size are the raw datagram of pkt, used to hash and mark it */
+		void enqueue(void *pkt, uint8_t *data, int size, int l3_off, uint64_t now);
+		void *dequeue(uint64_t now);
+		
+		/* Removes a queued packet, without dropping, for the teardown */
+		void *drain();
+		
+		size_t getBacklog() const { return(this->backlog); }
+		int getActive() const { return(this->new_list.size() + this->old_list.size()); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+	private:
+		struct item_t {
+			void *pkt;
+			uint8_t *data;
+			int size;
+			int l3_off;
+			uint64_t ts;
+		};
+		
+		struct flow_t {
+			std::deque<item_t> queue;
+			int bytes;
+			int deficit;
+			int list;
+			
+			/* CoDel state */
+			bool dropping;
+			uint32_t count;
+			uint32_t lastcount;
+			uint64_t first_above;
+			uint64_t drop_next;
+		};
+		
+		enum list_e {
+			LIST_NONE = 0,
+			LIST_NEW,
+			LIST_OLD,
+		};
+		
+		uint32_t hash(const uint8_t *data, int size, int l3_off) const;
+		bool pop(flow_t *flow, uint64_t now, item_t *item);
+		bool codel(flow_t *flow, uint64_t now, item_t *item);
+		bool mark(item_t *item);
+		void drop(const item_t &item);
+		void drop_fattest();
+		uint64_t control_law(uint64_t t, uint32_t count) const;
+		
+		opts_t opts;
+		free_cb_t free_cb;
+		uint32_t seed;
+		uint64_t target;
+		uint64_t interval;
+		
+		flow_t *flows;
+		std::deque<flow_t*> new_list;
+		std::deque<flow_t*> old_list;
+		size_t backlog;
+		stats_t stats;
+};
+
+#endif
@@ -0,0 +1,699 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+#include <poll.h>
+#include <time.h>
+
+#define PCAP_MAGIC_US			0xA1B2C3D4
+#define PCAP_MAGIC_NS			0xA1B23C4D
+#define PCAPNG_SHB			0x0A0D0D0A
+#define PCAPNG_IDB			1
+#define PCAPNG_SPB			3
+#define PCAPNG_EPB			6
+#define PCAPNG_BOM			0x1A2B3C4D
+#define PCAPNG_OPT_TSRESOL		9
+
+#define LINKTYPE_NULL			0
+#define LINKTYPE_ETHERNET		1
+#define LINKTYPE_RAW			101
+#define LINKTYPE_LINUX_SLL		113
+#define LINKTYPE_IPV4			228
+#define LINKTYPE_IPV6			229
+
+static inline uint32_t pcapRead32(const uint8_t *p, bool swap) {
+	uint32_t v;
+	
+	memcpy(&v, p, 4);
+	return(swap ? __builtin_bswap32(v) : v);
+}
+
+static inline uint16_t pcapRead16(const uint8_t *p, bool swap) {
+	uint16_t v;
+	
+	memcpy(&v, p, 2);
+	return(swap ? __builtin_bswap16(v) : v);
+}
+
+/* Converts a timestamp in units of 10^-v (or 2^-v when the MSB is set) to ns */
+static uint64_t pcapTsNs(uint64_t ts, uint8_t resol) {
+	uint64_t div = 1;
+	int i;
+	
+	if(resol & 0x80)
+		return((uint64_t) ((long double) ts * 1e9 / (long double) (1ULL << (resol & 0x3F))));
+	
+	if(resol <= 9) {
+		for(i = resol ; i < 9 ; i++)
+			ts *= 10;
+		return(ts);
+	}
+	
+	for(i = 9 ; i < resol && i < 19 ; i++)
+		div *= 10;
+	return(ts / div);
+}
+
+Generator::Generator() :
+	l3_off(INET_TUN_L3_OFF),
+	fd(-1),
+	done(NULL),
+	span(0),
+	pkt(NULL),
+	rand_state(0x9E3779B97F4A7C15ULL),
+	ip_id(0),
+	running(false),
+	stopping(false),
+	sent(0),
+	bytes(0),
+	errors(0),
+	eagain(0),
+	skipped(0),
+	started(0),
+	ended(0),
+	joinable(false)
+{}
+
+Generator::~Generator() {
+	this->stop();
+	
+	if(this->pkt)
+		delete[] this->pkt;
+}
+
+bool Generator::configure(const opts_t &opts, int l3_off, std::string *err) {
+	int hdr_size;
+	
+	this->stop();
+	
+	this->opts = opts;
+	this->l3_off = l3_off;
+	this->pcap_data.clear();
+	this->records.clear();
+	this->span = 0;
+	this->skipped = 0;
+	this->error.clear();
+	
+	/* The file itself is loaded by the thread, not to block the event loop */
+	if(this->opts.pcap.size() > 0) {
+		if(access(this->opts.pcap.c_str(), R_OK) < 0) {
+			*err = std::string("Cannot open ") + this->opts.pcap + " : " + strerror(errno);
+			return(false);
+		}
+		return(true);
+	}
+	
+	if(this->opts.family != 4 && this->opts.family != 6) {
+		*err = "Source and destination addresses of the same family are needed";
+		return(false);
+	}
+	
+	if(this->opts.proto != INET_PROTO_UDP && this->opts.proto != INET_PROTO_TCP) {
+		*err = "Only UDP and TCP datagrams can be generated";
+		return(false);
+	}
+	
+	hdr_size = (this->opts.family == 4 ? 20 : 40) + (this->opts.proto == INET_PROTO_TCP ? 20 : 8);
+	if(
+		this->opts.size_min < hdr_size ||
+		this->opts.size_max > GENERATOR_MAX_SIZE ||
+		this->opts.size_min > this->opts.size_max
+	) {
+		*err = "Invalid datagram size range";
+		return(false);
+	}
+	
+	if(
+		this->opts.sport_min > this->opts.sport_max ||
+		this->opts.dport_min > this->opts.dport_max ||
+		this->opts.src_count < 1 ||
+		this->opts.dst_count < 1
+	) {
+		*err = "Invalid port or address range";
+		return(false);
+	}
+	
+	if(!this->pkt)
+		this->pkt = new uint8_t[INET_TAP_L3_OFF + GENERATOR_MAX_SIZE];
+	memset(this->pkt, 0, INET_TAP_L3_OFF + GENERATOR_MAX_SIZE);
+	
+	return(true);
+}
+
+bool Generator::start(int fd, uv_async_t *done, std::string *err) {
+	this->stop();
+	
+	this->fd = fd;
+	this->done = done;
+	this->sent = 0;
+	this->bytes = 0;
+	this->errors = 0;
+	this->eagain = 0;
+	this->started = uv_hrtime();
+	this->ended = 0;
+	this->stopping = false;
+	
+	this->running = true;
+	if(uv_thread_create(&this->thread, thread_main, this) != 0) {
+		this->running = false;
+		*err = "Cannot start the generator thread";
+		return(false);
+	}
+	this->joinable = true;
+	
+	return(true);
+}
+
+void Generator::stop() {
+	this->stopping = true;
+	
+	if(this->joinable) {
+		uv_thread_join(&this->thread);
+		this->joinable = false;
+	}
+	
+	this->running = false;
+}
+
+Generator::stats_t Generator::getStats() const {
+	stats_t ret;
+	
+	ret.sent = this->sent.load(std::memory_order_relaxed);
+	ret.bytes = this->bytes.load(std::memory_order_relaxed);
+	ret.errors = this->errors.load(std::memory_order_relaxed);
+	ret.eagain = this->eagain.load(std::memory_order_relaxed);
+	ret.skipped = this->skipped.load(std::memory_order_relaxed);
+	ret.started = this->started.load();
+	ret.ended = this->ended.load();
+	
+	return(ret);
+}
+
+/*
+ * Replay
+ */
+bool Generator::pcapLoad(std::string *err) {
+	std::vector<uint8_t> file;
+	std::vector<std::pair<int, uint8_t> > ifaces;
+	uint8_t buff[65536];
+	const uint8_t *p;
+	const uint8_t *end;
+	uint64_t first = 0;
+	bool first_set = false;
+	uint32_t magic;
+	bool swap;
+	int fd;
+	int ret;
+	
+	fd = ::open(this->opts.pcap.c_str(), O_RDONLY);
+	if(fd < 0) {
+		*err = std::string("Cannot open ") + this->opts.pcap + " : " + strerror(errno);
+		return(false);
+	}
+	
+	while((ret = read(fd, buff, sizeof(buff))) > 0 && !this->stopping.load(std::memory_order_relaxed))
+		file.insert(file.end(), buff, buff + ret);
+	::close(fd);
+	
+	if(ret < 0) {
+		*err = std::string("Cannot read ") + this->opts.pcap + " : " + strerror(errno);
+		return(false);
+	}
+	
+	if(file.size() < 24) {
+		*err = "Not a pcap or pcapng file";
+		return(false);
+	}
+	
+	p = &file[0];
+	end = p + file.size();
+	memcpy(&magic, p, 4);
+	
+	/* pcap : a single link type, timestamps in us or ns */
+	if(
+		magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+		magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS)
+	) {
+		bool nsec = magic == PCAP_MAGIC_NS || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+		int linktype;
+		uint32_t caplen;
+		uint64_t ts;
+		
+		swap = magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS;
+		linktype = pcapRead32(p + 20, swap) & 0xFFFF;
+		
+		for(p += 24 ; p + 16 <= end ; p += 16 + caplen) {
+			caplen = pcapRead32(p + 8, swap);
+			if(p + 16 + caplen > end)
+				break;
+			
+			ts = (uint64_t) pcapRead32(p, swap) * 1000000000ULL + pcapRead32(p + 4, swap) * (nsec ? 1 : 1000);
+			if(!first_set) {
+				first = ts;
+				first_set = true;
+			}
+			if(!this->pcapRecord(linktype, ts - first, p + 16, caplen))
+				this->skipped++;
+		}
+	}
+	/* pcapng : enhanced and simple packet blocks, for any interface */
+	else if(magic == PCAPNG_SHB) {
+		uint32_t type;
+		uint32_t len;
+		uint32_t caplen;
+		uint32_t id;
+		uint64_t ts;
+		
+		swap = pcapRead32(p + 8, false) != PCAPNG_BOM;
+		
+		for( ; p + 12 <= end ; p += len) {
+			type = pcapRead32(p, swap);
+			len = pcapRead32(p + 4, swap);
+			if(len < 12 || p + len > end)
+				break;
+			
+			if(type == PCAPNG_SHB) {
+				swap = pcapRead32(p + 8, false) != PCAPNG_BOM;
+				len = pcapRead32(p + 4, swap);
+				if(len < 12 || p + len > end)
+					break;
+				ifaces.clear();
+			}
+			else if(type == PCAPNG_IDB && len >= 20) {
+				const uint8_t *opt = p + 16;
+				uint8_t resol = 6;
+				
+				while(opt + 4 <= p + len - 4) {
+					uint16_t code = pcapRead16(opt, swap);
+					uint16_t olen = pcapRead16(opt + 2, swap);
+					
+					if(code == 0)
+						break;
+					if(code == PCAPNG_OPT_TSRESOL && olen == 1)
+						resol = opt[4];
+					opt += 4 + ((olen + 3) & ~3);
+				}
+				ifaces.push_back(std::make_pair(pcapRead16(p + 8, swap), resol));
+			}
+			else if(type == PCAPNG_EPB && len >= 32) {
+				id = pcapRead32(p + 8, swap);
+				caplen = pcapRead32(p + 20, swap);
+				if(id >= ifaces.size() || 28 + caplen > len) {
+					this->skipped++;
+					continue;
+				}
+				
+				ts = ((uint64_t) pcapRead32(p + 12, swap) << 32) | pcapRead32(p + 16, swap);
+				ts = pcapTsNs(ts, ifaces[id].second);
+				if(!first_set) {
+					first = ts;
+					first_set = true;
+				}
+				if(!this->pcapRecord(ifaces[id].first, ts - first, p + 28, caplen))
+					this->skipped++;
+			}
+			else if(type == PCAPNG_SPB && len >= 16) {
+				/* No timestamp : sent along with the previous one */
+				caplen = pcapRead32(p + 8, swap);
+				if(caplen > len - 16)
+					caplen = len - 16;
+				ts = this->records.size() > 0 ? this->records.back().ts : 0;
+				if(ifaces.size() == 0 || !this->pcapRecord(ifaces[0].first, ts, p + 12, caplen))
+					this->skipped++;
+			}
+		}
+	}
+	else {
+		*err = "Not a pcap or pcapng file";
+		return(false);
+	}
+	
+	if(this->records.size() == 0) {
+		*err = "No datagram to replay in the file";
+		return(false);
+	}
+	
+	/* Timestamps may go backwards : keep them monotonic */
+	for(size_t i = 1 ; i < this->records.size() ; i++) {
+		if(this->records[i].ts < this->records[i - 1].ts)
+			this->records[i].ts = this->records[i - 1].ts;
+	}
+	this->span = this->records.back().ts;
+	
+	return(true);
+}
+
+/* Converts a captured frame to a device datagram */
+bool Generator::pcapRecord(int linktype, uint64_t ts, const uint8_t *data, int size) {
+	const uint8_t *l3 = data;
+	uint16_t ethertype = 0;
+	uint8_t hdr[INET_TAP_L3_OFF];
+	record_t rec;
+	int hdr_size;
+	
+	switch(linktype) {
+		case LINKTYPE_ETHERNET:
+			if(size < INET_ETH_LEN)
+				return(false);
+			
+			/* Given as is to a tap device */
+			if(this->l3_off == INET_TAP_L3_OFF) {
+				hdr[0] = 0;
+				hdr[1] = 0;
+				inetWrite16(hdr + 2, inetRead16(data + 12));
+				rec.ts = ts;
+				rec.offset = this->pcap_data.size();
+				rec.size = INET_PI_LEN + size;
+				this->pcap_data.insert(this->pcap_data.end(), hdr, hdr + INET_PI_LEN);
+				this->pcap_data.insert(this->pcap_data.end(), data, data + size);
+				this->records.push_back(rec);
+				return(true);
+			}
+			
+			ethertype = inetRead16(data + 12);
+			l3 = data + INET_ETH_LEN;
+			if(ethertype == INET_ETHTYPE_VLAN && size >= INET_ETH_LEN + 4) {
+				ethertype = inetRead16(data + 16);
+				l3 += 4;
+			}
+			break;
+		
+		case LINKTYPE_LINUX_SLL:
+			if(size < 16)
+				return(false);
+			ethertype = inetRead16(data + 14);
+			l3 = data + 16;
+			break;
+		
+		case LINKTYPE_NULL:
+			l3 = data + 4;
+			break;
+		
+		case LINKTYPE_RAW:
+		case LINKTYPE_IPV4:
+		case LINKTYPE_IPV6:
+			break;
+		
+		default:
+			return(false);
+	}
+	
+	size -= l3 - data;
+	if(size <= 0)
+		return(false);
+	
+	if(ethertype == 0) {
+		if((l3[0] >> 4) == 4)
+			ethertype = INET_ETHTYPE_IPV4;
+		else if((l3[0] >> 4) == 6)
+			ethertype = INET_ETHTYPE_IPV6;
+		else
+			return(false);
+	}
+	
+	hdr_size = this->buildHeaders(hdr, ethertype);
+	
+	rec.ts = ts;
+	rec.offset = this->pcap_data.size();
+	rec.size = hdr_size + size;
+	this->pcap_data.insert(this->pcap_data.end(), hdr, hdr + hdr_size);
+	this->pcap_data.insert(this->pcap_data.end(), l3, l3 + size);
+	this->records.push_back(rec);
+	
+	return(true);
+}
+
+/*
+ * Synthesis
+ */
+int Generator::buildHeaders(uint8_t *out, uint16_t ethertype) {
+	out[0] = 0;
+	out[1] = 0;
+	inetWrite16(out + 2, ethertype);
+	
+	if(this->l3_off == INET_TAP_L3_OFF) {
+		memcpy(out + INET_PI_LEN, this->opts.mac_dst, 6);
+		memcpy(out + INET_PI_LEN + 6, this->opts.mac_src, 6);
+		inetWrite16(out + INET_PI_LEN + 12, ethertype);
+	}
+	
+	return(this->l3_off);
+}
+
+uint32_t Generator::pick(uint32_t min, uint32_t max, uint64_t seq) {
+	uint64_t x;
+	
+	if(min >= max)
+		return(min);
+	
+	if(!this->opts.random)
+		return(min + seq % ((uint64_t) max - min + 1));
+	
+	/* xorshift64* */
+	x = this->rand_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	this->rand_state = x;
+	return(min + (x * 0x2545F4914F6CDD1DULL >> 32) % ((uint64_t) max - min + 1));
+}
+
+/* Builds the datagram `seq` in pkt, and returns its device size */
+int Generator::synthesize(uint64_t seq, uint64_t now) {
+	bool v4 = this->opts.family == 4;
+	uint8_t *ip = this->pkt + this->l3_off;
+	int ip_hdr = v4 ? 20 : 40;
+	int l4_hdr = this->opts.proto == INET_PROTO_TCP ? 20 : 8;
+	uint8_t *l4 = ip + ip_hdr;
+	uint8_t *payload = l4 + l4_hdr;
+	int size = this->pick(this->opts.size_min, this->opts.size_max, seq);
+	int l4_size = size - ip_hdr;
+	int payload_size = l4_size - l4_hdr;
+	int addr_off = v4 ? 0 : 12;
+	int addr_len = v4 ? 4 : 16;
+	uint8_t *src = ip + (v4 ? 12 : 8);
+	uint8_t *dst = src + addr_len;
+	uint32_t sum;
+	
+	this->buildHeaders(this->pkt, v4 ? INET_ETHTYPE_IPV4 : INET_ETHTYPE_IPV6);
+	
+	memcpy(src, this->opts.src, addr_len);
+	memcpy(dst, this->opts.dst, addr_len);
+	inetWrite32(src + addr_off, inetRead32(this->opts.src + addr_off) + this->pick(0, this->opts.src_count - 1, seq));
+	inetWrite32(dst + addr_off, inetRead32(this->opts.dst + addr_off) + this->pick(0, this->opts.dst_count - 1, seq));
+	
+	if(v4) {
+		ip[0] = 0x45;
+		ip[1] = this->opts.tos;
+		inetWrite16(ip + 2, size);
+		inetWrite16(ip + 4, this->ip_id++);
+		ip[6] = 0x40;
+		ip[7] = 0;
+		ip[8] = this->opts.ttl;
+		ip[9] = this->opts.proto;
+		inetWrite16(ip + 10, 0);
+		inetWrite16(ip + 10, inetChecksum(ip, 20));
+	}
+	else {
+		inetWrite32(ip, 0x60000000 | ((uint32_t) this->opts.tos << 20));
+		inetWrite16(ip + 4, l4_size);
+		ip[6] = this->opts.proto;
+		ip[7] = this->opts.ttl;
+	}
+	
+	inetWrite16(l4, this->pick(this->opts.sport_min, this->opts.sport_max, seq));
+	inetWrite16(l4 + 2, this->pick(this->opts.dport_min, this->opts.dport_max, seq));
+	if(this->opts.proto == INET_PROTO_TCP) {
+		inetWrite32(l4 + 4, (uint32_t) seq);
+		inetWrite32(l4 + 8, 0);
+		l4[12] = 0x50;
+		l4[13] = 0x18;
+		inetWrite16(l4 + 14, 0xFFFF);
+		inetWrite16(l4 + 18, 0);
+	}
+	else {
+		inetWrite16(l4 + 4, l4_size);
+	}
+	
+	/* The rest of the payload is always zero */
+	if(payload_size >= GENERATOR_STAMP_LEN) {
+		inetWrite32(payload, seq >> 32);
+		inetWrite32(payload + 4, seq);
+		inetWrite32(payload + 8, now >> 32);
+		inetWrite32(payload + 12, now);
+		payload_size = GENERATOR_STAMP_LEN;
+	}
+	else {
+		memset(payload, 0, payload_size);
+	}
+	
+	inetWrite16(l4 + (this->opts.proto == INET_PROTO_TCP ? 16 : 6), 0);
+	if(this->opts.checksum) {
+		if(v4) {
+			sum = inetChecksumAdd(ip + 12, 8, 0);
+			sum += this->opts.proto + l4_size;
+		}
+		else {
+			sum = inetPseudo6(ip, l4_size, this->opts.proto);
+		}
+		
+		sum = inetChecksumFold(inetChecksumAdd(l4, l4_hdr + payload_size, sum));
+		if(sum == 0 && this->opts.proto == INET_PROTO_UDP)
+			sum = 0xFFFF;
+		inetWrite16(l4 + (this->opts.proto == INET_PROTO_TCP ? 16 : 6), sum);
+	}
+	
+	return(this->l3_off + size);
+}
+
+/*
+ * Thread
+ */
+void Generator::thread_main(void *arg) {
+	Generator *gen = static_cast<Generator*>(arg);
+	
+	if(gen->opts.pcap.size() > 0 && !gen->pcapLoad(&gen->error)) {
+		gen->finish();
+		return;
+	}
+	
+	gen->loop();
+}
+
+/* Signals the end to the event loop, unless the generator was stopped */
+void Generator::finish() {
+	this->ended = uv_hrtime();
+	this->running = false;
+	
+	if(!this->stopping.load() && this->done)
+		uv_async_send(this->done);
+}
+
+void Generator::loop() {
+	bool replay = this->records.size() > 0;
+	uint64_t interval = this->opts.rate > 0 ? (uint64_t) (1e9 / this->opts.rate) : 0;
+	bool paced = interval > 0 || (replay && this->opts.speed > 0);
+	uint64_t start = uv_hrtime();
+	uint64_t now = start;
+	uint64_t due = start;
+	uint64_t seq = 0;
+	uint64_t lag;
+	size_t idx = 0;
+	int loops = 0;
+	struct timespec ts;
+	const uint8_t *data;
+	int size;
+	
+	this->started = start;
+	
+	while(!this->stopping.load(std::memory_order_relaxed)) {
+		if(this->opts.count && seq >= this->opts.count)
+			break;
+		if(this->opts.duration && now - start >= this->opts.duration * 1000000)
+			break;
+		
+		if(replay) {
+			if(idx == this->records.size()) {
+				idx = 0;
+				if(++loops == this->opts.loops)
+					break;
+			}
+			
+			if(!interval && this->opts.speed > 0)
+				due = start + (uint64_t) ((loops * this->span + this->records[idx].ts) / this->opts.speed);
+		}
+		
+		if(paced) {
+			now = uv_hrtime();
+			
+			/* Too late : the lost time is not made up */
+			if(now > due + GENERATOR_MAX_LAG) {
+				lag = now - due - GENERATOR_MAX_LAG;
+				due += lag;
+				start += lag;
+			}
+			
+			while(now < due && !this->stopping.load(std::memory_order_relaxed)) {
+				if(due - now > GENERATOR_SPIN) {
+					ts.tv_sec = (due - now - GENERATOR_SPIN) / 1000000000;
+					ts.tv_nsec = (due - now - GENERATOR_SPIN) % 1000000000;
+					nanosleep(&ts, NULL);
+				}
+				now = uv_hrtime();
+			}
+		}
+		else {
+			now = uv_hrtime();
+		}
+		
+		if(replay) {
+			data = &this->pcap_data[this->records[idx].offset];
+			size = this->records[idx].size;
+			idx++;
+		}
+		else {
+			size = this->synthesize(seq, now);
+			data = this->pkt;
+		}
+		
+		if(!this->send(data, size))
+			break;
+		
+		seq++;
+		due += interval;
+	}
+	
+	this->finish();
+}
+
+/* Returns false when the device cannot be written anymore */
+bool Generator::send(const uint8_t *data, int size) {
+	struct pollfd pfd;
+	int ret;
+	
+	for(;;) {
+		ret = write(this->fd, data, size);
+		if(ret == size) {
+			this->sent.fetch_add(1, std::memory_order_relaxed);
+			this->bytes.fetch_add(size, std::memory_order_relaxed);
+			return(true);
+		}
+		
+		if(ret < 0 && errno == EINTR)
+			continue;
+		
+		if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			this->eagain.fetch_add(1, std::memory_order_relaxed);
+			if(this->stopping.load(std::memory_order_relaxed))
+				return(false);
+			
+			pfd.fd = this->fd;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, 1);
+			continue;
+		}
+		
+		this->errors.fetch_add(1, std::memory_order_relaxed);
+		return(!(ret < 0 && (errno == EBADF || errno == EIO)));
+	}
+}
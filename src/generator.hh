@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_GENERATOR
+#define _H_NODETUNTAP_GENERATOR
+
+#define GENERATOR_DFT_SIZE		64
+#define GENERATOR_DFT_TTL		64
+#define GENERATOR_MAX_SIZE		65535
+#define GENERATOR_STAMP_LEN		16
+#define GENERATOR_SPIN			50000
+#define GENERATOR_MAX_LAG		10000000
+
+/*
+ * Traffic generator, writing to the device from its own thread.
+ * 
+ * The datagrams are either synthesized from a template (IPv4 or IPv6, UDP or
+ * TCP, the addresses, ports and sizes being taken in ranges, in sequence or
+ * at random), or replayed from a pcap or pcapng file loaded in memory by
+ * the thread, at the original speed, scaled, or as fast as possible. The
+ * payload of the synthesized datagrams is zeroed, except a stamp at its
+ * start (sequence number and send time, in nanoseconds, big endian), so
+ * that the checksums only cover the headers and the stamp.
+ * 
+ * The pace is kept against absolute deadlines : the thread sleeps until
+ * shortly before a deadline and spins for the rest, and falls behind by
+ * at most GENERATOR_MAX_LAG nanoseconds before dropping the lost time.
+ */
+class Generator {
+	public:
+		struct opts_t {
+			opts_t() :
+				family(0),
+				proto(INET_PROTO_UDP),
+				src_count(1),
+				dst_count(1),
+				sport_min(1024),
+				sport_max(1024),
+				dport_min(9),
+				dport_max(9),
+				size_min(GENERATOR_DFT_SIZE),
+				size_max(GENERATOR_DFT_SIZE),
+				ttl(GENERATOR_DFT_TTL),
+				tos(0),
+				random(false),
+				checksum(true),
+				speed(1),
+				loops(1),
+				rate(0),
+				count(0),
+				duration(0)
+			{
+				memset(this->src, 0, sizeof(this->src));
+				memset(this->dst, 0, sizeof(this->dst));
+				memcpy(this->mac_src, "\x02\x00\x00\x00\x00\x01", 6);
+				memset(this->mac_dst, 0xFF, 6);
+			}
+			
+			/* Template */
+			int family;
+			int proto;
+			uint8_t src[16];
+			uint8_t dst[16];
+			uint32_t src_count;
+			uint32_t dst_count;
+			int sport_min;
+			int sport_max;
+			int dport_min;
+			int dport_max;
+			int size_min;
+			int size_max;
+			int ttl;
+			int tos;
+			bool random;
+			bool checksum;
+			uint8_t mac_src[6];
+			uint8_t mac_dst[6];
+			
+			/* Replay */
+			std::string pcap;
+			double speed;
+			int loops;
+			
+			/* Packets per second (0 : as fast as possible, or the replay pace) */
+			double rate;
+			uint64_t count;
+			uint64_t duration;
+		};
+		
+		struct stats_t {
+			uint64_t sent;
+			uint64_t bytes;
+			uint64_t errors;
+			uint64_t eagain;
+			uint64_t skipped;
+			uint64_t started;
+			uint64_t ended;
+		};
+		
+		Generator();
+		~Generator();
+		
+		/* Prepares the datagrams, for a device with the given l3 offset */
+		bool configure(const opts_t &opts, int l3_off, std::string *err);
+		
+		/* `done` is signaled from the thread when it ends by itself */
+		bool start(int fd, uv_async_t *done, std::string *err);
+		void stop();
+		
+		bool isRunning() const { return(this->running.load()); }
+		double getRate() const { return(this->opts.rate); }
+		uint64_t getPackets() const { return(this->records.size()); }
+		stats_t getStats() const;
+		
+		/* Why the thread ended by itself without sending, once `done` is signaled */
+		const std::string &getError() const { return(this->error); }
+		
+	private:
+		struct record_t {
+			uint64_t ts;
+			size_t offset;
+			int size;
+		};
+		
+		bool pcapLoad(std::string *err);
+		bool pcapRecord(int linktype, uint64_t ts, const uint8_t *data, int size);
+		int buildHeaders(uint8_t *out, uint16_t ethertype);
+		int synthesize(uint64_t seq, uint64_t now);
+		uint32_t pick(uint32_t min, uint32_t max, uint64_t seq);
+		
+		static void thread_main(void *arg);
+		void loop();
+		void finish();
+		bool send(const uint8_t *data, int size);
+		
+		opts_t opts;
+		int l3_off;
+		int fd;
+		uv_async_t *done;
+		
+		std::vector<uint8_t> pcap_data;
+		std::vector<record_t> records;
+		uint64_t span;
+		
+		uint8_t *pkt;
+		uint64_t rand_state;
+		uint16_t ip_id;
+		
+		std::atomic<bool> running;
+		std::atomic<bool> stopping;
+		std::atomic<uint64_t> sent;
+		std::atomic<uint64_t> bytes;
+		std::atomic<uint64_t> errors;
+		std::atomic<uint64_t> eagain;
+		std::atomic<uint64_t> skipped;
+		std::atomic<uint64_t> started;
+		std::atomic<uint64_t> ended;
+		
+		std::string error;
+		
+		uv_thread_t thread;
+		bool joinable;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "module.hh"
+
+Histogram::Histogram() {
+	this->reset();
+}
+
+void Histogram::reset() {
+	memset(this->counts, 0, sizeof(this->counts));
+	this->total = 0;
+	this->sum = 0;
+	this->vmin = UINT64_MAX;
+	this->vmax = 0;
+}
+
+double Histogram::mean() const {
+	if(this->total == 0)
+		return(0);
+	
+	return((double) this->sum / this->total);
+}
+
+uint64_t Histogram::percentile(double p) const {
+	uint64_t rank;
+	uint64_t seen = 0;
+	uint64_t ret;
+	int i;
+	
+	if(this->total == 0)
+		return(0);
+	
+	rank = (uint64_t) ceil(p / 100.0 * this->total);
+	if(rank < 1)
+		rank = 1;
+	
+	for(i = 0 ; i < HISTOGRAM_BUCKETS ; i++) {
+		seen += this->counts[i];
+		if(seen >= rank)
+			break;
+	}
+	
+	/* Never report more than what was really seen */
+	ret = value(i);
+	if(ret > this->vmax)
+		ret = this->vmax;
+	if(ret < this->vmin)
+		ret = this->vmin;
+	
+	return(ret);
+}
+
+uint64_t Histogram::value(int idx) {
+	int group = idx / HISTOGRAM_SUB_COUNT;
+	int sub = idx % HISTOGRAM_SUB_COUNT;
+	
+	if(group == 0)
+		return(sub);
+	
+	/* Upper bound of the bucket */
+	return((((uint64_t) HISTOGRAM_SUB_COUNT + sub + 1) << (group - 1)) - 1);
+}
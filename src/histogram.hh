@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _H_NODETUNTAP_HISTOGRAM
+#define _H_NODETUNTAP_HISTOGRAM
+
+#define HISTOGRAM_SUB_BITS		6
+#define HISTOGRAM_MAX_BITS		40
+#define HISTOGRAM_SUB_COUNT		(1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS		((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+/*
+ * HDR-style log-linear histogram. Each power of two is split into
+ * HISTOGRAM_SUB_COUNT linear buckets, so the recorded values keep about 1.5%
+ * of precision from 1 up to 2^HISTOGRAM_MAX_BITS (about 18 minutes when
+ * counting nanoseconds). Bigger values are clamped.
+ */
+class Histogram {
+	public:
+		Histogram();
+		
+		inline void record(uint64_t value) {
+			this->counts[index(value)]++;
+			this->total++;
+			this->sum += value;
+			if(value < this->vmin)
+				this->vmin = value;
+			if(value > this->vmax)
+				this->vmax = value;
+		}
+		
+		void reset();
+		
+		uint64_t count() const { return(this->total); }
+		uint64_t min() const { return(this->total ? this->vmin : 0); }
+		uint64_t max() const { return(this->vmax); }
+		double mean() const;
+		uint64_t percentile(double p) const;
+		
+	private:
+		static inline int index(uint64_t value) {
+			int msb;
+			
+			if(value < HISTOGRAM_SUB_COUNT)
+				return(value);
+			
+			msb = 63 - __builtin_clzll(value);
+			if(msb >= HISTOGRAM_MAX_BITS)
+				return(HISTOGRAM_BUCKETS - 1);
+			
+			return(
+				(msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT +
+				(value >> (msb - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB_COUNT
+			);
+		}
+		
+		static uint64_t value(int idx);
+		
+		uint64_t counts[HISTOGRAM_BUCKETS];
+		uint64_t total;
+		uint64_t sum;
+		uint64_t vmin;
+		uint64_t vmax;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "module.hh"
+
+uint16_t inetEtherType(const uint8_t *data, int size, int l3_off) {
+	if(size < l3_off)
+		return(0);
+	
+	return(inetRead16(data + l3_off - 2));
+}
+
+bool inetFlow(const uint8_t *data, int size, int l3_off, inet_flow_t *flow) {
+	const uint8_t *l3 = data + l3_off;
+	const uint8_t *l4;
+	int l3_size = size - l3_off;
+	int l4_size;
+	
+	switch(inetEtherType(data, size, l3_off)) {
+		case INET_ETHTYPE_IPV4:
+			if(l3_size < 20 || (l3[0] >> 4) != 4 || (l3[0] & 0x0F) < 5)
+				return(false);
+			
+			flow->family = 4;
+			flow->proto = l3[9];
+			flow->dscp = l3[1] >> 2;
+			memset(flow->src, 0, sizeof(flow->src));
+			memset(flow->dst, 0, sizeof(flow->dst));
+			memcpy(flow->src, l3 + 12, 4);
+			memcpy(flow->dst, l3 + 16, 4);
+			
+			l4 = l3 + (l3[0] & 0x0F) * 4;
+			l4_size = l3_size - (l3[0] & 0x0F) * 4;
+			if(inetRead16(l3 + 6) & 0x1FFF)
+				l4_size = 0;
+			break;
+		
+		case INET_ETHTYPE_IPV6:
+			if(l3_size < 40 || (l3[0] >> 4) != 6)
+				return(false);
+			
+			flow->family = 6;
+			flow->proto = l3[6];
+			flow->dscp = (((l3[0] & 0x0F) << 4) | (l3[1] >> 4)) >> 2;
+			memcpy(flow->src, l3 + 8, 16);
+			memcpy(flow->dst, l3 + 24, 16);
+			
+			l4 = l3 + 40;
+			l4_size = l3_size - 40;
+			break;
+		
+		default:
+			return(false);
+	}
+	
+	flow->sport = 0;
+	flow->dport = 0;
+	flow->tcp_flags = 0;
+	if((flow->proto == INET_PROTO_TCP || flow->proto == INET_PROTO_UDP) && l4_size >= 4) {
+		flow->sport = inetRead16(l4);
+		flow->dport = inetRead16(l4 + 2);
+	}
+	if(flow->proto == INET_PROTO_TCP && l4_size >= 14)
+		flow->tcp_flags = l4[13];
+	
+	return(true);
+}
+
+/*
+ * The words are summed in the host byte order, 4 bytes at a time in a 64
+ * bits accumulator, which the compiler vectorizes. The one's complement sum
+ * does not depend on the byte order, up to a final swap (RFC 1071).
+ */
+uint32_t inetChecksumAdd(const uint8_t *data, int size, uint32_t sum) {
+	uint64_t acc = 0;
+	uint32_t word;
+	uint16_t half;
+	int i = 0;
+	
+	for( ; i + 4 <= size ; i += 4) {
+		memcpy(&word, data + i, 4);
+		acc += word;
+	}
+	
+	if(i + 2 <= size) {
+		memcpy(&half, data + i, 2);
+		acc += half;
+		i += 2;
+	}
+	
+	if(i < size) {
+		half = 0;
+		memcpy(&half, data + i, 1);
+		acc += half;
+	}
+	
+	while(acc >> 16)
+		acc = (acc & 0xFFFF) + (acc >> 16);
+	
+	return(sum + be16toh((uint16_t) acc));
+}
+
+uint16_t inetChecksumFold(uint32_t sum) {
+	while(sum >> 16)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	
+	return((uint16_t) ~sum);
+}
+
+uint16_t inetChecksum(const uint8_t *data, int size) {
+	return(inetChecksumFold(inetChecksumAdd(data, size, 0)));
+}
+
+uint32_t inetPseudo6(const uint8_t *ip6, uint32_t length, uint8_t next) {
+	uint32_t sum;
+	
+	sum = inetChecksumAdd(ip6 + 8, 32, 0);
+	sum += length >> 16;
+	sum += length & 0xFFFF;
+	sum += next;
+	
+	return(sum);
+}
+
+int inetParseAddr(const std::string &str, uint8_t *addr) {
+	if(uv_inet_pton(AF_INET, str.c_str(), addr) == 0)
+		return(4);
+	if(uv_inet_pton(AF_INET6, str.c_str(), addr) == 0)
+		return(6);
+	return(0);
+}
+
+bool inetParseMac(const std::string &str, uint8_t *mac) {
+	unsigned int b[6];
+	
+	if(sscanf(str.c_str(), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+		return(false);
+	for(int i = 0 ; i < 6 ; i++)
+		mac[i] = b[i];
+	return(true);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _H_NODETUNTAP_INET
+#define _H_NODETUNTAP_INET
+
+#include <stdint.h>
+#include <string>
+
+/*
+ * Offsets inside the raw datagrams exchanged with the device. Each datagram
+ * starts with the 4 bytes packet information header, followed in tap mode by
+ * the ethernet header.
+ */
+#define INET_PI_LEN			4
+#define INET_ETH_LEN			14
+#define INET_TUN_L3_OFF			INET_PI_LEN
+#define INET_TAP_L3_OFF			(INET_PI_LEN + INET_ETH_LEN)
+
+#define INET_ETHTYPE_IPV4		0x0800
+#define INET_ETHTYPE_ARP		0x0806
+#define INET_ETHTYPE_VLAN		0x8100
+#define INET_ETHTYPE_IPV6		0x86DD
+
+#define INET_PROTO_ICMP			1
+#define INET_PROTO_TCP			6
+#define INET_PROTO_UDP			17
+#define INET_PROTO_IPV6_FRAG		44
+#define INET_PROTO_ICMPV6		58
+
+static inline uint16_t inetRead16(const uint8_t *p) {
+	return((uint16_t) ((p[0] << 8) | p[1]));
+}
+
+static inline uint32_t inetRead32(const uint8_t *p) {
+	return(((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3]);
+}
+
+static inline void inetWrite16(uint8_t *p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void inetWrite32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/* The fields of a datagram used to classify it */
+struct inet_flow_t {
+	int family;
+	uint8_t proto;
+	uint8_t dscp;
+	uint8_t src[16];
+	uint8_t dst[16];
+	uint16_t sport;
+	uint16_t dport;
+	uint8_t tcp_flags;
+};
+
+/*
+ * Returns the ethertype of a raw device datagram (from the packet
+ * information header in tun mode, from the ethernet header in tap mode),
+ * or 0 if the datagram is too short.
+ */
+uint16_t inetEtherType(const uint8_t *data, int size, int l3_off);
+
+/*
+ * Fills flow from an IPv4 or IPv6 raw device datagram, the addresses taking
+ * 4 or 16 bytes depending on the family (4 or 6). The ports are only set for
+ * TCP and UDP, and the flags for TCP, and are 0 for the non first
+ * fragments. Returns false for other datagrams.
+ */
+bool inetFlow(const uint8_t *data, int size, int l3_off, inet_flow_t *flow);
+
+/* One's complement sum, to be folded by inetChecksumFold() */
+uint32_t inetChecksumAdd(const uint8_t *data, int size, uint32_t sum);
+uint16_t inetChecksumFold(uint32_t sum);
+uint16_t inetChecksum(const uint8_t *data, int size);
+
+/* Sum of the IPv6 pseudo header, for upper layer checksums */
+uint32_t inetPseudo6(const uint8_t *ip6, uint32_t length, uint8_t next);
+
+/*
+ * Parses an IPv4 or IPv6 address into `addr` (4 or 16 bytes), returning its
+ * family (4 or 6), or 0 when invalid.
+ */
+int inetParseAddr(const std::string &str, uint8_t *addr);
+
+/* Parses an ethernet address written as aa:bb:cc:dd:ee:ff */
+bool inetParseMac(const std::string &str, uint8_t *mac);
+
+#endif
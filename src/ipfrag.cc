@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "module.hh"
+
+#define IPFRAG_PAYLOAD_OFF		(INET_TAP_L3_OFF + IPFRAG_HDR_ROOM)
+
+IpFrag::IpFrag() :
+		mtu(0),
+		timeout(IPFRAG_DFT_TIMEOUT),
+		max_size(IPFRAG_DFT_MAX_SIZE),
+		icmp(false),
+		slots(NULL),
+		slot_count(0)
+	{
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+IpFrag::~IpFrag() {
+	this->clear();
+}
+
+void IpFrag::configure(int mtu, int datagrams, int timeout, int max_size, bool icmp) {
+	int i;
+	
+	this->clear();
+	
+	if(max_size < 576 || max_size > IPFRAG_DFT_MAX_SIZE)
+		max_size = IPFRAG_DFT_MAX_SIZE;
+	if(datagrams <= 0)
+		datagrams = IPFRAG_DFT_DATAGRAMS;
+	if(timeout <= 0)
+		timeout = IPFRAG_DFT_TIMEOUT;
+	if(mtu != 0 && mtu < 68)
+		mtu = 68;
+	
+	this->mtu = mtu;
+	this->timeout = timeout;
+	this->max_size = max_size;
+	this->icmp = icmp;
+	
+	this->slots = new slot_t[datagrams];
+	this->slot_count = datagrams;
+	for(i = 0 ; i < datagrams ; i++) {
+		this->slots[i].used = false;
+		this->slots[i].data = new uint8_t[IPFRAG_PAYLOAD_OFF + max_size];
+		this->slots[i].bitmap = new uint8_t[(max_size / 8 + 8) / 8];
+	}
+}
+
+void IpFrag::clear() {
+	int i;
+	
+	for(i = 0 ; i < this->slot_count ; i++) {
+		delete[] this->slots[i].data;
+		delete[] this->slots[i].bitmap;
+	}
+	
+	delete[] this->slots;
+	this->slots = NULL;
+	this->slot_count = 0;
+}
+
+int IpFrag::effectiveMtu(int dev_mtu) const {
+	if(this->mtu > 0)
+		return(this->mtu);
+	
+	return(dev_mtu);
+}
+
+IpFrag::verdict_e IpFrag::check(const uint8_t *data, int size, int l3_off, int dev_mtu) {
+	const uint8_t *ip = data + l3_off;
+	int mtu = this->effectiveMtu(dev_mtu);
+	int hl;
+	
+	if(size - l3_off <= mtu)
+		return(FRAG_PASS);
+	
+	switch(inetEtherType(data, size, l3_off)) {
+		case INET_ETHTYPE_IPV4:
+			if(size - l3_off < 20 || (ip[0] >> 4) != 4)
+				return(FRAG_PASS);
+			
+			hl = (ip[0] & 0x0F) * 4;
+			if((ip[6] & 0x40) || hl + 8 > mtu) {
+				this->stats.frag_too_big++;
+				return(FRAG_TOO_BIG);
+			}
+			
+			this->stats.frag_datagrams++;
+			return(FRAG_SPLIT);
+		
+		case INET_ETHTYPE_IPV6:
+			this->stats.frag_too_big++;
+			return(FRAG_TOO_BIG);
+	}
+	
+	return(FRAG_PASS);
+}
+
+int IpFrag::fragmentMaxSize(int l3_off, int dev_mtu) const {
+	return(l3_off + this->effectiveMtu(dev_mtu));
+}
+
+int IpFrag::fragment(const uint8_t *data, int size, int l3_off, int dev_mtu, int idx, uint8_t *out) {
+	const uint8_t *ip = data + l3_off;
+	uint8_t *oip = out + l3_off;
+	int hl = (ip[0] & 0x0F) * 4;
+	int total = inetRead16(ip + 2);
+	uint16_t fo = inetRead16(ip + 6);
+	int chunk = (this->effectiveMtu(dev_mtu) - hl) & ~7;
+	int payload;
+	int offset;
+	int length;
+	int ohl;
+	int i;
+	bool more;
+	
+	if(total > size - l3_off)
+		total = size - l3_off;
+	payload = total - hl;
+	offset = idx * chunk;
+	
+	if(chunk <= 0 || offset >= payload)
+		return(0);
+	
+	length = payload - offset;
+	more = (fo & 0x2000) != 0;
+	if(length > chunk) {
+		length = chunk;
+		more = true;
+	}
+	
+	memcpy(out, data, l3_off);
+	
+	if(idx == 0) {
+		memcpy(oip, ip, hl);
+		ohl = hl;
+	}
+	else {
+		/* Only the options with the "copied" flag go in the next fragments */
+		memcpy(oip, ip, 20);
+		ohl = 20;
+		
+		for(i = 20 ; i < hl ; ) {
+			if(ip[i] == 0)
+				break;
+			if(ip[i] == 1) {
+				i++;
+				continue;
+			}
+			if(i + 1 >= hl || ip[i + 1] < 2 || i + ip[i + 1] > hl)
+				break;
+			if(ip[i] & 0x80) {
+				memcpy(oip + ohl, ip + i, ip[i + 1]);
+				ohl += ip[i + 1];
+			}
+			i += ip[i + 1];
+		}
+		
+		while(ohl & 3)
+			oip[ohl++] = 0;
+		oip[0] = 0x40 | (ohl / 4);
+	}
+	
+	memcpy(oip + ohl, ip + hl + offset, length);
+	
+	inetWrite16(oip + 2, ohl + length);
+	inetWrite16(oip + 6, (((fo & 0x1FFF) * 8 + offset) / 8) | (more ? 0x2000 : 0));
+	inetWrite16(oip + 10, 0);
+	inetWrite16(oip + 10, inetChecksum(oip, ohl));
+	
+	this->stats.frag_created++;
+	
+	return(l3_off + ohl + length);
+}
+
+int IpFrag::ptbMaxSize(int l3_off) const {
+	return(l3_off + 1280);
+}
+
+int IpFrag::reassembledMaxSize(int l3_off) const {
+	return(l3_off + IPFRAG_HDR_ROOM + this->max_size);
+}
+
+int IpFrag::makePtb(const uint8_t *data, int size, int l3_off, int dev_mtu, uint8_t *out) {
+	const uint8_t *ip = data + l3_off;
+	uint8_t *oip = out + l3_off;
+	uint16_t ethtype = inetEtherType(data, size, l3_off);
+	uint32_t sum;
+	int hl;
+	int quote;
+	
+	memcpy(out, data, INET_PI_LEN);
+	if(l3_off > INET_PI_LEN) {
+		/* Answer back to the sender of the frame */
+		memcpy(out + INET_PI_LEN, data + INET_PI_LEN + 6, 6);
+		memcpy(out + INET_PI_LEN + 6, data + INET_PI_LEN, 6);
+		memcpy(out + INET_PI_LEN + 12, data + INET_PI_LEN + 12, 2);
+	}
+	
+	if(ethtype == INET_ETHTYPE_IPV4) {
+		hl = (ip[0] & 0x0F) * 4;
+		
+		/* Never answer to non-first fragments and ICMP errors */
+		if(inetRead16(ip + 6) & 0x1FFF)
+			return(0);
+		if(ip[9] == INET_PROTO_ICMP && size - l3_off > hl) {
+			switch(ip[hl]) {
+				case 3: case 4: case 5: case 11: case 12:
+					return(0);
+			}
+		}
+		
+		quote = size - l3_off;
+		if(quote > 576 - 28)
+			quote = 576 - 28;
+		
+		oip[0] = 0x45;
+		oip[1] = 0;
+		inetWrite16(oip + 2, 28 + quote);
+		inetWrite32(oip + 4, 0);
+		oip[8] = 64;
+		oip[9] = INET_PROTO_ICMP;
+		inetWrite16(oip + 10, 0);
+		memcpy(oip + 12, ip + 16, 4);
+		memcpy(oip + 16, ip + 12, 4);
+		inetWrite16(oip + 10, inetChecksum(oip, 20));
+		
+		oip[20] = 3;
+		oip[21] = 4;
+		inetWrite16(oip + 22, 0);
+		inetWrite16(oip + 24, 0);
+		inetWrite16(oip + 26, this->effectiveMtu(dev_mtu));
+		memcpy(oip + 28, ip, quote);
+		inetWrite16(oip + 22, inetChecksum(oip + 20, 8 + quote));
+		
+		this->stats.ptb_sent++;
+		return(l3_off + 28 + quote);
+	}
+	else if(ethtype == INET_ETHTYPE_IPV6) {
+		if(size - l3_off < 40)
+			return(0);
+		if(ip[6] == INET_PROTO_ICMPV6 && size - l3_off > 40 && ip[40] < 128)
+			return(0);
+		
+		quote = size - l3_off;
+		if(quote > 1280 - 48)
+			quote = 1280 - 48;
+		
+		inetWrite32(oip, 0x60000000);
+		inetWrite16(oip + 4, 8 + quote);
+		oip[6] = INET_PROTO_ICMPV6;
+		oip[7] = 64;
+		memcpy(oip + 8, ip + 24, 16);
+		memcpy(oip + 24, ip + 8, 16);
+		
+		oip[40] = 2;
+		oip[41] = 0;
+		inetWrite16(oip + 42, 0);
+		inetWrite32(oip + 44, this->effectiveMtu(dev_mtu));
+		memcpy(oip + 48, ip, quote);
+		
+		sum = inetPseudo6(oip, 8 + quote, INET_PROTO_ICMPV6);
+		inetWrite16(oip + 42, inetChecksumFold(inetChecksumAdd(oip + 40, 8 + quote, sum)));
+		
+		this->stats.ptb_sent++;
+		return(l3_off + 48 + quote);
+	}
+	
+	return(0);
+}
+
+uint8_t *IpFrag::reassemble(uint8_t *data, int size, int l3_off, int *out_size) {
+	uint8_t *ip = data + l3_off;
+	uint64_t now;
+	slot_t *slot;
+	uint16_t fo;
+	int hl;
+	int total;
+	
+	switch(inetEtherType(data, size, l3_off)) {
+		case INET_ETHTYPE_IPV4:
+			if(size - l3_off < 20 || (ip[0] >> 4) != 4)
+				return(data);
+			
+			fo = inetRead16(ip + 6);
+			if((fo & 0x3FFF) == 0)
+				return(data);
+			
+			this->stats.reasm_fragments++;
+			
+			hl = (ip[0] & 0x0F) * 4;
+			total = inetRead16(ip + 2);
+			if(total > size - l3_off)
+				total = size - l3_off;
+			if(hl < 20 || total <= hl || ((fo & 0x2000) && ((total - hl) & 7))) {
+				this->stats.reasm_errors++;
+				return(NULL);
+			}
+			
+			now = uv_hrtime() / 1000000;
+			slot = this->slotGet(4, ip + 12, 8, inetRead16(ip + 4), ip[9], now);
+			
+			return(this->slotInsert(
+				slot,
+				data,
+				l3_off,
+				ip,
+				hl,
+				ip + hl,
+				total - hl,
+				(fo & 0x1FFF) * 8,
+				(fo & 0x2000) != 0,
+				out_size
+			));
+		
+		case INET_ETHTYPE_IPV6:
+			if(size - l3_off < 48 || (ip[0] >> 4) != 6 || ip[6] != INET_PROTO_IPV6_FRAG)
+				return(data);
+			
+			this->stats.reasm_fragments++;
+			
+			total = 40 + inetRead16(ip + 4);
+			if(total > size - l3_off)
+				total = size - l3_off;
+			fo = inetRead16(ip + 42);
+			if(total <= 48 || ((fo & 1) && ((total - 48) & 7))) {
+				this->stats.reasm_errors++;
+				return(NULL);
+			}
+			
+			now = uv_hrtime() / 1000000;
+			slot = this->slotGet(6, ip + 8, 32, inetRead32(ip + 44), ip[40], now);
+			
+			return(this->slotInsert(
+				slot,
+				data,
+				l3_off,
+				ip,
+				40,
+				ip + 48,
+				total - 48,
+				fo & 0xFFF8,
+				(fo & 1) != 0,
+				out_size
+			));
+	}
+	
+	return(data);
+}
+
+IpFrag::slot_t *IpFrag::slotGet(uint8_t version, const uint8_t *addr, int addr_len, uint32_t id, uint8_t proto, uint64_t now) {
+	slot_t *slot;
+	slot_t *found = NULL;
+	slot_t *avail = NULL;
+	slot_t *oldest = NULL;
+	int i;
+	
+	for(i = 0 ; i < this->slot_count ; i++) {
+		slot = &this->slots[i];
+		
+		if(slot->used && now - slot->started > (uint64_t) this->timeout) {
+			this->stats.reasm_timeouts++;
+			this->slotRelease(slot);
+		}
+		
+		if(!slot->used) {
+			if(!avail)
+				avail = slot;
+			continue;
+		}
+		
+		if(
+			slot->version == version &&
+			slot->key_id == id &&
+			slot->key_proto == proto &&
+			memcmp(slot->key_addr, addr, addr_len) == 0
+		)
+			found = slot;
+		
+		if(!oldest || slot->started < oldest->started)
+			oldest = slot;
+	}
+	
+	if(found)
+		return(found);
+	
+	if(!avail) {
+		this->stats.reasm_evicted++;
+		this->slotRelease(oldest);
+		avail = oldest;
+	}
+	
+	avail->used = true;
+	avail->version = version;
+	memcpy(avail->key_addr, addr, addr_len);
+	avail->key_id = id;
+	avail->key_proto = proto;
+	avail->started = now;
+	avail->total = -1;
+	avail->blocks = 0;
+	avail->filled = 0;
+	avail->hdr_size = 0;
+	memset(avail->bitmap, 0, (this->max_size / 8 + 8) / 8);
+	
+	return(avail);
+}
+
+void IpFrag::slotRelease(slot_t *slot) {
+	slot->used = false;
+}
+
+uint8_t *IpFrag::slotInsert(slot_t *slot, const uint8_t *data, int l3_off, const uint8_t *hdr, int hdr_size, const uint8_t *payload, int payload_size, int offset, bool more, int *out_size) {
+	uint8_t *out;
+	uint8_t *oip;
+	int block;
+	int last;
+	
+	if(
+		offset + payload_size > this->max_size ||
+		(!more && slot->total >= 0 && slot->total != offset + payload_size) ||
+		(more && slot->total >= 0 && offset + payload_size > slot->total)
+	) {
+		this->stats.reasm_errors++;
+		this->slotRelease(slot);
+		return(NULL);
+	}
+	
+	if(!more) {
+		slot->total = offset + payload_size;
+		slot->blocks = (slot->total + 7) / 8;
+	}
+	
+	if(offset == 0) {
+		slot->hdr_size = hdr_size;
+		memcpy(slot->data + IPFRAG_PAYLOAD_OFF - hdr_size, hdr, hdr_size);
+		memcpy(slot->data + IPFRAG_PAYLOAD_OFF - hdr_size - l3_off, data, l3_off);
+	}
+	
+	memcpy(slot->data + IPFRAG_PAYLOAD_OFF + offset, payload, payload_size);
+	
+	last = (offset + payload_size + 7) / 8;
+	for(block = offset / 8 ; block < last ; block++) {
+		if(!(slot->bitmap[block / 8] & (1 << (block & 7)))) {
+			slot->bitmap[block / 8] |= 1 << (block & 7);
+			slot->filled++;
+		}
+	}
+	
+	if(slot->total < 0 || slot->filled != slot->blocks || slot->hdr_size == 0)
+		return(NULL);
+	
+	this->slotRelease(slot);
+	
+	out = slot->data + IPFRAG_PAYLOAD_OFF - slot->hdr_size - l3_off;
+	oip = out + l3_off;
+	
+	if(slot->version == 4) {
+		if(slot->hdr_size + slot->total > 0xFFFF) {
+			this->stats.reasm_errors++;
+			return(NULL);
+		}
+		
+		inetWrite16(oip + 2, slot->hdr_size + slot->total);
+		inetWrite16(oip + 6, 0);
+		inetWrite16(oip + 10, 0);
+		inetWrite16(oip + 10, inetChecksum(oip, slot->hdr_size));
+	}
+	else {
+		inetWrite16(oip + 4, slot->total);
+		oip[6] = slot->key_proto;
+	}
+	
+	this->stats.reasm_datagrams++;
+	*out_size = l3_off + slot->hdr_size + slot->total;
+	
+	return(out);
+}
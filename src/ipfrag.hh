@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _H_NODETUNTAP_IPFRAG
+#define _H_NODETUNTAP_IPFRAG
+
+#define IPFRAG_DFT_DATAGRAMS		16
+#define IPFRAG_DFT_TIMEOUT		5000
+#define IPFRAG_DFT_MAX_SIZE		65535
+#define IPFRAG_HDR_ROOM			60
+
+/*
+ * IP fragmentation and reassembly engine.
+ * 
+ * On the write side, IPv4 datagrams bigger than the configured MTU are split
+ * into fragments, and datagrams that cannot be fragmented (DF bit or IPv6)
+ * are dropped, optionally answering with an ICMP "fragmentation needed" or
+ * ICMPv6 "packet too big" message.
+ * 
+ * On the read side, fragments are gathered in a fixed pool of preallocated
+ * datagram slots until the whole datagram is available. When the pool is
+ * full, the oldest pending datagram is evicted, and pending datagrams are
+ * dropped after a timeout.
+ * 
+ * All the datagrams handled here are raw device datagrams, the network
+ * header starting at `l3_off`.
+ */
+class IpFrag {
+	public:
+		IpFrag();
+		~IpFrag();
+		
+		enum verdict_e {
+			FRAG_PASS,
+			FRAG_SPLIT,
+			FRAG_TOO_BIG,
+		};
+		
+		struct stats_t {
+			uint64_t frag_datagrams;
+			uint64_t frag_created;
+			uint64_t frag_too_big;
+			uint64_t ptb_sent;
+			uint64_t reasm_fragments;
+			uint64_t reasm_datagrams;
+			uint64_t reasm_timeouts;
+			uint64_t reasm_evicted;
+			uint64_t reasm_errors;
+		};
+		
+		void configure(int mtu, int datagrams, int timeout, int max_size, bool icmp);
+		void clear();
+		
+		bool enabled() const { return(this->slot_count > 0); }
+		bool icmpEnabled() const { return(this->icmp); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+		/* Write side. `dev_mtu` is used when no MTU was configured */
+		verdict_e check(const uint8_t *data, int size, int l3_off, int dev_mtu);
+		int fragment(const uint8_t *data, int size, int l3_off, int dev_mtu, int idx, uint8_t *out);
+		int fragmentMaxSize(int l3_off, int dev_mtu) const;
+		int makePtb(const uint8_t *data, int size, int l3_off, int dev_mtu, uint8_t *out);
+		int ptbMaxSize(int l3_off) const;
+		
+		/*
+		 * Read side. Returns `data` itself when it is not a fragment, NULL
+		 * when the fragment has been consumed, or a pointer to the whole
+		 * reassembled datagram (valid until the next call).
+		 */
+		uint8_t *reassemble(uint8_t *data, int size, int l3_off, int *out_size);
+		int reassembledMaxSize(int l3_off) const;
+		
+	private:
+		struct slot_t {
+			bool used;
+			uint8_t version;
+			uint8_t key_addr[32];
+			uint32_t key_id;
+			uint8_t key_proto;
+			uint64_t started;
+			int total;
+			int blocks;
+			int filled;
+			int hdr_size;
+			uint8_t *data;
+			uint8_t *bitmap;
+		};
+		
+		int effectiveMtu(int dev_mtu) const;
+		slot_t *slotGet(uint8_t version, const uint8_t *addr, int addr_len, uint32_t id, uint8_t proto, uint64_t now);
+		void slotRelease(slot_t *slot);
+		uint8_t *slotInsert(slot_t *slot, const uint8_t *data, int l3_off, const uint8_t *hdr, int hdr_size, const uint8_t *payload, int payload_size, int offset, bool more, int *out_size);
+		
+		int mtu;
+		int timeout;
+		int max_size;
+		bool icmp;
+		
+		slot_t *slots;
+		int slot_count;
+		
+		stats_t stats;
+};
+
+#endif
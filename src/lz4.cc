@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+/*
+ * LZ4 block format : sequences made of a token (literals length in the high
+ * nibble, match length - 4 in the low one), the literals, and a 2 bytes
+ * match offset. The last sequence only has literals.
+ */
+#define LZ4_MIN_MATCH			4
+#define LZ4_LAST_LITERALS		5
+#define LZ4_MFLIMIT			12
+#define LZ4_HASH_BITS			12
+#define LZ4_SKIP_TRIGGER		6
+
+#define LZ4_PROBE_SAMPLES		128
+#define LZ4_PROBE_SKIP			64
+
+static inline uint32_t lz4Read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return(v);
+}
+
+static inline uint32_t lz4Hash(uint32_t v) {
+	return((v * 2654435761U) >> (32 - LZ4_HASH_BITS));
+}
+
+static inline uint8_t *lz4Length(uint8_t *op, int len) {
+	for(; len >= 255 ; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return(op);
+}
+
+static uint8_t *lz4Sequence(uint8_t *op, uint8_t *oend, const uint8_t *anchor, int lit, int offset, int mlen) {
+	uint8_t *token;
+	
+	/* Token, extra lengths, literals, offset */
+	if(op + lit + lit / 255 + mlen / 255 + 5 > oend)
+		return(NULL);
+	
+	token = op++;
+	if(lit >= 15) {
+		*token = 15 << 4;
+		op = lz4Length(op, lit - 15);
+	}
+	else
+		*token = lit << 4;
+	
+	memcpy(op, anchor, lit);
+	op += lit;
+	
+	if(offset == 0)
+		return(op);
+	
+	*op++ = offset;
+	*op++ = offset >> 8;
+	
+	if(mlen >= 15) {
+		*token |= 15;
+		op = lz4Length(op, mlen - 15);
+	}
+	else
+		*token |= mlen;
+	
+	return(op);
+}
+
+int lz4Compress(const uint8_t *src, int src_size, uint8_t *dst, int dst_size) {
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *end = src + src_size;
+	const uint8_t *mflimit = end - LZ4_MFLIMIT;
+	const uint8_t *mlimit = end - LZ4_LAST_LITERALS;
+	const uint8_t *ref;
+	const uint8_t *mp;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_size;
+	uint16_t table[1 << LZ4_HASH_BITS];
+	unsigned int searched = 0;
+	uint32_t seq;
+	uint32_t h;
+	
+	if(src_size > 0xFFFF)
+		return(0);
+	
+	if(src_size > LZ4_MFLIMIT) {
+		memset(table, 0, sizeof(table));
+		ip++;
+		
+		while(ip < mflimit) {
+			seq = lz4Read32(ip);
+			h = lz4Hash(seq);
+			ref = src + table[h];
+			table[h] = ip - src;
+			
+			if(lz4Read32(ref) != seq || ref >= ip) {
+				/* Speeds up on incompressible data, as LZ4 does */
+				ip += 1 + (searched++ >> LZ4_SKIP_TRIGGER);
+				continue;
+			}
+			searched = 0;
+			
+			while(ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			
+			mp = ip + LZ4_MIN_MATCH;
+			for(ref += LZ4_MIN_MATCH ; mp < mlimit && *mp == *ref ; mp++, ref++);
+			
+			op = lz4Sequence(op, oend, anchor, ip - anchor, mp - ref, mp - ip - LZ4_MIN_MATCH);
+			if(!op)
+				return(0);
+			
+			ip = anchor = mp;
+			if(ip < mflimit)
+				table[lz4Hash(lz4Read32(ip - 2))] = ip - 2 - src;
+		}
+	}
+	
+	op = lz4Sequence(op, oend, anchor, end - anchor, 0, 0);
+	if(!op)
+		return(0);
+	
+	return(op - dst);
+}
+
+int lz4Decompress(const uint8_t *src, int src_size, uint8_t *dst, int dst_size) {
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + src_size;
+	const uint8_t *ref;
+	uint8_t *op = dst;
+	uint8_t token;
+	uint8_t b;
+	int offset;
+	int len;
+	
+	while(ip < iend) {
+		token = *ip++;
+		
+		len = token >> 4;
+		if(len == 15) {
+			do {
+				if(ip >= iend)
+					return(-1);
+				b = *ip++;
+				len += b;
+			} while(b == 255);
+		}
+		
+		if(len > iend - ip || len > dst + dst_size - op)
+			return(-1);
+		
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+		
+		/* The last sequence has no match */
+		if(ip == iend)
+			break;
+		
+		if(iend - ip < 2)
+			return(-1);
+		
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > op - dst)
+			return(-1);
+		
+		len = token & 15;
+		if(len == 15) {
+			do {
+				if(ip >= iend)
+					return(-1);
+				b = *ip++;
+				len += b;
+			} while(b == 255);
+		}
+		len += LZ4_MIN_MATCH;
+		
+		if(len > dst + dst_size - op)
+			return(-1);
+		
+		ref = op - offset;
+		if(offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		}
+		else {
+			/* Overlapping match, repeats the last offset bytes */
+			while(len-- > 0)
+				*op++ = *ref++;
+		}
+	}
+	
+	return(op - dst);
+}
+
+/* n * log2(n), for the sample counts */
+struct lz4_nlog2_t {
+	lz4_nlog2_t() {
+		for(int i = 0 ; i <= LZ4_PROBE_SAMPLES ; i++)
+			this->v[i] = i > 0 ? i * log2((double) i) : 0;
+	}
+	
+	float v[LZ4_PROBE_SAMPLES + 1];
+};
+
+bool lz4Probe(const uint8_t *src, int size, int min_size) {
+	static const lz4_nlog2_t nlog2;
+	uint8_t counts[256];
+	double sum = 0;
+	int start;
+	int step;
+	int n;
+	int i;
+	
+	if(size < min_size || size < LZ4_MFLIMIT + 1)
+		return(false);
+	
+	/* The protocol headers compress well whatever the payload is */
+	start = size / 2 < LZ4_PROBE_SKIP ? size / 2 : LZ4_PROBE_SKIP;
+	n = size - start < LZ4_PROBE_SAMPLES ? size - start : LZ4_PROBE_SAMPLES;
+	step = (size - start) / n;
+	
+	memset(counts, 0, sizeof(counts));
+	for(i = 0 ; i < n ; i++)
+		counts[src[start + i * step]]++;
+	
+	for(i = 0 ; i < 256 ; i++)
+		sum += nlog2.v[counts[i]];
+	
+	/* Shannon estimate, against 85% of the maximum the sample can show */
+	return(log2((double) n) - sum / n < 0.85 * log2((double) n));
+}
+
+int lz4Frame(const uint8_t *src, int size, uint8_t *dst, int min_size) {
+	int ret;
+	
+	if(size > LZ4_FRAME_MAX || !lz4Probe(src, size, min_size))
+		return(0);
+	
+	/* Only worth it when the frame ends up smaller than the plain one */
+	ret = lz4Compress(src, size, dst + LZ4_FRAME_HDR, size - 3);
+	if(ret == 0)
+		return(0);
+	
+	ret += 2;
+	dst[0] = ret;
+	dst[1] = (ret >> 8) | (LZ4_FRAME_FLAG >> 8);
+	dst[2] = size;
+	dst[3] = size >> 8;
+	
+	return(ret + 2);
+}
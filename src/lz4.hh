@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_LZ4
+#define _H_NODETUNTAP_LZ4
+
+#include <stdint.h>
+
+/*
+ * Compressed frames of the muxer framing : the 2 bytes length has its
+ * highest bit set, and the payload starts with the uncompressed length (2
+ * bytes, little endian) followed by a LZ4 block.
+ */
+#define LZ4_FRAME_FLAG			0x8000
+#define LZ4_FRAME_MAX			0x7FFF
+#define LZ4_FRAME_HDR			4
+
+#define LZ4_DFT_MIN_SIZE		64
+
+/* Worst case size of a compressed block */
+#define LZ4_BOUND(_size_)		((_size_) + (_size_) / 255 + 16)
+
+/*
+ * Compresses src into a LZ4 block (src_size is limited to 64 KiB). Returns
+ * the compressed size, or 0 when the block does not fit in dst_size bytes.
+ */
+int lz4Compress(const uint8_t *src, int src_size, uint8_t *dst, int dst_size);
+
+/* Returns the decompressed size, or -1 if the block is invalid */
+int lz4Decompress(const uint8_t *src, int src_size, uint8_t *dst, int dst_size);
+
+/*
+ * Cheap entropy estimate on a sample of the payload : returns false when
+ * the payload is too small or looks incompressible (already compressed or
+ * encrypted data).
+ */
+bool lz4Probe(const uint8_t *src, int size, int min_size);
+
+/*
+ * Writes a compressed frame (header included) of src to dst if it is worth
+ * it. Returns the frame size, or 0 if the payload should be sent as is.
+ */
+int lz4Frame(const uint8_t *src, int size, uint8_t *dst, int min_size);
+
+#endif
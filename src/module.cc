@@ -23,9 +23,8 @@
 
 using namespace v8;
 
-void InitAll(Handle<Object> exports, Handle<Object> module) {
-	Tuntap::Init(module);
+/* Context aware, so that the module can be loaded by worker threads */
+NODE_MODULE_INIT() {
+	Tuntap::Init(module.As<Object>());
 }
 
-NODE_MODULE(tuntap, InitAll)
-
@@ -27,9 +27,11 @@
 #include <node_object_wrap.h>
 #include <uv.h>
 
+#include <atomic>
 #include <deque>
 #include <string>
 #include <map>
+#include <vector>
 
 #include <cstdio>
 #include <cstring>
@@ -38,8 +40,28 @@
 #include <cmath>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <endian.h>
 
 #include "ethertypes.hh"
+#include "inet.hh"
+#include "ipfrag.hh"
+#include "offload.hh"
+#include "capture.hh"
+#include "histogram.hh"
+#include "aead.hh"
+#include "lz4.hh"
+#include "ring.hh"
+#include "shaper.hh"
+#include "fqcodel.hh"
+#include "reactor.hh"
+#include "bufpool.hh"
+#include "generator.hh"
+#include "flowmeter.hh"
+#include "neighbor.hh"
+#include "autotune.hh"
+#include "vlan.hh"
 #include "tuntap.hh"
 
 #define TT_THROW(str) \
@@ -48,6 +70,18 @@
 #define TT_THROW_TYPE(str) \
 	isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, str)))
 
+#define TT_GETOPT(obj, name, var, conv) { \
+	Local<Value> _opt_ = (obj)->Get(String::NewFromUtf8(isolate, name)); \
+	if(!_opt_->IsUndefined()) \
+		var = _opt_->conv()->Value(); \
+}
+
+#define TT_GETOPT_STR(obj, name, var) { \
+	Local<Value> _opt_ = (obj)->Get(String::NewFromUtf8(isolate, name)); \
+	if(!_opt_->IsUndefined()) \
+		var = *String::Utf8Value(_opt_->ToString()); \
+}
+
 #define NVM_NEW_INSTANCE(target, isolate, argc, argv) ( \
 	(target) \
 	->NewInstance(isolate->GetCurrentContext(), argc, argv) \
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+#define ARP_LEN				28
+#define ICMP6_NS			135
+#define ICMP6_NA			136
+
+Neighbor::Neighbor() :
+	proxy_max(NEIGHBOR_DFT_PROXY_MAX)
+{
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+void Neighbor::add(const uint8_t *addr, int addr_len, const uint8_t *mac, bool router) {
+	entry_t &entry = this->owned[std::string((const char*) addr, addr_len)];
+	
+	memcpy(entry.mac, mac, 6);
+	entry.router = router;
+	entry.proxy = false;
+}
+
+bool Neighbor::addProxy(const uint8_t *addr, int addr_len, const uint8_t *mac) {
+	std::string key((const char*) addr, addr_len);
+	std::map<std::string, entry_t>::iterator it = this->proxied.find(key);
+	entry_t *entry;
+	
+	if(it != this->proxied.end()) {
+		entry = &it->second;
+	}
+	else {
+		if(this->proxied.size() >= this->proxy_max)
+			return(false);
+		entry = &this->proxied[key];
+	}
+	
+	memcpy(entry->mac, mac, 6);
+	entry->router = false;
+	entry->proxy = true;
+	
+	return(true);
+}
+
+bool Neighbor::removeProxy(const uint8_t *addr, int addr_len) {
+	return(this->proxied.erase(std::string((const char*) addr, addr_len)) > 0);
+}
+
+const Neighbor::entry_t *Neighbor::lookup(const uint8_t *addr, int addr_len) const {
+	std::string key((const char*) addr, addr_len);
+	std::map<std::string, entry_t>::const_iterator it;
+	
+	it = this->owned.find(key);
+	if(it != this->owned.end())
+		return(&it->second);
+	
+	it = this->proxied.find(key);
+	if(it != this->proxied.end())
+		return(&it->second);
+	
+	return(NULL);
+}
+
+bool Neighbor::process(int fd, const uint8_t *data, int size) {
+	uint8_t reply[NEIGHBOR_MAX_REPLY];
+	int len;
+	
+	switch(inetEtherType(data, size, INET_TAP_L3_OFF)) {
+		case INET_ETHTYPE_ARP:
+			len = this->arpReply(data, size, reply);
+			break;
+		
+		case INET_ETHTYPE_IPV6:
+			len = this->naReply(data, size, reply);
+			break;
+		
+		default:
+			return(false);
+	}
+	
+	if(len == 0)
+		return(false);
+	
+	if(write(fd, reply, len) != len)
+		this->stats.errors++;
+	
+	return(true);
+}
+
+/* Starts a reply frame from the device header and the ethernet header */
+static void neighborFrame(uint8_t *out, const uint8_t *dst, const uint8_t *src, uint16_t ethertype) {
+	out[0] = 0;
+	out[1] = 0;
+	inetWrite16(out + 2, ethertype);
+	memcpy(out + INET_PI_LEN, dst, 6);
+	memcpy(out + INET_PI_LEN + 6, src, 6);
+	inetWrite16(out + INET_PI_LEN + 12, ethertype);
+}
+
+/* ARP over ethernet for IPv4 (RFC 826) */
+int Neighbor::arpReply(const uint8_t *data, int size, uint8_t *out) {
+	const uint8_t *arp = data + INET_TAP_L3_OFF;
+	uint8_t *oarp = out + INET_TAP_L3_OFF;
+	const entry_t *entry;
+	
+	if(
+		size - INET_TAP_L3_OFF < ARP_LEN ||
+		inetRead16(arp) != 1 ||
+		inetRead16(arp + 2) != INET_ETHTYPE_IPV4 ||
+		arp[4] != 6 ||
+		arp[5] != 4 ||
+		inetRead16(arp + 6) != 1
+	)
+		return(0);
+	
+	this->stats.arp_requests++;
+	
+	/* Gratuitous ARP announces the address of its sender */
+	if(memcmp(arp + 14, arp + 24, 4) == 0)
+		return(0);
+	
+	if(!(entry = this->lookup(arp + 24, 4)))
+		return(0);
+	
+	neighborFrame(out, arp + 8, entry->mac, INET_ETHTYPE_ARP);
+	
+	inetWrite16(oarp, 1);
+	inetWrite16(oarp + 2, INET_ETHTYPE_IPV4);
+	oarp[4] = 6;
+	oarp[5] = 4;
+	inetWrite16(oarp + 6, 2);
+	memcpy(oarp + 8, entry->mac, 6);
+	memcpy(oarp + 14, arp + 24, 4);
+	memcpy(oarp + 18, arp + 8, 6);
+	memcpy(oarp + 24, arp + 14, 4);
+	
+	this->stats.arp_replies++;
+	if(entry->proxy)
+		this->stats.proxy_replies++;
+	
+	return(INET_TAP_L3_OFF + ARP_LEN);
+}
+
+/* Neighbor solicitations (RFC 4861), answered by a neighbor advertisement */
+int Neighbor::naReply(const uint8_t *data, int size, uint8_t *out) {
+	static const uint8_t all_nodes[16] = { 0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+	static const uint8_t all_nodes_mac[6] = { 0x33, 0x33, 0, 0, 0, 1 };
+	static const uint8_t unspecified[16] = { 0 };
+	const uint8_t *ip = data + INET_TAP_L3_OFF;
+	const uint8_t *icmp = ip + 40;
+	uint8_t *oip = out + INET_TAP_L3_OFF;
+	uint8_t *oicmp = oip + 40;
+	const entry_t *entry;
+	bool dad;
+	uint32_t sum;
+	
+	if(
+		size - INET_TAP_L3_OFF < 40 + 24 ||
+		ip[6] != INET_PROTO_ICMPV6 ||
+		ip[7] != 255 ||
+		icmp[0] != ICMP6_NS ||
+		icmp[1] != 0
+	)
+		return(0);
+	
+	this->stats.ns_requests++;
+	
+	if(!(entry = this->lookup(icmp + 8, 16)))
+		return(0);
+	
+	/* Duplicate address detection is answered to all the nodes */
+	dad = memcmp(ip + 8, unspecified, 16) == 0;
+	
+	neighborFrame(out, dad ? all_nodes_mac : data + INET_PI_LEN + 6, entry->mac, INET_ETHTYPE_IPV6);
+	
+	oip[0] = 0x60;
+	oip[1] = 0;
+	oip[2] = 0;
+	oip[3] = 0;
+	inetWrite16(oip + 4, 32);
+	oip[6] = INET_PROTO_ICMPV6;
+	oip[7] = 255;
+	memcpy(oip + 8, icmp + 8, 16);
+	memcpy(oip + 24, dad ? all_nodes : ip + 8, 16);
+	
+	oicmp[0] = ICMP6_NA;
+	oicmp[1] = 0;
+	inetWrite16(oicmp + 2, 0);
+	/* Router, solicited and override flags */
+	oicmp[4] = (entry->router ? 0x80 : 0) | (dad ? 0 : 0x40) | (entry->proxy ? 0 : 0x20);
+	oicmp[5] = 0;
+	oicmp[6] = 0;
+	oicmp[7] = 0;
+	memcpy(oicmp + 8, icmp + 8, 16);
+	/* Target link-layer address option */
+	oicmp[24] = 2;
+	oicmp[25] = 1;
+	memcpy(oicmp + 26, entry->mac, 6);
+	
+	sum = inetPseudo6(oip, 32, INET_PROTO_ICMPV6);
+	inetWrite16(oicmp + 2, inetChecksumFold(inetChecksumAdd(oicmp, 32, sum)));
+	
+	this->stats.na_replies++;
+	if(entry->proxy)
+		this->stats.proxy_replies++;
+	
+	return(INET_TAP_L3_OFF + 40 + 32);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_NEIGHBOR
+#define _H_NODETUNTAP_NEIGHBOR
+
+#define NEIGHBOR_DFT_PROXY_MAX		4096
+#define NEIGHBOR_MAX_REPLY		(INET_TAP_L3_OFF + 40 + 32)
+
+/*
+ * ARP and IPv6 neighbor discovery responder, for tap devices. The requests
+ * for an owned or proxied address (ARP requests, and neighbor solicitations
+ * without extension headers) are answered by writing the reply straight to
+ * the device, and are not delivered to javascript. The other frames are left
+ * alone.
+ * 
+ * The addresses are the raw 4 or 16 bytes, used as keys as they are.
+ */
+class Neighbor {
+	public:
+		struct stats_t {
+			uint64_t arp_requests;
+			uint64_t arp_replies;
+			uint64_t ns_requests;
+			uint64_t na_replies;
+			uint64_t proxy_replies;
+			uint64_t errors;
+		};
+		
+		Neighbor();
+		
+		/* Owned entries are answered with the router flag in neighbor advertisements */
+		void add(const uint8_t *addr, int addr_len, const uint8_t *mac, bool router);
+		bool addProxy(const uint8_t *addr, int addr_len, const uint8_t *mac);
+		bool removeProxy(const uint8_t *addr, int addr_len);
+		void setProxyMax(int max) { this->proxy_max = max; }
+		
+		/* Returns true if the frame was answered, the reply written to `fd` */
+		bool process(int fd, const uint8_t *data, int size);
+		
+		int getOwned() const { return(this->owned.size()); }
+		int getProxied() const { return(this->proxied.size()); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+	private:
+		struct entry_t {
+			uint8_t mac[6];
+			bool router;
+			bool proxy;
+		};
+		
+		const entry_t *lookup(const uint8_t *addr, int addr_len) const;
+		int arpReply(const uint8_t *data, int size, uint8_t *out);
+		int naReply(const uint8_t *data, int size, uint8_t *out);
+		
+		std::map<std::string, entry_t> owned;
+		std::map<std::string, entry_t> proxied;
+		size_t proxy_max;
+		
+		stats_t stats;
+};
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+#define TCP_FIN				0x01
+#define TCP_SYN				0x02
+#define TCP_RST				0x04
+#define TCP_PSH				0x08
+#define TCP_ACK				0x10
+#define TCP_CWR				0x80
+
+Offload::Offload() :
+	gso(false),
+	gro_cur(0),
+	gro_max(0),
+	held_size(0),
+	held_l3_off(0),
+	held_count(0),
+	held_mss(0),
+	held_closed(false)
+{
+	this->gro_bufs[0] = NULL;
+	this->gro_bufs[1] = NULL;
+	memset(&this->held, 0, sizeof(this->held));
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+Offload::~Offload() {
+	delete[] this->gro_bufs[0];
+	delete[] this->gro_bufs[1];
+}
+
+void Offload::configureGro(bool enable, int max_size) {
+	delete[] this->gro_bufs[0];
+	delete[] this->gro_bufs[1];
+	this->gro_bufs[0] = NULL;
+	this->gro_bufs[1] = NULL;
+	this->held_size = 0;
+	
+	if(!enable)
+		return;
+	
+	if(max_size <= 0)
+		max_size = OFFLOAD_DFT_GRO_SIZE;
+	else if(max_size > OFFLOAD_MAX_GRO_SIZE)
+		max_size = OFFLOAD_MAX_GRO_SIZE;
+	
+	/* Room for the biggest merged datagram, whatever the mode */
+	this->gro_max = max_size;
+	this->gro_bufs[0] = new uint8_t[INET_TAP_L3_OFF + max_size];
+	this->gro_bufs[1] = new uint8_t[INET_TAP_L3_OFF + max_size];
+	this->gro_cur = 0;
+}
+
+/* Parses an IPv4 (without options) or IPv6 (without extension headers) TCP segment */
+bool Offload::parse(const uint8_t *data, int size, int l3_off, tcp_t *tcp) {
+	const uint8_t *ip = data + l3_off;
+	const uint8_t *th;
+	int l3_size = size - l3_off;
+	
+	switch(inetEtherType(data, size, l3_off)) {
+		case INET_ETHTYPE_IPV4:
+			if(l3_size < 40 || ip[0] != 0x45 || ip[9] != INET_PROTO_TCP || (inetRead16(ip + 6) & 0x3FFF))
+				return(false);
+			tcp->family = 4;
+			tcp->ip_len = 20;
+			tcp->total = inetRead16(ip + 2);
+			break;
+		
+		case INET_ETHTYPE_IPV6:
+			if(l3_size < 60 || (ip[0] >> 4) != 6 || ip[6] != INET_PROTO_TCP)
+				return(false);
+			tcp->family = 6;
+			tcp->ip_len = 40;
+			tcp->total = 40 + inetRead16(ip + 4);
+			break;
+		
+		default:
+			return(false);
+	}
+	
+	/* The ethernet frames may be padded */
+	if(tcp->total > l3_size)
+		return(false);
+	
+	th = ip + tcp->ip_len;
+	tcp->tcp_len = (th[12] >> 4) * 4;
+	if(tcp->tcp_len < 20 || tcp->ip_len + tcp->tcp_len > tcp->total)
+		return(false);
+	
+	tcp->payload = tcp->total - tcp->ip_len - tcp->tcp_len;
+	tcp->seq = inetRead32(th + 4);
+	tcp->flags = th[13];
+	
+	return(true);
+}
+
+/* Sets the IP header checksum (IPv4) and the TCP checksum */
+void Offload::checksums(uint8_t *data, int l3_off, const tcp_t &tcp) {
+	uint8_t *ip = data + l3_off;
+	uint8_t *th = ip + tcp.ip_len;
+	int l4_size = tcp.total - tcp.ip_len;
+	uint32_t sum;
+	
+	inetWrite16(th + 16, 0);
+	
+	if(tcp.family == 4) {
+		inetWrite16(ip + 10, 0);
+		inetWrite16(ip + 10, inetChecksum(ip, 20));
+		sum = inetChecksumAdd(ip + 12, 8, 0) + INET_PROTO_TCP + l4_size;
+	}
+	else {
+		sum = inetPseudo6(ip, l4_size, INET_PROTO_TCP);
+	}
+	
+	inetWrite16(th + 16, inetChecksumFold(inetChecksumAdd(th, l4_size, sum)));
+}
+
+/*
+ * GRO
+ */
+bool Offload::mergeable(const uint8_t *data, int l3_off, const tcp_t &tcp) const {
+	const uint8_t *hdata = this->gro_bufs[this->gro_cur];
+	const uint8_t *ip = data + l3_off;
+	const uint8_t *hip = hdata + this->held_l3_off;
+	const uint8_t *th = ip + tcp.ip_len;
+	const uint8_t *hth = hip + this->held.ip_len;
+	
+	if(
+		this->held_closed ||
+		l3_off != this->held_l3_off ||
+		tcp.family != this->held.family ||
+		tcp.tcp_len != this->held.tcp_len ||
+		tcp.payload > this->held_mss ||
+		tcp.seq != this->held.seq + (uint32_t) this->held.payload ||
+		this->held.total + tcp.payload > this->gro_max
+	)
+		return(false);
+	
+	/* Device and ethernet headers */
+	if(memcmp(data, hdata, l3_off) != 0)
+		return(false);
+	
+	if(tcp.family == 4) {
+		/* TOS, flags (DF), TTL, protocol, and the addresses */
+		if(ip[1] != hip[1] || ip[6] != hip[6] || ip[8] != hip[8] || memcmp(ip + 12, hip + 12, 8) != 0)
+			return(false);
+	}
+	else {
+		/* Traffic class, flow label, hop limit, and the addresses */
+		if(memcmp(ip, hip, 4) != 0 || ip[7] != hip[7] || memcmp(ip + 8, hip + 8, 32) != 0)
+			return(false);
+	}
+	
+	/* Ports, acknowledgment, window and options */
+	return(
+		memcmp(th, hth, 4) == 0 &&
+		memcmp(th + 8, hth + 8, 4) == 0 &&
+		memcmp(th + 14, hth + 14, 2) == 0 &&
+		memcmp(th + 20, hth + 20, tcp.tcp_len - 20) == 0
+	);
+}
+
+void Offload::release(out_t *out) {
+	uint8_t *hdata = this->gro_bufs[this->gro_cur];
+	
+	if(this->held_count > 1) {
+		if(this->held.family == 4)
+			inetWrite16(hdata + this->held_l3_off + 2, this->held.total);
+		else
+			inetWrite16(hdata + this->held_l3_off + 4, this->held.total - 40);
+		
+		checksums(hdata, this->held_l3_off, this->held);
+	}
+	
+	out->data = hdata;
+	out->size = this->held_size;
+	
+	this->stats.gro_out++;
+	this->held_size = 0;
+	this->gro_cur ^= 1;
+}
+
+int Offload::groPush(uint8_t *data, int size, int l3_off, out_t *out) {
+	uint8_t *hdata;
+	tcp_t tcp;
+	int count = 0;
+	bool candidate;
+	
+	candidate =
+		parse(data, size, l3_off, &tcp) &&
+		tcp.payload > 0 &&
+		(tcp.flags & ~(TCP_ACK | TCP_PSH)) == 0 &&
+		(tcp.flags & TCP_ACK) &&
+		tcp.total <= this->gro_max;
+	
+	if(candidate)
+		this->stats.gro_segments++;
+	
+	if(this->held_size > 0) {
+		if(candidate && this->mergeable(data, l3_off, tcp)) {
+			hdata = this->gro_bufs[this->gro_cur];
+			memcpy(hdata + this->held_size, data + l3_off + tcp.ip_len + tcp.tcp_len, tcp.payload);
+			this->held_size += tcp.payload;
+			this->held.total += tcp.payload;
+			this->held.payload += tcp.payload;
+			this->held_count++;
+			this->stats.gro_merged++;
+			
+			/* A smaller segment or a push ends the merged segment */
+			hdata[this->held_l3_off + this->held.ip_len + 13] |= tcp.flags & TCP_PSH;
+			if(tcp.payload < this->held_mss || (tcp.flags & TCP_PSH))
+				this->held_closed = true;
+			
+			return(0);
+		}
+		
+		this->release(&out[count++]);
+	}
+	
+	if(candidate && !(tcp.flags & TCP_PSH)) {
+		memcpy(this->gro_bufs[this->gro_cur], data, l3_off + tcp.total);
+		this->held_size = l3_off + tcp.total;
+		this->held_l3_off = l3_off;
+		this->held_count = 1;
+		this->held_mss = tcp.payload;
+		this->held_closed = false;
+		this->held = tcp;
+		return(count);
+	}
+	
+	out[count].data = data;
+	out[count].size = size;
+	
+	return(count + 1);
+}
+
+int Offload::groFlush(out_t *out) {
+	if(this->held_size == 0)
+		return(0);
+	
+	this->release(out);
+	
+	return(1);
+}
+
+/*
+ * GSO
+ */
+bool Offload::gsoCheck(const uint8_t *data, int size, int l3_off, int dev_mtu) const {
+	tcp_t tcp;
+	
+	return(
+		this->gso &&
+		size - l3_off > dev_mtu &&
+		parse(data, size, l3_off, &tcp) &&
+		tcp.total > dev_mtu &&
+		tcp.payload > 0 &&
+		!(tcp.flags & TCP_SYN) &&
+		dev_mtu > tcp.ip_len + tcp.tcp_len
+	);
+}
+
+int Offload::segment(const uint8_t *data, int size, int l3_off, int dev_mtu, int idx, uint8_t *out) {
+	const uint8_t *ip = data + l3_off;
+	uint8_t *oip = out + l3_off;
+	uint8_t *oth;
+	int hdr_len;
+	int mss;
+	int off;
+	int len;
+	tcp_t tcp;
+	
+	if(!parse(data, size, l3_off, &tcp))
+		return(0);
+	
+	hdr_len = tcp.ip_len + tcp.tcp_len;
+	mss = dev_mtu - hdr_len;
+	off = idx * mss;
+	if(off >= tcp.payload)
+		return(0);
+	
+	len = tcp.payload - off;
+	if(len > mss)
+		len = mss;
+	
+	memcpy(out, data, l3_off + hdr_len);
+	memcpy(oip + hdr_len, ip + hdr_len + off, len);
+	
+	if(tcp.family == 4) {
+		inetWrite16(oip + 2, hdr_len + len);
+		inetWrite16(oip + 4, inetRead16(ip + 4) + idx);
+	}
+	else {
+		inetWrite16(oip + 4, hdr_len + len - 40);
+	}
+	
+	oth = oip + tcp.ip_len;
+	inetWrite32(oth + 4, tcp.seq + off);
+	if(off + len < tcp.payload)
+		oth[13] &= ~(TCP_FIN | TCP_PSH);
+	if(idx > 0)
+		oth[13] &= ~TCP_CWR;
+	
+	tcp.total = hdr_len + len;
+	checksums(out, l3_off, tcp);
+	
+	if(off + len >= tcp.payload)
+		this->stats.gso_datagrams++;
+	this->stats.gso_segments++;
+	
+	return(l3_off + hdr_len + len);
+}
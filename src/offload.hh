@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_OFFLOAD
+#define _H_NODETUNTAP_OFFLOAD
+
+#define OFFLOAD_DFT_GRO_SIZE		64000
+#define OFFLOAD_MAX_GRO_SIZE		65535
+
+/*
+ * TCP segmentation offloads, in userspace.
+ * 
+ * GRO merges the consecutive in order segments of a TCP flow read in the
+ * same round into a single segment, as the kernel does (RFC 9293 segments
+ * with the same headers but the sequence number, of the same size but the
+ * last one, carrying only ACK and PSH). The merged segment gets its own
+ * lengths and checksums, the datagrams coming from the kernel not being
+ * checked again.
+ * 
+ * GSO splits the TCP segments bigger than the device MTU into segments of
+ * the MTU, each one with its own sequence number, lengths and checksums.
+ * FIN and PSH only stay on the last segment, and CWR on the first one.
+ * 
+ * Only IPv4 without options and IPv6 without extension headers are merged
+ * or split, the other datagrams going through as they are.
+ */
+class Offload {
+	public:
+		struct stats_t {
+			uint64_t gro_segments;
+			uint64_t gro_merged;
+			uint64_t gro_out;
+			uint64_t gso_datagrams;
+			uint64_t gso_segments;
+		};
+		
+		/* A datagram ready to go on */
+		struct out_t {
+			uint8_t *data;
+			int size;
+		};
+		
+		Offload();
+		~Offload();
+		
+		void configureGro(bool enable, int max_size);
+		void configureGso(bool enable) { this->gso = enable; }
+		bool groEnabled() const { return(this->gro_bufs[0] != NULL); }
+		bool gsoEnabled() const { return(this->gso); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+		/*
+		 * Gives a datagram to GRO, which holds it or merges it into the held
+		 * one. Returns the number of datagrams (at most 2, in order) now ready,
+		 * valid until the next call.
+		 */
+		int groPush(uint8_t *data, int size, int l3_off, out_t *out);
+		
+		/* Releases the held datagram, at the end of a round. Returns 0 or 1 */
+		int groFlush(out_t *out);
+		
+		/* Tells if the datagram is a TCP segment to split */
+		bool gsoCheck(const uint8_t *data, int size, int l3_off, int dev_mtu) const;
+		
+		/* Writes the idx-th segment to `out`, returns its size, or 0 after the last one */
+		int segment(const uint8_t *data, int size, int l3_off, int dev_mtu, int idx, uint8_t *out);
+		int segmentMaxSize(int l3_off, int dev_mtu) const { return(l3_off + dev_mtu); }
+		
+	private:
+		struct tcp_t {
+			int family;
+			int ip_len;
+			int tcp_len;
+			int total;
+			int payload;
+			uint32_t seq;
+			uint8_t flags;
+		};
+		
+		static bool parse(const uint8_t *data, int size, int l3_off, tcp_t *tcp);
+		static void checksums(uint8_t *data, int l3_off, const tcp_t &tcp);
+		
+		bool mergeable(const uint8_t *data, int l3_off, const tcp_t &tcp) const;
+		void release(out_t *out);
+		
+		bool gso;
+		
+		uint8_t *gro_bufs[2];
+		int gro_cur;
+		int gro_max;
+		int held_size;
+		int held_l3_off;
+		int held_count;
+		int held_mss;
+		bool held_closed;
+		tcp_t held;
+		
+		stats_t stats;
+};
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+#include <sys/epoll.h>
+#include <mutex>
+
+using namespace v8;
+
+/* The reactors, one per event loop (main thread and workers) */
+static std::mutex reactorLock;
+static std::map<uv_loop_t*, Reactor*> reactorLoops;
+
+Reactor *Reactor::get(Isolate *isolate, uv_loop_t *loop) {
+	std::lock_guard<std::mutex> lock(reactorLock);
+	std::map<uv_loop_t*, Reactor*>::iterator it = reactorLoops.find(loop);
+	
+	if(it != reactorLoops.end())
+		return(it->second);
+	
+	return(reactorLoops[loop] = new Reactor(isolate, loop));
+}
+
+Reactor::Reactor(Isolate *isolate, uv_loop_t *loop) :
+	isolate(isolate),
+	loop(loop),
+	epfd(-1),
+	poll(NULL),
+	idle(NULL),
+	devices(0),
+	servicing(false)
+{
+	memset(&this->stats, 0, sizeof(this->stats));
+	
+	this->resource.Reset(isolate, Object::New(isolate));
+	
+	this->idle = new uv_idle_t;
+	uv_idle_init(loop, this->idle);
+	this->idle->data = this;
+}
+
+Reactor::~Reactor() {
+	if(this->poll) {
+		uv_poll_stop(this->poll);
+		uv_close((uv_handle_t*) this->poll, Tuntap::uv_free_cb<uv_poll_t>);
+	}
+	if(this->epfd >= 0)
+		::close(this->epfd);
+	
+	uv_idle_stop(this->idle);
+	uv_close((uv_handle_t*) this->idle, Tuntap::uv_free_cb<uv_idle_t>);
+	
+	this->resource.Reset();
+	
+	for(size_t i = 0 ; i < this->dead.size() ; i++)
+		delete this->dead[i];
+}
+
+Reactor::entry_t *Reactor::add(Tuntap *tt, int fd, std::string *err) {
+	struct epoll_event ev;
+	entry_t *entry;
+	
+	if(this->epfd < 0) {
+		this->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if(this->epfd < 0) {
+			*err = "epoll_create1: ";
+			*err += strerror(errno);
+			this->drop_unused();
+			return(NULL);
+		}
+		
+		this->poll = new uv_poll_t;
+		uv_poll_init(this->loop, this->poll, this->epfd);
+		this->poll->data = this;
+		uv_poll_start(this->poll, UV_READABLE, poll_cb);
+	}
+	
+	entry = new entry_t();
+	entry->tt = tt;
+	entry->rx_ready = false;
+	entry->tx_ready = false;
+	entry->queued = false;
+	
+	/* Registered once, for both directions : no epoll_ctl when they toggle */
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.ptr = entry;
+	if(epoll_ctl(this->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		*err = "epoll_ctl: ";
+		*err += strerror(errno);
+		delete entry;
+		this->drop_unused();
+		return(NULL);
+	}
+	
+	this->devices++;
+	
+	return(entry);
+}
+
+/* Called before the device is closed */
+void Reactor::remove(entry_t *entry) {
+	Tuntap *tt = entry->tt;
+	
+	epoll_ctl(this->epfd, EPOLL_CTL_DEL, tt->fd, NULL);
+	this->devices--;
+	
+	/* The entry may be in the batch being serviced, or on the ready list */
+	entry->tt = NULL;
+	this->dead.push_back(entry);
+	
+	if(!this->servicing)
+		this->collect();
+	
+	this->drop_unused();
+}
+
+/* A reactor left without devices is freed, unless it is being serviced */
+void Reactor::drop_unused() {
+	if(this->servicing || this->devices > 0)
+		return;
+	
+	std::lock_guard<std::mutex> lock(reactorLock);
+	reactorLoops.erase(this->loop);
+	delete this;
+}
+
+/* Frees the removed entries, once they are on no list */
+void Reactor::collect() {
+	size_t kept = 0;
+	
+	for(size_t n = 0 ; n < this->dead.size() ; n++) {
+		if(this->dead[n]->queued)
+			this->dead[kept++] = this->dead[n];
+		else
+			delete this->dead[n];
+	}
+	this->dead.resize(kept);
+}
+
+bool Reactor::wants(entry_t *entry) const {
+	Tuntap *tt = entry->tt;
+	
+	if(!tt || tt->fd < 0)
+		return(false);
+	
+	return(
+		(entry->rx_ready && tt->is_reading) ||
+		(entry->tx_ready && tt->is_writing && tt->write_queued() > 0)
+	);
+}
+
+void Reactor::schedule(entry_t *entry) {
+	if(entry->queued || !this->wants(entry))
+		return;
+	
+	entry->queued = true;
+	this->ready.push_back(entry);
+	
+	if(!this->servicing)
+		uv_idle_start(this->idle, idle_cb);
+}
+
+void Reactor::update(entry_t *entry) {
+	this->schedule(entry);
+}
+
+void Reactor::poll_cb(uv_poll_t *handle, int status, int events) {
+	Reactor *r = static_cast<Reactor*>(handle->data);
+	struct epoll_event evs[REACTOR_MAX_EVENTS];
+	entry_t *entry;
+	int count;
+	int i;
+	
+	r->stats.wakeups++;
+	
+	count = epoll_wait(r->epfd, evs, REACTOR_MAX_EVENTS, 0);
+	for(i = 0 ; i < count ; i++) {
+		entry = static_cast<entry_t*>(evs[i].data.ptr);
+		if(!entry->tt)
+			continue;
+		
+		if(evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			entry->rx_ready = true;
+		if(evs[i].events & EPOLLOUT)
+			entry->tx_ready = true;
+		
+		r->schedule(entry);
+	}
+	
+	if(count > 0)
+		r->stats.events += count;
+	
+	r->service();
+}
+
+void Reactor::idle_cb(uv_idle_t *handle) {
+	Reactor *r = static_cast<Reactor*>(handle->data);
+	
+	r->service();
+}
+
+void Reactor::service() {
+	Isolate *isolate = this->isolate;
+	HandleScope scope(isolate);
+	std::vector<entry_t*> batch;
+	bool drained;
+	entry_t *entry;
+	Tuntap *tt;
+	int ret;
+	int i;
+	
+	uv_idle_stop(this->idle);
+	
+	if(this->ready.empty())
+		return;
+	
+	this->stats.rounds++;
+	this->servicing = true;
+	batch.swap(this->ready);
+	
+	{
+		/* The callbacks of the whole batch share the tick processing */
+		Local<Object> resource = Local<Object>::New(isolate, this->resource);
+		node::CallbackScope cb_scope(isolate, resource, { 0, 0 });
+		
+		for(size_t n = 0 ; n < batch.size() ; n++) {
+			entry = batch[n];
+			entry->queued = false;
+			
+			if(!(tt = entry->tt))
+				continue;
+			
+			this->stats.dispatched++;
+			
+			/* Edge-triggered : the device must be read until it is empty */
+			if(entry->rx_ready && tt->is_reading && tt->fd >= 0) {
+				/* A round stopped by a full ring leaves the datagrams in the device */
+				tt->do_read(&drained);
+				if(drained)
+					entry->rx_ready = false;
+			}
+			
+			for(i = 0 ; i < REACTOR_WRITE_BATCH && entry->tt && tt->fd >= 0 && tt->write_queued() > 0 ; i++) {
+				ret = tt->do_write();
+				if(ret == -EAGAIN) {
+					entry->tx_ready = false;
+					break;
+				}
+			}
+			
+			/* Devices with data left are serviced in the next round */
+			if(entry->tt)
+				this->schedule(entry);
+		}
+	}
+	
+	this->servicing = false;
+	this->collect();
+	
+	if(!this->ready.empty())
+		uv_idle_start(this->idle, idle_cb);
+	
+	this->drop_unused();
+}
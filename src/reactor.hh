@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_REACTOR
+#define _H_NODETUNTAP_REACTOR
+
+#define REACTOR_MAX_EVENTS		256
+#define REACTOR_WRITE_BATCH		64
+
+class Tuntap;
+
+/*
+ * Shared epoll reactor : the devices of an event loop are registered once in
+ * a single edge-triggered epoll set, watched by one libuv handle. Each wakeup
+ * collects the ready devices and services them in a batch, inside a single
+ * callback scope. A device that still has data after its read batch stays
+ * on the ready list, which is serviced again from an idle handle.
+ */
+class Reactor {
+	public:
+		struct entry_t {
+			Tuntap *tt;
+			bool rx_ready;
+			bool tx_ready;
+			bool queued;
+		};
+		
+		struct stats_t {
+			uint64_t wakeups;
+			uint64_t events;
+			uint64_t rounds;
+			uint64_t dispatched;
+		};
+		
+		/* Returns the reactor of the loop, created on the first use */
+		static Reactor *get(v8::Isolate *isolate, uv_loop_t *loop);
+		
+		/* On failure, the reactor is freed if it has no other device */
+		entry_t *add(Tuntap *tt, int fd, std::string *err);
+		void remove(entry_t *entry);
+		
+		/* To be called when the device starts reading or has data to write */
+		void update(entry_t *entry);
+		
+		size_t getDevices() const { return(this->devices); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+	private:
+		Reactor(v8::Isolate *isolate, uv_loop_t *loop);
+		~Reactor();
+		
+		static void poll_cb(uv_poll_t *handle, int status, int events);
+		static void idle_cb(uv_idle_t *handle);
+		
+		bool wants(entry_t *entry) const;
+		void schedule(entry_t *entry);
+		void service();
+		void collect();
+		void drop_unused();
+		
+		v8::Isolate *isolate;
+		uv_loop_t *loop;
+		int epfd;
+		uv_poll_t *poll;
+		uv_idle_t *idle;
+		v8::Persistent<v8::Object> resource;
+		
+		std::vector<entry_t*> ready;
+		std::vector<entry_t*> dead;
+		size_t devices;
+		bool servicing;
+		stats_t stats;
+};
+
+#endif
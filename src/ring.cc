@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+static size_t ringDataOffset(int slots) {
+	return((RING_HDR_SIZE + (size_t) slots * RING_DESC_SIZE + 63) & ~(size_t) 63);
+}
+
+size_t Ring::bytes(int slots, int slot_size) {
+	return(ringDataOffset(slots) + (size_t) slots * slot_size);
+}
+
+Ring::Ring(uint8_t *base, int slots, int slot_size) :
+	base(base),
+	prod((uint32_t*) (base + RING_OFF_PROD)),
+	cons((uint32_t*) (base + RING_OFF_CONS)),
+	mask(slots - 1),
+	slots(slots),
+	slot_size(slot_size),
+	data_off(ringDataOffset(slots))
+{
+	uint32_t *hdr = (uint32_t*) base;
+	int i;
+	
+	memset(base, 0, RING_HDR_SIZE);
+	hdr[RING_OFF_SLOTS / 4] = slots;
+	hdr[RING_OFF_SLOT_SIZE / 4] = slot_size;
+	hdr[RING_OFF_DESC / 4] = RING_HDR_SIZE;
+	hdr[RING_OFF_DATA / 4] = this->data_off;
+	
+	/* The slot of each descriptor never moves */
+	for(i = 0 ; i < slots ; i++) {
+		uint32_t *d = this->desc(i);
+		d[0] = this->data_off + (size_t) i * slot_size;
+		d[1] = 0;
+		d[2] = 0;
+		d[3] = 0;
+	}
+}
+
+uint32_t Ring::hdr32(int off) const {
+	return(__atomic_load_n((uint32_t*) (this->base + off), __ATOMIC_RELAXED));
+}
+
+uint32_t *Ring::desc(uint32_t idx) const {
+	return((uint32_t*) (this->base + RING_HDR_SIZE) + (idx & this->mask) * (RING_DESC_SIZE / 4));
+}
+
+bool Ring::full() const {
+	uint32_t p = __atomic_load_n(this->prod, __ATOMIC_RELAXED);
+	uint32_t c = __atomic_load_n(this->cons, __ATOMIC_ACQUIRE);
+	
+	return(p - c >= (uint32_t) this->slots);
+}
+
+bool Ring::push(const uint8_t *data, int size, uint32_t flags) {
+	uint32_t p = __atomic_load_n(this->prod, __ATOMIC_RELAXED);
+	uint32_t *d;
+	
+	if(this->full() || size > this->slot_size) {
+		__atomic_add_fetch((uint32_t*) (this->base + RING_OFF_DROPPED), 1, __ATOMIC_RELAXED);
+		return(false);
+	}
+	
+	/* Never trusts the offsets, that javascript can write to */
+	d = this->desc(p);
+	d[0] = this->data_off + (size_t) (p & this->mask) * this->slot_size;
+	memcpy(this->base + d[0], data, size);
+	d[1] = size;
+	d[2] = flags;
+	
+	/* Publishes the slot and its descriptor */
+	__atomic_store_n(this->prod, p + 1, __ATOMIC_RELEASE);
+	
+	return(true);
+}
+
+uint8_t *Ring::peek(int *size, uint32_t *flags) const {
+	uint32_t c = __atomic_load_n(this->cons, __ATOMIC_RELAXED);
+	uint32_t p = __atomic_load_n(this->prod, __ATOMIC_ACQUIRE);
+	uint32_t *d;
+	
+	if(p == c)
+		return(NULL);
+	
+	d = this->desc(c);
+	*size = d[1] > (uint32_t) this->slot_size ? -1 : (int) d[1];
+	*flags = d[2];
+	
+	/* The slot is fixed, whatever the offset written by the producer */
+	return(this->base + this->data_off + (size_t) (c & this->mask) * this->slot_size);
+}
+
+void Ring::release() {
+	uint32_t c = __atomic_load_n(this->cons, __ATOMIC_RELAXED);
+	
+	__atomic_store_n(this->cons, c + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_RING
+#define _H_NODETUNTAP_RING
+
+#include <stdint.h>
+
+#define RING_DFT_SLOTS			1024
+#define RING_DFT_SLOT_SIZE		2048
+#define RING_MAX_SLOTS			(1 << 20)
+
+/*
+ * Layout of a ring, shared with javascript. The producer and consumer
+ * indices are free running 32 bits counters, each on its own cache line.
+ */
+#define RING_OFF_PROD			0
+#define RING_OFF_CONS			64
+#define RING_OFF_SLOTS			128
+#define RING_OFF_SLOT_SIZE		132
+#define RING_OFF_DESC			136
+#define RING_OFF_DATA			140
+#define RING_OFF_DROPPED		144
+#define RING_HDR_SIZE			192
+
+/* Descriptors : offset, length, flags, reserved (4 bytes each) */
+#define RING_DESC_SIZE			16
+
+/* Read ring : the datagram was encrypted by the aead stage */
+#define RING_FLAG_SEALED		0x1
+/* Write ring : the datagram is written as is, skipping the read stages */
+#define RING_FLAG_RAW			0x2
+
+/*
+ * Single producer / single consumer ring of fixed size packet slots, laid
+ * out in memory owned by a SharedArrayBuffer. One side is native, the other
+ * is javascript (possibly in another thread), which uses Atomics on the
+ * indices.
+ */
+class Ring {
+	public:
+		/* slots must be a power of 2 */
+		static size_t bytes(int slots, int slot_size);
+		
+		Ring(uint8_t *base, int slots, int slot_size);
+		
+		bool full() const;
+		
+		/* Producer side, returns false (and counts a drop) when full */
+		bool push(const uint8_t *data, int size, uint32_t flags);
+		
+		/* Consumer side, returns NULL when empty */
+		uint8_t *peek(int *size, uint32_t *flags) const;
+		void release();
+		
+		uint32_t getDropped() const { return(this->hdr32(RING_OFF_DROPPED)); }
+		int getSlots() const { return(this->slots); }
+		
+	private:
+		uint32_t hdr32(int off) const;
+		uint32_t *desc(uint32_t idx) const;
+		
+		uint8_t *base;
+		uint32_t *prod;
+		uint32_t *cons;
+		uint32_t mask;
+		int slots;
+		int slot_size;
+		size_t data_off;
+};
+
+#endif
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "module.hh"
+
+Shaper::Shaper() :
+	dft(NULL),
+	backlog(0),
+	rr(0)
+{
+}
+
+Shaper::~Shaper() {
+	for(size_t i = 0 ; i < this->classes.size() ; i++)
+		delete this->classes[i];
+}
+
+Shaper::class_t *Shaper::find(uint32_t id) const {
+	for(size_t i = 0 ; i < this->classes.size() ; i++) {
+		if(this->classes[i]->id == id)
+			return(this->classes[i]);
+	}
+	
+	return(NULL);
+}
+
+bool Shaper::addClass(uint32_t id, uint32_t parent, double rate, double ceil, int burst, int cburst, int limit, std::string *err) {
+	class_t *cls;
+	class_t *pcls = NULL;
+	
+	if(id == 0 || this->find(id)) {
+		*err = "Invalid or duplicate class id";
+		return(false);
+	}
+	
+	if(parent) {
+		pcls = this->find(parent);
+		if(!pcls) {
+			*err = "Unknown parent class";
+			return(false);
+		}
+		if(pcls->rules > 0 || pcls == this->dft) {
+			*err = "A class with rules cannot have children";
+			return(false);
+		}
+	}
+	
+	if(rate <= 0 || (ceil > 0 && ceil < rate)) {
+		*err = "Invalid class rate";
+		return(false);
+	}
+	
+	cls = new class_t();
+	cls->id = id;
+	cls->parent = pcls;
+	cls->children = 0;
+	cls->rules = 0;
+	cls->rate = rate;
+	cls->ceil = ceil > 0 ? ceil : rate;
+	cls->burst = burst > 0 ? burst : rate * SHAPER_DFT_BURST_NS / 1e9;
+	cls->cburst = cburst > 0 ? cburst : cls->ceil * SHAPER_DFT_BURST_NS / 1e9;
+	if(cls->burst < SHAPER_MIN_BURST)
+		cls->burst = SHAPER_MIN_BURST;
+	if(cls->cburst < SHAPER_MIN_BURST)
+		cls->cburst = SHAPER_MIN_BURST;
+	cls->tokens = cls->burst;
+	cls->ctokens = cls->cburst;
+	cls->last = uv_hrtime();
+	cls->limit = limit > 0 ? limit : SHAPER_DFT_LIMIT;
+	cls->packets = 0;
+	cls->bytes = 0;
+	cls->dropped = 0;
+	cls->borrowed = 0;
+	
+	this->classes.push_back(cls);
+	
+	/* The parent is no longer a leaf */
+	if(pcls && pcls->children++ == 0) {
+		for(size_t i = 0 ; i < this->leaves.size() ; i++) {
+			if(this->leaves[i] == pcls) {
+				this->leaves.erase(this->leaves.begin() + i);
+				break;
+			}
+		}
+	}
+	this->leaves.push_back(cls);
+	
+	return(true);
+}
+
+bool Shaper::addRule(uint32_t id, rule_t rule, std::string *err) {
+	rule.cls = this->find(id);
+	
+	if(!rule.cls || rule.cls->children > 0) {
+		*err = "The rules must lead to a leaf class";
+		return(false);
+	}
+	
+	rule.cls->rules++;
+	this->rules.push_back(rule);
+	
+	return(true);
+}
+
+bool Shaper::setDefault(uint32_t id, std::string *err) {
+	class_t *cls = this->find(id);
+	
+	if(!cls || cls->children > 0) {
+		*err = "The default class must be a leaf class";
+		return(false);
+	}
+	
+	this->dft = cls;
+	
+	return(true);
+}
+
+static bool shaperPrefix(const uint8_t *addr, const uint8_t *prefix, int len) {
+	int bytes = len / 8;
+	int bits = len % 8;
+	
+	if(memcmp(addr, prefix, bytes) != 0)
+		return(false);
+	
+	if(bits && ((addr[bytes] ^ prefix[bytes]) & (0xFF << (8 - bits))))
+		return(false);
+	
+	return(true);
+}
+
+Shaper::class_t *Shaper::classify(const uint8_t *data, int size, int l3_off, uint32_t mark) const {
+	inet_flow_t flow;
+	bool has_flow = inetFlow(data, size, l3_off, &flow);
+	
+	for(size_t i = 0 ; i < this->rules.size() ; i++) {
+		const rule_t &r = this->rules[i];
+		
+		if(r.mark >= 0 && r.mark != mark)
+			continue;
+		
+		if(r.dscp >= 0 || r.proto >= 0 || r.sport >= 0 || r.dport >= 0 || r.family) {
+			if(!has_flow)
+				continue;
+			if(r.dscp >= 0 && r.dscp != flow.dscp)
+				continue;
+			if(r.proto >= 0 && r.proto != flow.proto)
+				continue;
+			if(r.sport >= 0 && r.sport != flow.sport)
+				continue;
+			if(r.dport >= 0 && r.dport != flow.dport)
+				continue;
+			if(r.family && r.family != flow.family)
+				continue;
+			if(r.src_len >= 0 && !shaperPrefix(flow.src, r.src, r.src_len))
+				continue;
+			if(r.dst_len >= 0 && !shaperPrefix(flow.dst, r.dst, r.dst_len))
+				continue;
+		}
+		
+		return(r.cls);
+	}
+	
+	return(this->dft);
+}
+
+bool Shaper::enqueue(class_t *cls, void *pkt, int size) {
+	class_t::item_t item;
+	
+	if((int) cls->queue.size() >= cls->limit) {
+		cls->dropped++;
+		return(false);
+	}
+	
+	item.pkt = pkt;
+	item.size = size;
+	cls->queue.push_back(item);
+	this->backlog++;
+	
+	return(true);
+}
+
+void Shaper::refill(class_t *cls, uint64_t now) {
+	double elapsed;
+	
+	if(now <= cls->last)
+		return;
+	
+	elapsed = (now - cls->last) / 1e9;
+	cls->last = now;
+	
+	cls->tokens += elapsed * cls->rate;
+	if(cls->tokens > cls->burst)
+		cls->tokens = cls->burst;
+	
+	cls->ctokens += elapsed * cls->ceil;
+	if(cls->ctokens > cls->cburst)
+		cls->ctokens = cls->cburst;
+}
+
+/*
+ * As in HTB, a class may send while its bucket is not in debt, the packet
+ * then being charged, possibly leaving the bucket in debt. Returns the class
+ * whose rate is used (the leaf itself, or the ancestor it borrows from), or
+ * NULL.
+ */
+Shaper::class_t *Shaper::lender(class_t *cls, bool borrow) const {
+	class_t *p;
+	
+	for(p = cls ; p ; p = p->parent) {
+		if(p->ctokens < 0)
+			return(NULL);
+	}
+	
+	if(cls->tokens >= 0)
+		return(cls);
+	
+	if(!borrow)
+		return(NULL);
+	
+	for(p = cls->parent ; p ; p = p->parent) {
+		if(p->tokens >= 0)
+			return(p);
+	}
+	
+	return(NULL);
+}
+
+void *Shaper::dequeue(uint64_t now) {
+	class_t::item_t item;
+	class_t *cls;
+	class_t *from;
+	class_t *p;
+	size_t count = this->leaves.size();
+	size_t i;
+	int pass;
+	
+	if(this->backlog == 0)
+		return(NULL);
+	
+	for(i = 0 ; i < this->classes.size() ; i++)
+		this->refill(this->classes[i], now);
+	
+	/* The classes within their own rate go first, then the borrowers */
+	for(pass = 0 ; pass < 2 ; pass++) {
+		for(i = 0 ; i < count ; i++) {
+			cls = this->leaves[(this->rr + i) % count];
+			if(cls->queue.empty() || !(from = this->lender(cls, pass == 1)))
+				continue;
+			
+			item = cls->queue.front();
+			cls->queue.pop_front();
+			this->backlog--;
+			this->rr = (this->rr + i + 1) % count;
+			
+			/* The classes below the lender only pay their ceil */
+			for(p = cls ; p ; p = p->parent) {
+				if(p == from)
+					from = NULL;
+				if(!from)
+					p->tokens -= item.size;
+				p->ctokens -= item.size;
+				p->packets++;
+				p->bytes += item.size;
+			}
+			if(pass == 1)
+				cls->borrowed++;
+			
+			return(item.pkt);
+		}
+	}
+	
+	return(NULL);
+}
+
+uint64_t Shaper::nextTime(uint64_t now) const {
+	uint64_t next = 0;
+	double wait;
+	double t_ceil;
+	double t_rate;
+	class_t *cls;
+	class_t *p;
+	
+	for(size_t i = 0 ; i < this->leaves.size() ; i++) {
+		cls = this->leaves[i];
+		if(cls->queue.empty())
+			continue;
+		
+		/* Every ceil on the way must be paid back, and one rate */
+		t_ceil = 0;
+		t_rate = -1;
+		for(p = cls ; p ; p = p->parent) {
+			wait = p->ctokens < 0 ? -p->ctokens / p->ceil : 0;
+			if(wait > t_ceil)
+				t_ceil = wait;
+			
+			wait = p->tokens < 0 ? -p->tokens / p->rate : 0;
+			if(t_rate < 0 || wait < t_rate)
+				t_rate = wait;
+		}
+		
+		wait = t_ceil > t_rate ? t_ceil : t_rate;
+		if(next == 0 || now + (uint64_t) (wait * 1e9) < next)
+			next = now + (uint64_t) (wait * 1e9);
+	}
+	
+	return(next);
+}
+
+void *Shaper::drain() {
+	class_t::item_t item;
+	
+	for(size_t i = 0 ; i < this->leaves.size() ; i++) {
+		if(!this->leaves[i]->queue.empty()) {
+			item = this->leaves[i]->queue.front();
+			this->leaves[i]->queue.pop_front();
+			this->backlog--;
+			return(item.pkt);
+		}
+	}
+	
+	return(NULL);
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _H_NODETUNTAP_SHAPER
+#define _H_NODETUNTAP_SHAPER
+
+#include <stdint.h>
+
+#define SHAPER_DFT_LIMIT		1000
+#define SHAPER_MIN_BURST		1600
+/* Default burst : what the rate sends in 10ms */
+#define SHAPER_DFT_BURST_NS		10000000ULL
+
+/*
+ * HTB-like shaper : a tree of classes, each with a guaranteed rate and a
+ * ceil rate (token buckets in bytes). Only the leaves hold packets. A leaf
+ * sends within its own rate first, and otherwise borrows the unused rate
+ * of an ancestor, as long as none of the classes on the way exceeds its
+ * ceil. The packets are opaque pointers, owned by the caller.
+ */
+class Shaper {
+	public:
+		struct class_t {
+			uint32_t id;
+			class_t *parent;
+			int children;
+			int rules;
+			
+			double rate;
+			double ceil;
+			double burst;
+			double cburst;
+			double tokens;
+			double ctokens;
+			uint64_t last;
+			
+			struct item_t {
+				void *pkt;
+				int size;
+			};
+			std::deque<item_t> queue;
+			int limit;
+			
+			uint64_t packets;
+			uint64_t bytes;
+			uint64_t dropped;
+			uint64_t borrowed;
+		};
+		
+		/* Fields set to -1 (or an address length of -1) match anything */
+		struct rule_t {
+			rule_t() :
+				cls(NULL),
+				mark(-1),
+				dscp(-1),
+				proto(-1),
+				sport(-1),
+				dport(-1),
+				src_len(-1),
+				dst_len(-1),
+				family(0)
+			{}
+			
+			class_t *cls;
+			int64_t mark;
+			int dscp;
+			int proto;
+			int sport;
+			int dport;
+			int src_len;
+			int dst_len;
+			int family;
+			uint8_t src[16];
+			uint8_t dst[16];
+		};
+		
+		Shaper();
+		~Shaper();
+		
+		/* rate and ceil in bytes per second, ceil 0 meaning the rate */
+		bool addClass(uint32_t id, uint32_t parent, double rate, double ceil, int burst, int cburst, int limit, std::string *err);
+		bool addRule(uint32_t id, rule_t rule, std::string *err);
+		bool setDefault(uint32_t id, std::string *err);
+		
+		/* Returns the leaf of a raw device datagram, or NULL when unshaped */
+		class_t *classify(const uint8_t *data, int size, int l3_off, uint32_t mark) const;
+		
+		/* Returns false if the queue of the class is full */
+		bool enqueue(class_t *cls, void *pkt, int size);
+		
+		/* Returns the next packet allowed to be sent, or NULL */
+		void *dequeue(uint64_t now);
+		
+		/* Time at which a queued packet will be allowed, 0 if none */
+		uint64_t nextTime(uint64_t now) const;
+		
+		/* Removes a queued packet, whatever the rates, for the teardown */
+		void *drain();
+		
+		size_t getBacklog() const { return(this->backlog); }
+		const std::vector<class_t*> &getClasses() const { return(this->classes); }
+		
+	private:
+		class_t *find(uint32_t id) const;
+		void refill(class_t *cls, uint64_t now);
+		class_t *lender(class_t *cls, bool borrow) const;
+		
+		std::vector<class_t*> classes;
+		std::vector<class_t*> leaves;
+		std::vector<rule_t> rules;
+		class_t *dft;
+		size_t backlog;
+		size_t rr;
+};
+
+#endif
@@ -22,6 +22,7 @@
 #include "tuntap-itf.hh"
 
 #include <cerrno>
+#include <cstdlib>
 #include <cstring>
 
 #include <uv.h>
@@ -79,9 +80,13 @@ static bool doIfreq(int fd, struct ifreq *ifr, T *field, std::string addr, int p
 
 
 /*
- * Public functions
+ * Backend functions
  */
-bool tuntapItfCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err) {
+static bool kernelSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, int itf_fd, std::string *err);
+static bool kernelSetSndbuf(int fd, int sndbuf, std::string *err);
+static bool readCounter(const std::string &path, uint64_t *val);
+
+static bool kernelCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err) {
 	#define RETURN(_e) { \
 		if(err) \
 			*err = std::string(_e) + " : " + strerror(errno); \
@@ -111,6 +116,18 @@ bool tuntapItfCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err) {
 	else if(opts.mode == tuntap_itf_opts_t::MODE_TAP)
 		ifr.ifr_flags |= IFF_TAP;
 	
+	if(opts.is_multi_queue)
+		ifr.ifr_flags |= IFF_MULTI_QUEUE;
+	
+	if(opts.is_napi || opts.is_napi_frags) {
+#if defined(IFF_NAPI) && defined(IFF_NAPI_FRAGS)
+		ifr.ifr_flags |= (opts.is_napi ? IFF_NAPI : 0) | (opts.is_napi_frags ? IFF_NAPI_FRAGS : 0);
+#else
+		errno = ENOTSUP;
+		RETURN("NAPI flags are not supported by this system")
+#endif
+	}
+	
 	MK_IOCTL(*fd, TUNSETIFF, &ifr)
 	if(strlen(ifr.ifr_name) > 0)
 		opts.itf_name = ifr.ifr_name;
@@ -134,6 +151,14 @@ bool tuntapItfCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err) {
 	ifr.ifr_flags |= (opts.is_up ? IFF_UP : 0) | (opts.is_running ? IFF_RUNNING : 0);
 	MK_IOCTL(tun_sock, SIOCSIFFLAGS, &ifr)
 	
+	if(opts.txqueuelen > 0) {
+		ifr.ifr_qlen = opts.txqueuelen;
+		MK_IOCTL(tun_sock, SIOCSIFTXQLEN, &ifr)
+	}
+	
+	if(opts.sndbuf > 0)
+		MK_IOCTL(*fd, TUNSETSNDBUF, &opts.sndbuf)
+	
 	::close(tun_sock);
 	
 	#undef RETURN
@@ -143,7 +168,86 @@ bool tuntapItfCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err) {
 	return(true);
 }
 
-bool tuntapItfSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, std::string *err) {
+/* Whether the device of `fd` belongs to the network namespace of the process */
+static bool kernelOwnNetns(int fd) {
+#ifdef TUNGETDEVNETNS
+	struct stat dev_ns;
+	struct stat own_ns;
+	int ns_fd;
+	
+	if((ns_fd = ioctl(fd, TUNGETDEVNETNS)) < 0)
+		return(false);
+	
+	if(fstat(ns_fd, &dev_ns) < 0 || stat("/proc/self/ns/net", &own_ns) < 0) {
+		::close(ns_fd);
+		return(false);
+	}
+	::close(ns_fd);
+	
+	return(dev_ns.st_dev == own_ns.st_dev && dev_ns.st_ino == own_ns.st_ino);
+#else
+	return(false);
+#endif
+}
+
+static bool kernelAttach(tuntap_itf_opts_t &opts, int fd, std::string *err) {
+	struct ifreq ifr;
+	uint64_t flags;
+	int sock;
+	
+	memset(&ifr, 0, sizeof(ifr));
+	if(ioctl(fd, TUNGETIFF, &ifr) < 0) {
+		if(err)
+			*err = std::string("Not a tun/tap descriptor : ") + strerror(errno);
+		return(false);
+	}
+	
+	/*
+	 * The reads and writes expect the packet information header. TUNGETIFF
+	 * reports IFF_NOFILTER on the same bit as IFF_NO_PI when the queue has
+	 * no socket filter, so a set bit is checked against the flags of the
+	 * device in sysfs, which only shows the devices of our own namespace.
+	 */
+	if(
+		(ifr.ifr_flags & IFF_NO_PI) &&
+		kernelOwnNetns(fd) &&
+		(!readCounter(std::string("/sys/class/net/") + ifr.ifr_name + "/tun_flags", &flags) || (flags & IFF_NO_PI))
+	) {
+		if(err)
+			*err = "Not a tun/tap descriptor with packet information (IFF_NO_PI is set)";
+		return(false);
+	}
+	
+	opts.itf_name = ifr.ifr_name;
+	if(ifr.ifr_flags & IFF_TAP)
+		opts.mode = tuntap_itf_opts_t::MODE_TAP;
+	else
+		opts.mode = tuntap_itf_opts_t::MODE_TUN;
+	opts.is_multi_queue = (ifr.ifr_flags & IFF_MULTI_QUEUE) != 0;
+	
+	/* The reads are sized on the MTU : take the one of the device */
+	if(kernelOwnNetns(fd)) {
+		if((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || ioctl(sock, SIOCGIFMTU, &ifr) < 0) {
+			if(err)
+				*err = std::string("Error calling ioctl (SIOCGIFMTU) : ") + strerror(errno);
+			if(sock >= 0)
+				::close(sock);
+			return(false);
+		}
+		::close(sock);
+		opts.mtu = ifr.ifr_mtu;
+	}
+	
+	if(opts.sndbuf > 0 && !kernelSetSndbuf(fd, opts.sndbuf, err))
+		return(false);
+	
+	if(opts.txqueuelen > 0)
+		return(kernelSet(std::vector<tuntap_itf_opts_t::option_e>(1, tuntap_itf_opts_t::OPT_TXQUEUELEN), opts, fd, err));
+	
+	return(true);
+}
+
+static bool kernelSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, int itf_fd, std::string *err) {
 	struct ifreq ifr;
 	int fd;
 	
@@ -192,6 +296,15 @@ bool tuntapItfSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const
 					ifr.ifr_flags &= ~(IFF_RUNNING);
 				doIoctl(fd, SIOCSIFFLAGS, &ifr);
 				break;
+			case tuntap_itf_opts_t::OPT_TXQUEUELEN:
+				ifr.ifr_qlen = data.txqueuelen;
+				if(!doIoctl(fd, SIOCSIFTXQLEN, &ifr)) {
+					if(err)
+						*err = std::string("Error calling ioctl (SIOCSIFTXQLEN) : ") + strerror(errno);
+					::close(fd);
+					return(false);
+				}
+				break;
 		}
 	}
 	
@@ -199,3 +312,76 @@ bool tuntapItfSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const
 	
 	return(true);
 }
+
+static bool readCounter(const std::string &path, uint64_t *val) {
+	char buff[32];
+	ssize_t ret;
+	int fd;
+	
+	if((fd = ::open(path.c_str(), O_RDONLY)) < 0)
+		return(false);
+	
+	ret = read(fd, buff, sizeof(buff) - 1);
+	::close(fd);
+	if(ret <= 0)
+		return(false);
+	
+	buff[ret] = 0;
+	/* Decimal, or hexadecimal for the flags */
+	*val = strtoull(buff, NULL, 0);
+	
+	return(true);
+}
+
+static bool kernelStats(const tuntap_itf_opts_t &opts, int fd, tuntap_itf_stats_t *stats) {
+	std::string base = std::string("/sys/class/net/") + opts.itf_name.str() + "/";
+	uint64_t qlen = 0;
+	
+	if(
+		!readCounter(base + "statistics/rx_dropped", &stats->rx_dropped) ||
+		!readCounter(base + "statistics/rx_over_errors", &stats->rx_over_errors) ||
+		!readCounter(base + "statistics/tx_dropped", &stats->tx_dropped) ||
+		!readCounter(base + "statistics/tx_fifo_errors", &stats->tx_fifo_errors) ||
+		!readCounter(base + "tx_queue_len", &qlen)
+	)
+		return(false);
+	
+	stats->lost = 0;
+	stats->txqueuelen = qlen;
+	
+	return(true);
+}
+
+static bool kernelSetSndbuf(int fd, int sndbuf, std::string *err) {
+	if(ioctl(fd, TUNSETSNDBUF, &sndbuf) < 0) {
+		if(err)
+			*err = std::string("Error calling ioctl (TUNSETSNDBUF) : ") + strerror(errno);
+		return(false);
+	}
+	
+	return(true);
+}
+
+static int kernelGetSndbuf(int fd) {
+	int sndbuf = 0;
+	
+	if(ioctl(fd, TUNGETSNDBUF, &sndbuf) < 0)
+		return(-1);
+	
+	return(sndbuf);
+}
+
+static void kernelClose(const tuntap_itf_opts_t &opts, int fd) {
+	::close(fd);
+}
+
+const tuntap_itf_backend_t tuntapItfKernel = {
+	TUNTAP_DFT_BACKEND,
+	kernelCreate,
+	kernelAttach,
+	kernelClose,
+	kernelSet,
+	kernelStats,
+	kernelSetSndbuf,
+	kernelGetSndbuf,
+};
@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "tuntap-itf.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <uv.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define LOOPBACK_DFT_TXQUEUELEN		1000
+#define LOOPBACK_MAX_DATAGRAM		(65536 + 64)
+
+/*
+ * Each interface gets one end of a SOCK_SEQPACKET socket pair, which keeps
+ * the datagram boundaries as the tun/tap driver does. Without any latency
+ * nor loss, the two interfaces of a wire get the two ends of the same pair,
+ * so that a datagram written by one of them is read by the other one without
+ * any other copy. Otherwise each interface gets its own pair, and a relay
+ * thread moves the datagrams between the other ends, through a delay line.
+ */
+
+/* A datagram written, waiting for its due time */
+struct lo_held_t {
+	uint64_t due;
+	std::vector<uint8_t> data;
+};
+
+struct lo_end_t {
+	lo_end_t() :
+		fd(-1),
+		peer(-1),
+		closed(false),
+		blocked(false),
+		mode(0),
+		latency(0),
+		jitter(0),
+		loss(0),
+		rand(1),
+		last_due(0),
+		txqueuelen(LOOPBACK_DFT_TXQUEUELEN),
+		lost(0),
+		tx_dropped(0)
+	{}
+	
+	int fd;
+	int peer;
+	bool closed;
+	bool blocked;
+	int mode;
+	
+	/* The link emulated for the datagrams written by this end */
+	uint64_t latency;
+	uint64_t jitter;
+	double loss;
+	uint32_t rand;
+	uint64_t last_due;
+	std::deque<lo_held_t> held;
+	
+	/* The datagrams to this end, delayed or not read yet, are dropped over txqueuelen */
+	std::atomic<int> txqueuelen;
+	std::atomic<uint64_t> lost;
+	std::atomic<uint64_t> tx_dropped;
+};
+
+struct lo_wire_t {
+	lo_wire_t(const std::string &name) :
+		name(name),
+		count(0),
+		relayed(false)
+	{}
+	
+	std::string name;
+	lo_end_t ends[2];
+	int count;
+	bool relayed;
+	uv_thread_t thread;
+};
+
+typedef std::shared_ptr<lo_wire_t> lo_wire_ptr;
+
+/* The wires waiting for their second end, and the ends by descriptor */
+static std::mutex loLock;
+static std::map<std::string, lo_wire_ptr> loPending;
+static std::map<int, std::pair<lo_wire_ptr, int> > loEnds;
+
+/* xorshift32, enough to draw the losses and the jitter */
+static uint32_t loRandom(uint32_t *state) {
+	uint32_t x = *state;
+	
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	
+	return(x);
+}
+
+static bool loImpaired(const lo_end_t &end) {
+	return(end.latency > 0 || end.jitter > 0 || end.loss > 0);
+}
+
+static void loHold(lo_end_t *from, lo_end_t *to, const uint8_t *data, int size, uint64_t now) {
+	lo_held_t held;
+	
+	if(from->loss > 0 && (loRandom(&from->rand) >> 8) < from->loss * (1 << 24)) {
+		from->lost++;
+		return;
+	}
+	
+	if((int) from->held.size() >= to->txqueuelen) {
+		to->tx_dropped++;
+		return;
+	}
+	
+	held.due = now + from->latency;
+	if(from->jitter > 0)
+		held.due += loRandom(&from->rand) % (from->jitter + 1);
+	
+	/* The jitter does not reorder the datagrams */
+	if(held.due < from->last_due)
+		held.due = from->last_due;
+	from->last_due = held.due;
+	
+	held.data.assign(data, data + size);
+	from->held.push_back(held);
+}
+
+static void loRelay(void *arg) {
+	lo_wire_t *wire = static_cast<lo_wire_t*>(arg);
+	uint8_t *buff = new uint8_t[LOOPBACK_MAX_DATAGRAM];
+	struct pollfd pfd[2];
+	struct timespec ts;
+	uint64_t next;
+	uint64_t now;
+	ssize_t ret;
+	int d;
+	
+	for(;;) {
+		now = uv_hrtime();
+		next = UINT64_MAX;
+		
+		for(d = 0 ; d < 2 ; d++) {
+			lo_end_t *from = &wire->ends[d];
+			lo_end_t *to = &wire->ends[1 - d];
+			
+			from->blocked = false;
+			
+			while(!from->held.empty() && from->held.front().due <= now) {
+				const std::vector<uint8_t> &data = from->held.front().data;
+				
+				/* A slow reader keeps the datagrams held, up to its queue length */
+				if(to->peer >= 0 && send(to->peer, data.data(), data.size(), MSG_DONTWAIT) < 0) {
+					if(errno == EAGAIN || errno == EWOULDBLOCK) {
+						from->blocked = true;
+						break;
+					}
+					to->tx_dropped++;
+				}
+				from->held.pop_front();
+			}
+			
+			if(!from->blocked && !from->held.empty() && from->held.front().due < next)
+				next = from->held.front().due;
+		}
+		
+		for(d = 0 ; d < 2 ; d++) {
+			pfd[d].fd = wire->ends[d].peer;
+			pfd[d].events = POLLIN | (wire->ends[1 - d].blocked ? POLLOUT : 0);
+			pfd[d].revents = 0;
+		}
+		
+		if(wire->ends[0].peer < 0 && wire->ends[1].peer < 0)
+			break;
+		
+		if(next != UINT64_MAX) {
+			ts.tv_sec = (next - now) / 1000000000;
+			ts.tv_nsec = (next - now) % 1000000000;
+		}
+		
+		if(ppoll(pfd, 2, next != UINT64_MAX ? &ts : NULL, NULL) < 0) {
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		
+		now = uv_hrtime();
+		
+		for(d = 0 ; d < 2 ; d++) {
+			lo_end_t *from = &wire->ends[d];
+			
+			if(from->peer < 0 || (pfd[d].revents & ~POLLOUT) == 0)
+				continue;
+			
+			while((ret = recv(from->peer, buff, LOOPBACK_MAX_DATAGRAM, MSG_DONTWAIT)) > 0)
+				loHold(from, &wire->ends[1 - d], buff, ret, now);
+			
+			/* The interface closed its end */
+			if(pfd[d].revents & (POLLHUP | POLLERR)) {
+				::close(from->peer);
+				from->peer = -1;
+			}
+		}
+	}
+	
+	for(d = 0 ; d < 2 ; d++) {
+		if(wire->ends[d].peer >= 0)
+			::close(wire->ends[d].peer);
+		wire->ends[d].peer = -1;
+	}
+	
+	delete[] buff;
+}
+
+static void loConfigure(lo_end_t *end, int side, const tuntap_itf_opts_t &opts) {
+	end->mode = opts.mode;
+	end->latency = opts.loopback.latency;
+	end->jitter = opts.loopback.jitter;
+	end->loss = opts.loopback.loss;
+	end->rand = (opts.loopback.seed ^ (0x9E3779B9 * (side + 1))) | 1;
+	if(opts.txqueuelen > 0)
+		end->txqueuelen = opts.txqueuelen;
+}
+
+/* The kernel doubles the value set, for its own bookkeeping */
+static int loopbackGetSndbuf(int fd) {
+	socklen_t len = sizeof(int);
+	int sndbuf = 0;
+	
+	if(getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0)
+		return(-1);
+	
+	return(sndbuf / 2);
+}
+
+/* Without privilege, the send buffer is capped by net.core.wmem_max */
+static bool loopbackSetSndbuf(int fd, int sndbuf, std::string *err) {
+	if(
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf, sizeof(sndbuf)) < 0 &&
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) < 0
+	) {
+		if(err)
+			*err = std::string("Error calling setsockopt (SO_SNDBUF) : ") + strerror(errno);
+		return(false);
+	}
+	
+	if(loopbackGetSndbuf(fd) < sndbuf) {
+		if(err)
+			*err = "The send buffer is limited by net.core.wmem_max";
+		return(false);
+	}
+	
+	return(true);
+}
+
+static bool loopbackCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err) {
+	std::lock_guard<std::mutex> lock(loLock);
+	std::string name = opts.loopback.wire.size() > 0 ? opts.loopback.wire.str() : TUNTAP_DFT_WIRE;
+	std::map<std::string, lo_wire_ptr>::iterator it = loPending.find(name);
+	lo_wire_ptr wire;
+	lo_end_t *end;
+	int side;
+	int sv[2];
+	
+	#define RETURN(_e) { \
+		if(err) \
+			*err = std::string(_e) + " : " + strerror(errno); \
+		return(false); \
+	}
+	
+	if(it == loPending.end()) {
+		wire = lo_wire_ptr(new lo_wire_t(name));
+		side = 0;
+	}
+	else {
+		wire = it->second;
+		side = 1;
+		
+		if(wire->ends[0].mode != opts.mode) {
+			errno = EINVAL;
+			RETURN("The interfaces of a loopback wire must be of the same type")
+		}
+	}
+	
+	end = &wire->ends[side];
+	loConfigure(end, side, opts);
+	
+	if(side == 1 && !loImpaired(wire->ends[0]) && !loImpaired(wire->ends[1])) {
+		/* Both interfaces share the same pair */
+		end->fd = wire->ends[0].peer;
+		wire->ends[0].peer = -1;
+	}
+	else {
+		if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+			RETURN("Call of socketpair() failed")
+		
+		end->fd = sv[0];
+		end->peer = sv[1];
+		
+		if(side == 1) {
+			wire->relayed = true;
+			fcntl(wire->ends[0].peer, F_SETFL, fcntl(wire->ends[0].peer, F_GETFL) | O_NONBLOCK);
+			fcntl(wire->ends[1].peer, F_SETFL, fcntl(wire->ends[1].peer, F_GETFL) | O_NONBLOCK);
+			
+			if(uv_thread_create(&wire->thread, loRelay, wire.get()) != 0) {
+				::close(sv[0]);
+				::close(sv[1]);
+				end->fd = -1;
+				end->peer = -1;
+				wire->relayed = false;
+				errno = EAGAIN;
+				RETURN("Cannot start the loopback relay thread")
+			}
+		}
+	}
+	
+	if(side == 0)
+		loPending[name] = wire;
+	else
+		loPending.erase(it);
+	
+	wire->count++;
+	loEnds[end->fd] = std::make_pair(wire, side);
+	
+	if(opts.itf_name.size() == 0)
+		opts.itf_name = name + (side == 0 ? ".0" : ".1");
+	
+	*fd = end->fd;
+	
+	#undef RETURN
+	
+	if(opts.sndbuf > 0)
+		return(loopbackSetSndbuf(end->fd, opts.sndbuf, err));
+	
+	return(true);
+}
+
+/* A descriptor detached from another interface of this backend */
+static bool loopbackAttach(tuntap_itf_opts_t &opts, int fd, std::string *err) {
+	std::lock_guard<std::mutex> lock(loLock);
+	std::map<int, std::pair<lo_wire_ptr, int> >::iterator it = loEnds.find(fd);
+	lo_end_t *end;
+	
+	if(it == loEnds.end()) {
+		if(err)
+			*err = "Not a loopback descriptor";
+		return(false);
+	}
+	
+	end = &it->second.first->ends[it->second.second];
+	
+	if(end->mode == tuntap_itf_opts_t::MODE_TAP)
+		opts.mode = tuntap_itf_opts_t::MODE_TAP;
+	else
+		opts.mode = tuntap_itf_opts_t::MODE_TUN;
+	
+	if(opts.itf_name.size() == 0)
+		opts.itf_name = it->second.first->name + (it->second.second == 0 ? ".0" : ".1");
+	
+	if(opts.txqueuelen > 0)
+		end->txqueuelen = opts.txqueuelen;
+	
+	if(opts.sndbuf > 0 && !loopbackSetSndbuf(fd, opts.sndbuf, err))
+		return(false);
+	
+	return(true);
+}
+
+static void loopbackClose(const tuntap_itf_opts_t &opts, int fd) {
+	std::unique_lock<std::mutex> lock(loLock);
+	std::map<int, std::pair<lo_wire_ptr, int> >::iterator it = loEnds.find(fd);
+	lo_wire_ptr wire;
+	lo_end_t *end;
+	lo_end_t *other;
+	
+	if(it == loEnds.end()) {
+		::close(fd);
+		return;
+	}
+	
+	wire = it->second.first;
+	end = &wire->ends[it->second.second];
+	other = &wire->ends[1 - it->second.second];
+	loEnds.erase(it);
+	
+	end->closed = true;
+	
+	if(wire->count == 1) {
+		/* Never linked */
+		loPending.erase(wire->name);
+		::close(end->peer);
+		::close(fd);
+	}
+	else if(wire->relayed) {
+		::close(fd);
+		
+		/* The relay ends once it saw both interfaces go */
+		if(other->closed) {
+			lock.unlock();
+			uv_thread_join(&wire->thread);
+		}
+	}
+	else if(other->closed) {
+		::close(other->fd);
+		::close(fd);
+	}
+	
+	/*
+	 * Otherwise the end shared with the other interface stays open, so that
+	 * it does not see a hang up that a device never gives : its writes are
+	 * held back once the buffer of the closed end is full.
+	 */
+}
+
+static bool loopbackSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, int fd, std::string *err) {
+	std::lock_guard<std::mutex> lock(loLock);
+	std::map<int, std::pair<lo_wire_ptr, int> >::iterator it = loEnds.find(fd);
+	
+	if(it == loEnds.end())
+		return(true);
+	
+	/* Only the queue length means something without a kernel interface */
+	for(unsigned i = 0 ; i < options.size() ; i++) {
+		if(options[i] == tuntap_itf_opts_t::OPT_TXQUEUELEN)
+			it->second.first->ends[it->second.second].txqueuelen = data.txqueuelen;
+	}
+	
+	return(true);
+}
+
+static bool loopbackStats(const tuntap_itf_opts_t &opts, int fd, tuntap_itf_stats_t *stats) {
+	std::lock_guard<std::mutex> lock(loLock);
+	std::map<int, std::pair<lo_wire_ptr, int> >::iterator it = loEnds.find(fd);
+	lo_end_t *end;
+	
+	if(it == loEnds.end())
+		return(false);
+	
+	end = &it->second.first->ends[it->second.second];
+	
+	stats->rx_dropped = 0;
+	stats->rx_over_errors = 0;
+	stats->tx_dropped = end->tx_dropped;
+	stats->tx_fifo_errors = 0;
+	stats->lost = end->lost;
+	stats->txqueuelen = end->txqueuelen;
+	
+	return(true);
+}
+
+const tuntap_itf_backend_t tuntapItfLoopback = {
+	"loopback",
+	loopbackCreate,
+	loopbackAttach,
+	loopbackClose,
+	loopbackSet,
+	loopbackStats,
+	loopbackSetSndbuf,
+	loopbackGetSndbuf,
+};
@@ -19,6 +19,65 @@
  *
  */
 
+#include "tuntap-itf.hh"
+
+#include <map>
+#include <mutex>
+
+/* The interned strings, shared by the interfaces of all the threads */
+static std::mutex itfStrLock;
+static std::map<std::string, unsigned int> itfStrings;
+
+tuntap_itf_str_t::tuntap_itf_str_t(const tuntap_itf_str_t &from) :
+	entry(NULL)
+{
+	*this = from;
+}
+
+tuntap_itf_str_t::~tuntap_itf_str_t() {
+	this->set(NULL);
+}
+
+tuntap_itf_str_t &tuntap_itf_str_t::operator=(const tuntap_itf_str_t &from) {
+	if(from.entry) {
+		std::lock_guard<std::mutex> lock(itfStrLock);
+		from.entry->second++;
+	}
+	this->set(from.entry);
+	return(*this);
+}
+
+tuntap_itf_str_t &tuntap_itf_str_t::operator=(const std::string &str) {
+	entry_t *found = NULL;
+	
+	if(str.size() > 0) {
+		std::lock_guard<std::mutex> lock(itfStrLock);
+		found = &*itfStrings.insert(entry_t(str, 0)).first;
+		found->second++;
+	}
+	this->set(found);
+	return(*this);
+}
+
+const std::string &tuntap_itf_str_t::str() const {
+	static const std::string empty;
+	
+	return(this->entry ? this->entry->first : empty);
+}
+
+/* Takes a reference already counted, and drops the current one */
+void tuntap_itf_str_t::set(entry_t *entry) {
+	entry_t *old = this->entry;
+	
+	this->entry = entry;
+	if(!old)
+		return;
+	
+	std::lock_guard<std::mutex> lock(itfStrLock);
+	if(--old->second == 0)
+		itfStrings.erase(itfStrings.find(old->first));
+}
+
 #if defined(__APPLE__)
 #error "Apple OSes are not supported for now"
 #elif defined(__linux__)
@@ -28,4 +87,46 @@
 #include "tuntap-itf-linux.inc.cc"
 #else
 #error "Your operating system does not seems to be supported"
-#endif
\ No newline at end of file
+#endif
+
+const tuntap_itf_backend_t *tuntapItfBackend(const std::string &name) {
+	static const tuntap_itf_backend_t *backends[] = {
+		&tuntapItfKernel,
+		&tuntapItfLoopback,
+	};
+	
+	for(size_t i = 0 ; i < sizeof(backends) / sizeof(*backends) ; i++) {
+		if(name == backends[i]->name)
+			return(backends[i]);
+	}
+	
+	return(NULL);
+}
+
+bool tuntapItfCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err) {
+	return(opts.backend->create(opts, fd, err));
+}
+
+bool tuntapItfAttach(tuntap_itf_opts_t &opts, int fd, std::string *err) {
+	return(opts.backend->attach(opts, fd, err));
+}
+
+void tuntapItfClose(const tuntap_itf_opts_t &opts, int fd) {
+	opts.backend->close(opts, fd);
+}
+
+bool tuntapItfSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, int fd, std::string *err) {
+	return(data.backend->set(options, data, fd, err));
+}
+
+bool tuntapItfStats(const tuntap_itf_opts_t &opts, int fd, tuntap_itf_stats_t *stats) {
+	return(opts.backend->stats(opts, fd, stats));
+}
+
+bool tuntapItfSetSndbuf(const tuntap_itf_opts_t &opts, int fd, int sndbuf, std::string *err) {
+	return(opts.backend->set_sndbuf(fd, sndbuf, err));
+}
+
+int tuntapItfGetSndbuf(const tuntap_itf_opts_t &opts, int fd) {
+	return(opts.backend->get_sndbuf(fd));
+}
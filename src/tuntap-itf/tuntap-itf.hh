@@ -22,6 +22,7 @@
 #ifndef _H_NODETUNTAP_TUNTAP_ITF
 #define _H_NODETUNTAP_TUNTAP_ITF
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -30,6 +31,8 @@
 #define TUNTAP_DFT_PERSIST		true
 #define TUNTAP_DFT_UP			true
 #define TUNTAP_DFT_RUNNING		true
+#define TUNTAP_DFT_BACKEND		"kernel"
+#define TUNTAP_DFT_WIRE			"loopback"
 
 enum tuntap_etcomp_t {
 	TUNTAP_ETCOMP_NONE,
@@ -37,15 +40,66 @@ enum tuntap_etcomp_t {
 	TUNTAP_ETCOMP_FULL,
 };
 
+/*
+ * Interned configuration string. The equal strings of all the interfaces
+ * (addresses, masks...) share a single reference counted copy, each
+ * interface only keeping a pointer to it.
+ */
+struct tuntap_itf_str_t {
+	public:
+		tuntap_itf_str_t() : entry(NULL) {}
+		tuntap_itf_str_t(const tuntap_itf_str_t &from);
+		~tuntap_itf_str_t();
+		
+		tuntap_itf_str_t &operator=(const tuntap_itf_str_t &from);
+		tuntap_itf_str_t &operator=(const std::string &str);
+		
+		const std::string &str() const;
+		operator const std::string &() const { return(this->str()); }
+		const char *c_str() const { return(this->str().c_str()); }
+		size_t size() const { return(this->str().size()); }
+		size_t length() const { return(this->str().size()); }
+		
+	private:
+		typedef std::pair<const std::string, unsigned int> entry_t;
+		
+		void set(entry_t *entry);
+		
+		entry_t *entry;
+};
+
+struct tuntap_itf_backend_t;
+
+/* The device backend of the kernel tun/tap driver, the default one */
+extern const tuntap_itf_backend_t tuntapItfKernel;
+
+/*
+ * In memory backend, linking the interfaces created on the same wire by
+ * pairs, as if each one was the device of the other. Does not need any
+ * privilege.
+ */
+extern const tuntap_itf_backend_t tuntapItfLoopback;
+
 struct tuntap_itf_opts_t {
 	tuntap_itf_opts_t() :
+		backend(&tuntapItfKernel),
 		mode(MODE_TUN),
 		mtu(TUNTAP_DFT_MTU),
 		is_persistant(TUNTAP_DFT_PERSIST),
 		is_up(TUNTAP_DFT_UP),
 		is_running(TUNTAP_DFT_RUNNING),
+		is_multi_queue(false),
+		is_napi(false),
+		is_napi_frags(false),
+		sndbuf(0),
+		txqueuelen(0),
 		ethtype_comp(TUNTAP_ETCOMP_NONE)
-	{}
+	{
+		this->loopback.latency = 0;
+		this->loopback.jitter = 0;
+		this->loopback.loss = 0;
+		this->loopback.seed = 1;
+	}
 	
 	enum option_e {
 		OPT_ADDR,
@@ -55,25 +109,79 @@ struct tuntap_itf_opts_t {
 		OPT_PERSIST,
 		OPT_UP,
 		OPT_RUNNING,
+		OPT_TXQUEUELEN,
 	};
 	
+	const tuntap_itf_backend_t *backend;
+	
 	enum {
 		MODE_TUN,
 		MODE_TAP,
 	} mode;
 	
-	std::string itf_name;
-	std::string addr;
-	std::string dest;
-	std::string mask;
+	tuntap_itf_str_t itf_name;
+	tuntap_itf_str_t addr;
+	tuntap_itf_str_t dest;
+	tuntap_itf_str_t mask;
 	int mtu;
 	bool is_persistant;
 	bool is_up;
 	bool is_running;
+	bool is_multi_queue;
+	bool is_napi;
+	bool is_napi_frags;
+	int sndbuf;
+	int txqueuelen;
 	tuntap_etcomp_t ethtype_comp;
+	
+	/* Link emulated by the loopback backend, for the datagrams written */
+	struct {
+		tuntap_itf_str_t wire;
+		uint64_t latency;
+		uint64_t jitter;
+		double loss;
+		uint32_t seed;
+	} loopback;
+};
+
+/* Kernel counters of the interface, from sysfs */
+struct tuntap_itf_stats_t {
+	uint64_t rx_dropped;
+	uint64_t rx_over_errors;
+	uint64_t tx_dropped;
+	uint64_t tx_fifo_errors;
+	uint64_t lost;
+	int txqueuelen;
 };
 
+/*
+ * A device backend. The descriptors it gives are read and written as those
+ * of the tun/tap driver, one datagram (with its packet information header)
+ * at a time.
+ */
+struct tuntap_itf_backend_t {
+	const char *name;
+	bool (*create)(tuntap_itf_opts_t &opts, int *fd, std::string *err);
+	bool (*attach)(tuntap_itf_opts_t &opts, int fd, std::string *err);
+	void (*close)(const tuntap_itf_opts_t &opts, int fd);
+	bool (*set)(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, int fd, std::string *err);
+	bool (*stats)(const tuntap_itf_opts_t &opts, int fd, tuntap_itf_stats_t *stats);
+	bool (*set_sndbuf)(int fd, int sndbuf, std::string *err);
+	int (*get_sndbuf)(int fd);
+};
+
+/* Returns the backend of this name, or NULL */
+const tuntap_itf_backend_t *tuntapItfBackend(const std::string &name);
+
+/* These go to the backend of the options */
 bool tuntapItfCreate(tuntap_itf_opts_t &opts, int *fd, std::string *err);
-bool tuntapItfSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, std::string *err);
+bool tuntapItfAttach(tuntap_itf_opts_t &opts, int fd, std::string *err);
+void tuntapItfClose(const tuntap_itf_opts_t &opts, int fd);
+bool tuntapItfSet(const std::vector<tuntap_itf_opts_t::option_e> &options, const tuntap_itf_opts_t &data, int fd, std::string *err);
+bool tuntapItfStats(const tuntap_itf_opts_t &opts, int fd, tuntap_itf_stats_t *stats);
+
+/* The send buffer limits the datagrams written but not yet processed by the kernel */
+bool tuntapItfSetSndbuf(const tuntap_itf_opts_t &opts, int fd, int sndbuf, std::string *err);
+int tuntapItfGetSndbuf(const tuntap_itf_opts_t &opts, int fd);
 
 #endif
\ No newline at end of file
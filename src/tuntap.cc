@@ -23,29 +23,165 @@
 
 using namespace v8;
 
-Persistent<Function> Tuntap::constructor;
-
-Tuntap::Tuntap() :
+Tuntap::Tuntap(Isolate* isolate) :
+	isolate_(isolate),
+	loop_(node::GetCurrentEventLoop(isolate)),
 	fd(-1),
+	adopt_fd(-1),
+	capture_(NULL),
+	latency_(NULL),
+	coalesce_(NULL),
+	aead_(NULL),
+	ring_(NULL),
+	shaper_(NULL),
+	shaper_timer_(NULL),
+	fq_(NULL),
+	generator_(NULL),
+	generator_async_(NULL),
+	flows_(NULL),
+	flows_timer_(NULL),
+	flows_batch(FLOWMETER_DFT_BATCH),
+	neighbor_(NULL),
+	autotune_(NULL),
+	autotune_timer_(NULL),
+	vlan_(NULL),
+	reactor_(NULL),
+	reactor_entry_(NULL),
+	use_reactor(false),
+	lean(false),
+	pull_mode(false),
+	read_batch(1),
+	timestamps(false),
 	read_buff(NULL),
+	writ_buff(NULL),
 	is_reading(true),
-	is_writing(false)
-{}
+	is_writing(false),
+	uv_handle_(NULL),
+	disposed(false)
+{
+	memset(&this->stats_, 0, sizeof(this->stats_));
+	
+	/* The environment (main thread or worker) may go away before the object */
+	node::AddEnvironmentCleanupHook(isolate, env_cleanup, this);
+}
 
 Tuntap::~Tuntap() {
-	if(this->fd >= 0) {
-		::close(this->fd);
-		uv_poll_stop(&this->uv_handle_);
+	if(!this->disposed)
+		node::RemoveEnvironmentCleanupHook(this->isolate_, env_cleanup, this);
+	
+	this->dispose();
+}
+
+void Tuntap::env_cleanup(void *arg) {
+	static_cast<Tuntap*>(arg)->dispose();
+}
+
+/*
+ * Releases everything bound to the event loop and the device. The libuv
+ * handles are closed asynchronously, so they are allocated apart from the
+ * object.
+ */
+void Tuntap::dispose() {
+	if(this->disposed)
+		return;
+	this->disposed = true;
+	
+	this->release(true);
+	
+	if(this->capture_)
+		delete this->capture_;
+	if(this->latency_)
+		delete this->latency_;
+	if(this->coalesce_) {
+		delete[] this->coalesce_->data;
+		uv_close((uv_handle_t*) this->coalesce_->timer, uv_free_cb<uv_timer_t>);
+		delete this->coalesce_;
+	}
+	
+	if(this->aead_)
+		delete this->aead_;
+	
+	this->ring_stop();
+	this->shaper_stop();
+	
+	if(this->fq_)
+		delete this->fq_;
+	this->fq_ = NULL;
+	
+	if(this->generator_) {
+		delete this->generator_;
+		uv_close((uv_handle_t*) this->generator_async_, uv_free_cb<uv_async_t>);
+	}
+	this->generator_ = NULL;
+	this->generator_async_ = NULL;
+	
+	this->flows_stop();
+	
+	if(this->neighbor_)
+		delete this->neighbor_;
+	this->neighbor_ = NULL;
+	
+	this->autotune_stop();
+	
+	if(this->vlan_)
+		delete this->vlan_;
+	this->vlan_ = NULL;
+	
+	if(this->writ_buff) {
+		for(size_t i = 0 ; i < this->writ_buff->size() ; i++)
+			delete (*this->writ_buff)[i];
+		delete this->writ_buff;
+	}
+	this->writ_buff = NULL;
+	
+	this->capture_ = NULL;
+	this->latency_ = NULL;
+	this->coalesce_ = NULL;
+	this->aead_ = NULL;
+}
+
+void Tuntap::release(bool close_fd) {
+	/* The generator writes to the descriptor */
+	if(this->generator_)
+		this->generator_->stop();
+	
+	if(this->autotune_)
+		uv_timer_stop(this->autotune_timer_);
+	
+	if(this->reactor_entry_) {
+		this->reactor_->remove(this->reactor_entry_);
+		this->reactor_ = NULL;
+		this->reactor_entry_ = NULL;
+	}
+	
+	if(this->uv_handle_) {
+		uv_poll_stop(this->uv_handle_);
+		uv_close((uv_handle_t*) this->uv_handle_, uv_free_cb<uv_poll_t>);
+		this->uv_handle_ = NULL;
 	}
+	
+	if(this->coalesce_)
+		uv_timer_stop(this->coalesce_->timer);
+	
+	if(this->fd >= 0 && close_fd)
+		tuntapItfClose(this->itf_opts, this->fd);
+	this->fd = -1;
+	
 	if(this->read_buff)
 		delete[] this->read_buff;
+	this->read_buff = NULL;
+	
+	this->is_writing = false;
 }
 
 void Tuntap::Init(Handle<Object> module) {
 	Isolate* isolate = module->GetIsolate();
 	
+	// The constructor is kept per environment, for the plain function calls
+	Persistent<Function> *constructor = new Persistent<Function>();
+	
 	// Prepare constructor template
-	Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+	Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New, External::New(isolate, constructor));
 	tpl->SetClassName(String::NewFromUtf8(isolate, "tuntap"));
 	tpl->InstanceTemplate()->SetInternalFieldCount(1);
 	
@@ -53,16 +189,40 @@ void Tuntap::Init(Handle<Object> module) {
 #define SETFUNC(_name_) \
 	NODE_SET_PROTOTYPE_METHOD(tpl, #_name_, _name_);
 	SETFUNC(writeBuffer)
+	SETFUNC(writeBuffers)
 	SETFUNC(open)
 	SETFUNC(close)
 	SETFUNC(set)
 	SETFUNC(unset)
 	SETFUNC(stopRead)
 	SETFUNC(startRead)
+	SETFUNC(stats)
+	SETFUNC(capture)
+	SETFUNC(latency)
+	SETFUNC(detach)
+	SETFUNC(aeadPeer)
+	SETFUNC(ring)
+	SETFUNC(ringWrite)
+	SETFUNC(shaper)
+	SETFUNC(pull)
+	SETFUNC(readInto)
+	SETFUNC(readManyInto)
+	SETFUNC(generate)
+	SETFUNC(flows)
+	SETFUNC(flushFlows)
+	SETFUNC(neighbors)
+	SETFUNC(proxyNeighbor)
+	SETFUNC(vlans)
+	SETFUNC(writeVlan)
 	
 #undef SETFUNC
 	
-	constructor.Reset(isolate, tpl->GetFunction());
+	// Framing helpers, used by the muxer and the demuxer
+	tpl->Set(String::NewFromUtf8(isolate, "compress"), FunctionTemplate::New(isolate, compress));
+	tpl->Set(String::NewFromUtf8(isolate, "decompress"), FunctionTemplate::New(isolate, decompress));
+	
+	constructor->Reset(isolate, tpl->GetFunction());
+	node::AddEnvironmentCleanupHook(isolate, constructor_cleanup, constructor);
 	
 	module->Set(String::NewFromUtf8(isolate, "exports"), tpl->GetFunction());
 }
@@ -77,7 +237,7 @@ void Tuntap::New(const FunctionCallbackInfo<Value>& args) {
 	
 	if(args.IsConstructCall()) {
 		// Invoked as constructor: `new Tuntap(...)`
-		obj = new Tuntap();
+		obj = new Tuntap(isolate);
 		obj->Wrap(args.This());
 		if(args[0]->IsObject()) {
 			main_obj = args[0]->ToObject();
@@ -95,11 +255,19 @@ void Tuntap::New(const FunctionCallbackInfo<Value>& args) {
 		// Invoked as plain function `Tuntap(...)`, turn into construct call.
 		const int argc = 1;
 		Local<Value> argv[argc] = { args[0] };
-		Local<Function> cons = Local<Function>::New(isolate, constructor);
+		Persistent<Function> *constructor = static_cast<Persistent<Function>*>(args.Data().As<External>()->Value());
+		Local<Function> cons = Local<Function>::New(isolate, *constructor);
 		args.GetReturnValue().Set(NVM_NEW_INSTANCE(cons, isolate, argc, argv));
 	}
 }
 
+void Tuntap::constructor_cleanup(void *arg) {
+	Persistent<Function> *constructor = static_cast<Persistent<Function>*>(arg);
+	
+	constructor->Reset();
+	delete constructor;
+}
+
 bool Tuntap::construct(Handle<Object> main_obj, std::string &error) {
 	Isolate* isolate = main_obj->GetIsolate();
 	HandleScope scope(isolate);
@@ -109,14 +277,54 @@ bool Tuntap::construct(Handle<Object> main_obj, std::string &error) {
 	
 	this->objset(main_obj);
 	
-	if(!tuntapItfCreate(this->itf_opts, &this->fd, &error))
+	if(!this->itf_opts.backend) {
+		this->itf_opts.backend = &tuntapItfKernel;
+		error = "Unknown backend";
+		return(false);
+	}
+	
+	if(this->adopt_fd >= 0) {
+		this->fd = this->adopt_fd;
+		this->adopt_fd = -1;
+		if(!tuntapItfAttach(this->itf_opts, this->fd, &error))
+			return(false);
+	}
+	else if(!tuntapItfCreate(this->itf_opts, &this->fd, &error)) {
 		return(false);
+	}
+	
+	/* In lean mode, the read buffer is borrowed for each read round */
+	if(!this->lean)
+		this->read_buff = new unsigned char[this->itf_opts.mtu + this->l3_offset()];
+	
+	/* Several datagrams may be read for a single event */
+	fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) | O_NONBLOCK);
 	
-	this->read_buff = new unsigned char[this->itf_opts.mtu + 4];
+	this->is_reading = true;
+	this->is_writing = false;
 	
-	uv_poll_init(uv_default_loop(), &this->uv_handle_, this->fd);
-	this->uv_handle_.data = this;
-	uv_poll_start(&this->uv_handle_, UV_READABLE, uv_event_cb);
+	if(this->use_reactor) {
+		this->reactor_ = Reactor::get(this->isolate_, this->loop_);
+		this->reactor_entry_ = this->reactor_->add(this, this->fd, &error);
+		if(!this->reactor_entry_) {
+			this->reactor_ = NULL;
+			tuntapItfClose(this->itf_opts, this->fd);
+			this->fd = -1;
+			return(false);
+		}
+	}
+	else {
+		this->uv_handle_ = new uv_poll_t;
+		uv_poll_init(this->loop_, this->uv_handle_, this->fd);
+		this->uv_handle_->data = this;
+		uv_poll_start(this->uv_handle_, UV_READABLE, uv_event_cb);
+	}
+	
+	if(this->write_queued() > 0)
+		this->set_write(true);
+	
+	if(this->autotune_)
+		this->autotune_start();
 	
 	return(true);
 }
@@ -125,9 +333,6 @@ void Tuntap::writeBuffer(const FunctionCallbackInfo<Value>& args) {
 	Isolate* isolate = args.GetIsolate();
 	HandleScope scope(isolate);
 	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
-	Buffer *wbuff;
-	unsigned char *data;
-	size_t data_length;
 	Local<Value> in_buff;
 	
 	if(obj->fd == -1) {
@@ -135,7 +340,7 @@ void Tuntap::writeBuffer(const FunctionCallbackInfo<Value>& args) {
 		return;
 	}
 	
-	if(args.Length() != 1) {
+	if(args.Length() != 1 && args.Length() != 2) {
 		TT_THROW_TYPE("Wrong number of arguments");
 		return;
 	}
@@ -152,15 +357,79 @@ void Tuntap::writeBuffer(const FunctionCallbackInfo<Value>& args) {
 		return;
 	}
 	
-	in_buff = args[0];
+	obj->write_data(
+		reinterpret_cast<unsigned char*>(node::Buffer::Data(in_buff)),
+		node::Buffer::Length(in_buff),
+		args[1]->IsNumber() ? args[1]->Uint32Value() : 0
+	);
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+void Tuntap::writeBuffers(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Local<Array> buffers;
+	Local<Value> in_buff;
+	
+	if(obj->fd == -1) {
+		TT_THROW_TYPE("Object is closed and cannot be written!");
+		return;
+	}
+	
+	if(args.Length() != 1 || !args[0]->IsArray()) {
+		TT_THROW_TYPE("Wrong argument type");
+		return;
+	}
+	
+	buffers = args[0].As<Array>();
+	
+	for(unsigned int i = 0, limiti = buffers->Length(); i < limiti; i++) {
+		in_buff = buffers->Get(i);
+		
+		if(!node::Buffer::HasInstance(in_buff)) {
+			TT_THROW_TYPE("Wrong argument type");
+			return;
+		}
+		
+		obj->write_data(
+			reinterpret_cast<unsigned char*>(node::Buffer::Data(in_buff)),
+			node::Buffer::Length(in_buff)
+		);
+	}
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+void Tuntap::write_data(unsigned char *data, size_t data_length, uint32_t mark, int vlan) {
+	Buffer *wbuff;
+	Buffer *tagged;
+	int plain_length;
 	
-	data = reinterpret_cast<unsigned char*>(node::Buffer::Data(in_buff));
-	data_length = node::Buffer::Length(in_buff);
+	if(this->aead_) {
+		data = this->aead_->open(data, data_length, &plain_length);
+		if(!data) {
+			this->stats_.tx_dropped++;
+			return;
+		}
+		data_length = plain_length;
+	}
 	
-	if(obj->itf_opts.ethtype_comp == TUNTAP_ETCOMP_NONE) {
+	if(vlan >= 0 && this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_NONE) {
+		/* Tagged while copied */
+		wbuff = new Buffer(data_length + VLAN_TAG_LEN);
+		if(!this->vlan_->tag(data, data_length, vlan, wbuff->data)) {
+			delete wbuff;
+			this->stats_.tx_dropped++;
+			return;
+		}
+		vlan = -1;
+	}
+	else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_NONE) {
 		wbuff = new Buffer(data, data_length);
 	}
-	else if(obj->itf_opts.ethtype_comp == TUNTAP_ETCOMP_HALF) {
+	else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_HALF) {
 		wbuff = new Buffer(data_length + 2);
 		wbuff->data[0] = 0;
 		wbuff->data[1] = 0;
@@ -170,7 +439,7 @@ void Tuntap::writeBuffer(const FunctionCallbackInfo<Value>& args) {
 			data_length
 		);
 	}
-	else if(obj->itf_opts.ethtype_comp == TUNTAP_ETCOMP_FULL) {
+	else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_FULL) {
 		uint32_t type = htobe32(EtherTypes::getType(data[0]));
 		wbuff = new Buffer(data_length + 3);
 		memcpy(
@@ -188,11 +457,21 @@ void Tuntap::writeBuffer(const FunctionCallbackInfo<Value>& args) {
 		wbuff = new Buffer(data, data_length);
 	}
 	
-	obj->writ_buff.push_back(wbuff);
-	obj->set_write(true);
+	if(vlan >= 0) {
+		tagged = new Buffer(wbuff->size + VLAN_TAG_LEN);
+		if(!this->vlan_->tag(wbuff->data, wbuff->size, vlan, tagged->data)) {
+			delete tagged;
+			delete wbuff;
+			this->stats_.tx_dropped++;
+			return;
+		}
+		delete wbuff;
+		wbuff = tagged;
+	}
 	
-	args.GetReturnValue().Set(args.This());
+	this->queue_write(wbuff, mark);
 }
+
 void Tuntap::open(const FunctionCallbackInfo<Value>& args) {
 	Isolate* isolate = args.GetIsolate();
 	HandleScope scope(isolate);
@@ -235,15 +514,30 @@ void Tuntap::close(const FunctionCallbackInfo<Value>& args) {
 		return;
 	}
 	
-	uv_poll_stop(&obj->uv_handle_);
-	::close(obj->fd);
-	obj->fd = -1;
-	delete[] obj->read_buff;
-	obj->read_buff = NULL;
+	obj->coalesce_flush();
+	obj->release(true);
 	
 	args.GetReturnValue().Set(args.This());
 }
 
+void Tuntap::detach(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	int fd = obj->fd;
+	
+	if(fd == -1) {
+		TT_THROW_TYPE("The tunnel is closed!");
+		return;
+	}
+	
+	/* The descriptor stays open, for another object (possibly in another thread) */
+	obj->coalesce_flush();
+	obj->release(false);
+	
+	args.GetReturnValue().Set(Integer::New(isolate, fd));
+}
+
 void Tuntap::set(const FunctionCallbackInfo<Value>& args) {
 	Isolate* isolate = args.GetIsolate();
 	HandleScope scope(isolate);
@@ -262,8 +556,11 @@ void Tuntap::set(const FunctionCallbackInfo<Value>& args) {
 	
 	main_obj = args[0]->ToObject();
 	
-	if(main_obj->Has(String::NewFromUtf8(isolate, "type")) || main_obj->Has(String::NewFromUtf8(isolate, "name"))) {
-		TT_THROW_TYPE("Cannot set name and type from this function!");
+	if(
+		main_obj->Has(String::NewFromUtf8(isolate, "type")) || main_obj->Has(String::NewFromUtf8(isolate, "name")) ||
+		main_obj->Has(String::NewFromUtf8(isolate, "backend")) || main_obj->Has(String::NewFromUtf8(isolate, "loopback"))
+	) {
+		TT_THROW_TYPE("Cannot set name, type and backend from this function!");
 		return;
 	}
 	
@@ -303,6 +600,16 @@ void Tuntap::set(const FunctionCallbackInfo<Value>& args) {
 			if(obj->fd)
 				options.push_back(tuntap_itf_opts_t::OPT_RUNNING);
 		}
+		else if(strcmp(*key_str, "txqueuelen") == 0) {
+			if(obj->fd >= 0 && obj->itf_opts.txqueuelen > 0)
+				options.push_back(tuntap_itf_opts_t::OPT_TXQUEUELEN);
+		}
+		else if(strcmp(*key_str, "sndbuf") == 0) {
+			if(obj->fd >= 0 && obj->itf_opts.sndbuf > 0 && !tuntapItfSetSndbuf(obj->itf_opts, obj->fd, obj->itf_opts.sndbuf, &err_str)) {
+				TT_THROW_TYPE(err_str.c_str());
+				return;
+			}
+		}
 		else if(strcmp(*key_str, "ethtype_comp") == 0) {
 			String::Utf8Value val_str(val->ToString());
 			
@@ -315,7 +622,7 @@ void Tuntap::set(const FunctionCallbackInfo<Value>& args) {
 		}
 	}
 	
-	if(!tuntapItfSet(options, obj->itf_opts, &err_str)) {
+	if(!tuntapItfSet(options, obj->itf_opts, obj->fd, &err_str)) {
 		TT_THROW_TYPE(err_str.c_str());
 		return;
 	}
@@ -373,7 +680,7 @@ void Tuntap::unset(const FunctionCallbackInfo<Value>& args) {
 		}
 	}
 	
-	if(!tuntapItfSet(options, obj->itf_opts, &err_str)) {
+	if(!tuntapItfSet(options, obj->itf_opts, obj->fd, &err_str)) {
 		TT_THROW_TYPE(err_str.c_str());
 		return;
 	}
@@ -401,173 +708,2698 @@ void Tuntap::startRead(const FunctionCallbackInfo<Value>& args) {
 	args.GetReturnValue().Set(args.This());
 }
 
-void Tuntap::objset(Handle<Object> obj) {
-	Local<Array> keys_arr;
-	Local<Value> key;
-	Local<Value> val;
+void Tuntap::pull(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
 	
-	keys_arr = obj->GetPropertyNames();
-	for (unsigned int i = 0, limiti = keys_arr->Length(); i < limiti; i++) {
-		key = keys_arr->Get(i);
-		val = obj->Get(key);
-		String::Utf8Value key_str(key->ToString());
-		String::Utf8Value val_str(val->ToString());
-		
-		if(strcmp(*key_str, "type") == 0) {
-			if(strcmp(*val_str, "tun") == 0) {
-				this->itf_opts.mode = tuntap_itf_opts_t::MODE_TUN;
-			}
-			else if(strcmp(*val_str, "tap") == 0) {
-				this->itf_opts.mode = tuntap_itf_opts_t::MODE_TAP;
-			}
-		}
-		else if(strcmp(*key_str, "name") == 0) {
-			this->itf_opts.itf_name = *val_str;
-		}
-		else if(strcmp(*key_str, "addr") == 0) {
-			this->itf_opts.addr = *val_str;
-		}
-		else if(strcmp(*key_str, "mask") == 0) {
-			this->itf_opts.mask = *val_str;
-		}
-		else if(strcmp(*key_str, "dest") == 0) {
-			this->itf_opts.dest = *val_str;
-		}
-		else if(strcmp(*key_str, "mtu") == 0) {
-			this->itf_opts.mtu = val->ToInteger()->Value();
-			if(this->itf_opts.mtu <= 50)
-				this->itf_opts.mtu = 50;
-		}
-		else if(strcmp(*key_str, "persist") == 0) {
-			this->itf_opts.is_persistant = val->ToBoolean()->Value();
-		}
-		else if(strcmp(*key_str, "up") == 0) {
-			this->itf_opts.is_up = val->ToBoolean()->Value();
-		}
-		else if(strcmp(*key_str, "running") == 0) {
-			this->itf_opts.is_running = val->ToBoolean()->Value();
-		}
-		else if(strcmp(*key_str, "ethtype_comp") == 0) {
-			String::Utf8Value val_str(val->ToString());
-			
-			if(strcmp(*val_str, "none") == 0)
-				this->itf_opts.ethtype_comp = TUNTAP_ETCOMP_NONE;
-			else if(strcmp(*val_str, "half") == 0)
-				this->itf_opts.ethtype_comp = TUNTAP_ETCOMP_HALF;
-			else if(strcmp(*val_str, "full") == 0)
-				this->itf_opts.ethtype_comp = TUNTAP_ETCOMP_FULL;
-		}
-	}
+	obj->pull_mode = args[0]->BooleanValue();
+	obj->set_read(true);
+	
+	/* The room needed in the buffers given to readInto() */
+	args.GetReturnValue().Set(Integer::New(isolate, obj->read_into_room()));
 }
 
-void Tuntap::uv_event_cb(uv_poll_t* handle, int status, int events) {
-	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+/* Gets the memory of a Buffer or any other ArrayBufferView */
+static bool viewData(Local<Value> val, uint8_t **data, int *size) {
+	Local<ArrayBufferView> view;
 	
-	if(events & UV_READABLE) {
-		obj->do_read();
-	}
+	if(!val->IsArrayBufferView())
+		return(false);
 	
-	if(events & UV_WRITABLE) {
-		obj->do_write();
-	}
-}
-
-void Tuntap::set_read(bool r) {
-	if(r != this->is_reading) {
-		this->is_reading = r;
-		uv_poll_start(
-			&this->uv_handle_,
-			(this->is_reading ? UV_READABLE : 0) | (this->is_writing ? UV_WRITABLE : 0),
-			uv_event_cb
-		);
-	}
-}
-
-void Tuntap::set_write(bool w) {
-	if(w != this->is_writing) {
-		this->is_writing = w;
-		uv_poll_start(
-			&this->uv_handle_,
-			(this->is_reading ? UV_READABLE : 0) | (this->is_writing ? UV_WRITABLE : 0),
-			uv_event_cb
-		);
-	}
+	view = val.As<ArrayBufferView>();
+	*data = static_cast<uint8_t*>(view->Buffer()->GetContents().Data()) + view->ByteOffset();
+	*size = view->ByteLength();
+	return(true);
 }
 
-
-void Tuntap::do_read() {
-	Isolate* isolate = Isolate::GetCurrent();
+void Tuntap::readInto(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
 	HandleScope scope(isolate);
-	
-	Local<Object> ret_buff;
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	uint8_t *data;
+	int offset = 0;
+	int size;
 	int ret;
 	
-	ret = read(this->fd, this->read_buff, this->itf_opts.mtu + 4);
-	
-	if(ret <= 0) {
-		printf("PHAYL1\n");
+	if(obj->fd == -1) {
+		TT_THROW_TYPE("Object is closed and cannot be read!");
+		return;
 	}
 	
-#if defined(V8_MAJOR_VERSION) && (V8_MAJOR_VERSION > 4 || (V8_MAJOR_VERSION == 4 && defined(V8_MINOR_VERSION) && V8_MINOR_VERSION >= 3))
-	if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_HALF) {
-		ret_buff = node::Buffer::Copy(isolate, (char*) this->read_buff + 2, ret - 2).ToLocalChecked();
-	}
-	else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_FULL) {
-		uint8_t etval = EtherTypes::getId(be32toh(*(uint32_t*) this->read_buff));
-		this->read_buff[3] = etval;
-		ret_buff = node::Buffer::Copy(isolate, (char*) this->read_buff + 3, ret - 3).ToLocalChecked();
-	}
-	else { /* Also matches TUNTAP_ETCOMP_NONE */
-		ret_buff = node::Buffer::Copy(isolate, (char*) this->read_buff, ret).ToLocalChecked();
-	}
-#else
-	if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_HALF) {
-		ret_buff = node::Buffer::Copy(isolate, (char*) this->read_buff + 2, ret - 2);
-	}
-	else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_FULL) {
-		uint8_t etval = EtherTypes::getId(be32toh(*(uint32_t*) this->read_buff));
-		this->read_buff[3] = etval;
-		ret_buff = node::Buffer::Copy(isolate, (char*) this->read_buff + 3, ret - 3);
+	if(!viewData(args[0], &data, &size)) {
+		TT_THROW_TYPE("Wrong argument type");
+		return;
 	}
-	else { /* Also matches TUNTAP_ETCOMP_NONE */
-		ret_buff = node::Buffer::Copy(isolate, (char*) this->read_buff, ret);
+	
+	if(args[1]->IsNumber())
+		offset = args[1]->Int32Value();
+	
+	if(offset < 0 || offset > size || size - offset < obj->read_into_room()) {
+		isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate, "Not enough room in the buffer for the MTU")));
+		return;
 	}
-#endif
 	
-	const int argc = 1;
-	Local<Value> argv[argc] = {
-		ret_buff
-	};
+	obj->pull_mode = true;
 	
-	node::MakeCallback(
-		isolate,
-		this->handle(isolate),
-		"_on_read",
-		argc,
-		argv
-	);
+	ret = obj->read_into(data + offset, size - offset);
+	
+	/* Empty : notify the next datagrams */
+	if(ret == 0 && obj->fd >= 0)
+		obj->set_read(true);
+	
+	args.GetReturnValue().Set(Integer::New(isolate, ret));
 }
 
-void Tuntap::do_write() {
-	Buffer *cur;
-	int ret;
+/*
+ * Reads up to `maxPackets` datagrams back to back, each one after `headroom`
+ * free bytes, and returns their sizes.
+ */
+void Tuntap::readManyInto(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Local<Array> ret = Array::New(isolate);
+	uint8_t *data;
+	int max_packets = 0;
+	int headroom = 0;
+	int room;
+	int count = 0;
+	int used = 0;
+	int size;
+	int len;
 	
-	if(this->writ_buff.size() == 0) {
-		this->set_write(false);
+	if(obj->fd == -1) {
+		TT_THROW_TYPE("Object is closed and cannot be read!");
+		return;
+	}
+	
+	if(!viewData(args[0], &data, &size) || !args[1]->IsNumber()) {
+		TT_THROW_TYPE("Wrong argument type");
 		return;
 	}
 	
-	cur = this->writ_buff[0];
-	this->writ_buff.pop_front();
+	max_packets = args[1]->Int32Value();
+	if(args[2]->IsNumber())
+		headroom = args[2]->Int32Value();
 	
-	ret = write(this->fd, cur->data, cur->size);
-	if(ret != cur->size) {
-		printf("PHAYL2!\n");
+	if(headroom < 0) {
+		isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate, "Wrong headroom")));
+		return;
 	}
 	
-	delete cur;
+	obj->pull_mode = true;
+	room = obj->read_into_room();
 	
-	if(this->writ_buff.size() == 0) {
-		this->set_write(false);
+	while(count < max_packets && obj->fd >= 0 && size - used - headroom >= room) {
+		len = obj->read_into(data + used + headroom, size - used - headroom);
+		if(len <= 0)
+			break;
+		
+		ret->Set(count++, Integer::New(isolate, len));
+		used += headroom + len;
 	}
+	
+	if(count < max_packets && size - used - headroom >= room && obj->fd >= 0)
+		obj->set_read(true);
+	
+	args.GetReturnValue().Set(ret);
+}
+
+void Tuntap::stats(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Local<Object> ret = Object::New(isolate);
+	Local<Object> frag;
+	Local<Object> capture;
+	Local<Object> poll;
+	Local<Object> coalesce;
+	Local<Object> aead;
+	Local<Object> ring;
+	Local<Object> shaper;
+	Local<Object> classes;
+	Local<Object> fq;
+	Local<Object> gen;
+	Local<Object> reactor;
+	Local<Object> pool;
+	Local<Object> flows;
+	Local<Object> neigh;
+	Local<Object> vlans;
+	Local<Object> kernel;
+	Local<Object> tune;
+	Local<Object> offload;
+	tuntap_itf_stats_t ks;
+	
+#define SETSTAT(_obj_, _name_, _val_) \
+	_obj_->Set(String::NewFromUtf8(isolate, _name_), Number::New(isolate, (double) (_val_)));
+	
+	SETSTAT(ret, "rx_packets", obj->stats_.rx_packets)
+	SETSTAT(ret, "rx_bytes", obj->stats_.rx_bytes)
+	SETSTAT(ret, "rx_errors", obj->stats_.rx_errors)
+	SETSTAT(ret, "tx_packets", obj->stats_.tx_packets)
+	SETSTAT(ret, "tx_bytes", obj->stats_.tx_bytes)
+	SETSTAT(ret, "tx_errors", obj->stats_.tx_errors)
+	SETSTAT(ret, "tx_dropped", obj->stats_.tx_dropped)
+	SETSTAT(ret, "tx_queued", obj->write_queued())
+	SETSTAT(ret, "tx_eagain", obj->stats_.tx_eagain)
+	
+	/* The kernel backend reads sysfs, so only when the queues are tuned */
+	if(
+		(obj->itf_opts.sndbuf > 0 || obj->itf_opts.txqueuelen > 0 || obj->autotune_ || obj->itf_opts.backend != &tuntapItfKernel) &&
+		obj->fd >= 0 && tuntapItfStats(obj->itf_opts, obj->fd, &ks)
+	) {
+		kernel = Object::New(isolate);
+		SETSTAT(kernel, "sndbuf", tuntapItfGetSndbuf(obj->itf_opts, obj->fd))
+		SETSTAT(kernel, "txqueuelen", ks.txqueuelen)
+		SETSTAT(kernel, "rx_dropped", ks.rx_dropped)
+		SETSTAT(kernel, "rx_over_errors", ks.rx_over_errors)
+		SETSTAT(kernel, "tx_dropped", ks.tx_dropped)
+		SETSTAT(kernel, "tx_fifo_errors", ks.tx_fifo_errors)
+		if(obj->itf_opts.backend != &tuntapItfKernel)
+			SETSTAT(kernel, "lost", ks.lost)
+		ret->Set(String::NewFromUtf8(isolate, "kernel"), kernel);
+	}
+	
+	if(obj->autotune_) {
+		const Autotune::stats_t &as = obj->autotune_->getStats();
+		
+		tune = Object::New(isolate);
+		SETSTAT(tune, "samples", as.samples)
+		SETSTAT(tune, "adjustments", as.adjustments)
+		SETSTAT(tune, "errors", as.errors)
+		ret->Set(String::NewFromUtf8(isolate, "autotune"), tune);
+	}
+	
+	if(obj->offload.groEnabled() || obj->offload.gsoEnabled()) {
+		const Offload::stats_t &os = obj->offload.getStats();
+		
+		offload = Object::New(isolate);
+		SETSTAT(offload, "gro_segments", os.gro_segments)
+		SETSTAT(offload, "gro_merged", os.gro_merged)
+		SETSTAT(offload, "gro_out", os.gro_out)
+		SETSTAT(offload, "gso_datagrams", os.gso_datagrams)
+		SETSTAT(offload, "gso_segments", os.gso_segments)
+		ret->Set(String::NewFromUtf8(isolate, "offload"), offload);
+	}
+	
+	if(obj->ipfrag.enabled()) {
+		const IpFrag::stats_t &fs = obj->ipfrag.getStats();
+		
+		frag = Object::New(isolate);
+		SETSTAT(frag, "frag_datagrams", fs.frag_datagrams)
+		SETSTAT(frag, "frag_created", fs.frag_created)
+		SETSTAT(frag, "frag_too_big", fs.frag_too_big)
+		SETSTAT(frag, "ptb_sent", fs.ptb_sent)
+		SETSTAT(frag, "reasm_fragments", fs.reasm_fragments)
+		SETSTAT(frag, "reasm_datagrams", fs.reasm_datagrams)
+		SETSTAT(frag, "reasm_timeouts", fs.reasm_timeouts)
+		SETSTAT(frag, "reasm_evicted", fs.reasm_evicted)
+		SETSTAT(frag, "reasm_errors", fs.reasm_errors)
+		ret->Set(String::NewFromUtf8(isolate, "frag"), frag);
+	}
+	
+	if(obj->poll_.mode != busy_poll_t::POLL_EVENT) {
+		poll = Object::New(isolate);
+		SETSTAT(poll, "busy", obj->poll_.busy)
+		SETSTAT(poll, "rate", obj->poll_.rate)
+		SETSTAT(poll, "wakeups", obj->poll_.wakeups)
+		SETSTAT(poll, "busy_rounds", obj->poll_.busy_rounds)
+		SETSTAT(poll, "busy_packets", obj->poll_.busy_packets)
+		SETSTAT(poll, "switches", obj->poll_.switches)
+		ret->Set(String::NewFromUtf8(isolate, "poll"), poll);
+	}
+	
+	if(obj->coalesce_) {
+		coalesce = Object::New(isolate);
+		SETSTAT(coalesce, "chunks", obj->coalesce_->chunks)
+		SETSTAT(coalesce, "packets", obj->coalesce_->packets)
+		SETSTAT(coalesce, "pending", obj->coalesce_->used)
+		SETSTAT(coalesce, "compressed", obj->coalesce_->compressed)
+		SETSTAT(coalesce, "saved", obj->coalesce_->saved)
+		ret->Set(String::NewFromUtf8(isolate, "coalesce"), coalesce);
+	}
+	
+	if(obj->aead_) {
+		const Aead::stats_t &as = obj->aead_->getStats();
+		
+		aead = Object::New(isolate);
+		SETSTAT(aead, "sealed", as.sealed)
+		SETSTAT(aead, "opened", as.opened)
+		SETSTAT(aead, "no_peer", as.no_peer)
+		SETSTAT(aead, "auth_failed", as.auth_failed)
+		SETSTAT(aead, "replayed", as.replayed)
+		SETSTAT(aead, "malformed", as.malformed)
+		SETSTAT(aead, "exhausted", as.exhausted)
+		ret->Set(String::NewFromUtf8(isolate, "aead"), aead);
+	}
+	
+	if(obj->ring_) {
+		ring = Object::New(isolate);
+		SETSTAT(ring, "rx_packets", obj->ring_->rx_packets)
+		SETSTAT(ring, "rx_dropped", obj->ring_->rx->getDropped())
+		SETSTAT(ring, "tx_packets", obj->ring_->tx_packets)
+		SETSTAT(ring, "tx_errors", obj->ring_->tx_errors)
+		SETSTAT(ring, "stalls", obj->ring_->stalls)
+		ret->Set(String::NewFromUtf8(isolate, "ring"), ring);
+	}
+	
+	if(obj->reactor_) {
+		const Reactor::stats_t &rs = obj->reactor_->getStats();
+		
+		reactor = Object::New(isolate);
+		SETSTAT(reactor, "devices", obj->reactor_->getDevices())
+		SETSTAT(reactor, "wakeups", rs.wakeups)
+		SETSTAT(reactor, "events", rs.events)
+		SETSTAT(reactor, "rounds", rs.rounds)
+		SETSTAT(reactor, "dispatched", rs.dispatched)
+		ret->Set(String::NewFromUtf8(isolate, "reactor"), reactor);
+	}
+	
+	if(obj->lean) {
+		const BufPool::stats_t &ps = BufPool::local()->getStats();
+		
+		pool = Object::New(isolate);
+		SETSTAT(pool, "buffers", ps.buffers)
+		SETSTAT(pool, "bytes", ps.bytes)
+		SETSTAT(pool, "leases", ps.leases)
+		SETSTAT(pool, "allocs", ps.allocs)
+		ret->Set(String::NewFromUtf8(isolate, "read_pool"), pool);
+	}
+	
+	if(obj->fq_) {
+		const FqCodel::stats_t &fs = obj->fq_->getStats();
+		
+		fq = Object::New(isolate);
+		SETSTAT(fq, "backlog", obj->fq_->getBacklog())
+		SETSTAT(fq, "flows", obj->fq_->getActive())
+		SETSTAT(fq, "new_flows", fs.new_flows)
+		SETSTAT(fq, "dropped", fs.dropped)
+		SETSTAT(fq, "marked", fs.marked)
+		SETSTAT(fq, "overlimit", fs.overlimit)
+		ret->Set(String::NewFromUtf8(isolate, "fq_codel"), fq);
+	}
+	
+	if(obj->generator_) {
+		Generator::stats_t gs = obj->generator_->getStats();
+		uint64_t end = gs.ended ? gs.ended : uv_hrtime();
+		double elapsed = (end - gs.started) / 1e9;
+		
+		gen = Object::New(isolate);
+		gen->Set(String::NewFromUtf8(isolate, "running"), Boolean::New(isolate, obj->generator_->isRunning()));
+		SETSTAT(gen, "sent", gs.sent)
+		SETSTAT(gen, "bytes", gs.bytes)
+		SETSTAT(gen, "errors", gs.errors)
+		SETSTAT(gen, "eagain", gs.eagain)
+		SETSTAT(gen, "skipped", gs.skipped)
+		SETSTAT(gen, "elapsed", elapsed * 1000)
+		SETSTAT(gen, "rate", obj->generator_->getRate())
+		SETSTAT(gen, "pps", elapsed > 0 ? gs.sent / elapsed : 0)
+		SETSTAT(gen, "bps", elapsed > 0 ? gs.bytes * 8 / elapsed : 0)
+		ret->Set(String::NewFromUtf8(isolate, "generator"), gen);
+	}
+	
+	if(obj->flows_) {
+		const FlowMeter::stats_t &ms = obj->flows_->getStats();
+		
+		flows = Object::New(isolate);
+		SETSTAT(flows, "active", obj->flows_->getActive())
+		SETSTAT(flows, "packets", ms.packets)
+		SETSTAT(flows, "sampled_out", ms.sampled_out)
+		SETSTAT(flows, "unparsed", ms.unparsed)
+		SETSTAT(flows, "created", ms.created)
+		SETSTAT(flows, "exported", ms.exported)
+		SETSTAT(flows, "evicted", ms.evicted)
+		SETSTAT(flows, "ipfix_messages", ms.ipfix_messages)
+		SETSTAT(flows, "ipfix_errors", ms.ipfix_errors)
+		ret->Set(String::NewFromUtf8(isolate, "flows"), flows);
+	}
+	
+	if(obj->neighbor_) {
+		const Neighbor::stats_t &ns = obj->neighbor_->getStats();
+		
+		neigh = Object::New(isolate);
+		SETSTAT(neigh, "owned", obj->neighbor_->getOwned())
+		SETSTAT(neigh, "proxied", obj->neighbor_->getProxied())
+		SETSTAT(neigh, "arp_requests", ns.arp_requests)
+		SETSTAT(neigh, "arp_replies", ns.arp_replies)
+		SETSTAT(neigh, "ns_requests", ns.ns_requests)
+		SETSTAT(neigh, "na_replies", ns.na_replies)
+		SETSTAT(neigh, "proxy_replies", ns.proxy_replies)
+		SETSTAT(neigh, "errors", ns.errors)
+		ret->Set(String::NewFromUtf8(isolate, "neighbors"), neigh);
+	}
+	
+	if(obj->vlan_) {
+		const Vlan::stats_t &vs = obj->vlan_->getStats();
+		const std::vector<int> &ids = obj->vlan_->getIds();
+		
+		vlans = Object::New(isolate);
+		SETSTAT(vlans, "rx_tagged", vs.rx_tagged)
+		SETSTAT(vlans, "rx_passed", vs.rx_passed)
+		SETSTAT(vlans, "rx_dropped", vs.rx_dropped)
+		SETSTAT(vlans, "tx_tagged", vs.tx_tagged)
+		SETSTAT(vlans, "tx_errors", vs.tx_errors)
+		
+		for(size_t i = 0 ; i < ids.size() ; i++) {
+			const Vlan::counters_t &vc = obj->vlan_->getCounters(ids[i]);
+			Local<Object> vlan = Object::New(isolate);
+			
+			SETSTAT(vlan, "rx_packets", vc.rx_packets)
+			SETSTAT(vlan, "tx_packets", vc.tx_packets)
+			vlans->Set(Integer::New(isolate, ids[i]), vlan);
+		}
+		
+		ret->Set(String::NewFromUtf8(isolate, "vlans"), vlans);
+	}
+	
+	if(obj->shaper_) {
+		const std::vector<Shaper::class_t*> &cls = obj->shaper_->getClasses();
+		char id[16];
+		
+		shaper = Object::New(isolate);
+		classes = Object::New(isolate);
+		SETSTAT(shaper, "backlog", obj->shaper_->getBacklog())
+		
+		for(size_t i = 0 ; i < cls.size() ; i++) {
+			Local<Object> c = Object::New(isolate);
+			
+			SETSTAT(c, "packets", cls[i]->packets)
+			SETSTAT(c, "bytes", cls[i]->bytes)
+			SETSTAT(c, "dropped", cls[i]->dropped)
+			SETSTAT(c, "borrowed", cls[i]->borrowed)
+			SETSTAT(c, "backlog", cls[i]->queue.size())
+			SETSTAT(c, "tokens", cls[i]->tokens)
+			SETSTAT(c, "ctokens", cls[i]->ctokens)
+			
+			snprintf(id, sizeof(id), "%u", cls[i]->id);
+			classes->Set(String::NewFromUtf8(isolate, id), c);
+		}
+		
+		shaper->Set(String::NewFromUtf8(isolate, "classes"), classes);
+		ret->Set(String::NewFromUtf8(isolate, "shaper"), shaper);
+	}
+	
+	if(obj->capture_) {
+		capture = Object::New(isolate);
+		SETSTAT(capture, "packets", obj->capture_->getPackets())
+		SETSTAT(capture, "dropped", obj->capture_->getDropped())
+		SETSTAT(capture, "written", obj->capture_->getWritten())
+		ret->Set(String::NewFromUtf8(isolate, "capture"), capture);
+	}
+	
+#undef SETSTAT
+	
+	args.GetReturnValue().Set(ret);
+}
+
+void Tuntap::latency(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Local<Object> ret = Object::New(isolate);
+	Local<Object> hist;
+	
+	if(!obj->latency_) {
+		args.GetReturnValue().Set(Undefined(isolate));
+		return;
+	}
+	
+#define SETHIST(_name_, _hist_) \
+	hist = Object::New(isolate); \
+	hist->Set(String::NewFromUtf8(isolate, "count"), Number::New(isolate, (double) _hist_.count())); \
+	hist->Set(String::NewFromUtf8(isolate, "min"), Number::New(isolate, (double) _hist_.min())); \
+	hist->Set(String::NewFromUtf8(isolate, "max"), Number::New(isolate, (double) _hist_.max())); \
+	hist->Set(String::NewFromUtf8(isolate, "mean"), Number::New(isolate, _hist_.mean())); \
+	hist->Set(String::NewFromUtf8(isolate, "p50"), Number::New(isolate, (double) _hist_.percentile(50))); \
+	hist->Set(String::NewFromUtf8(isolate, "p90"), Number::New(isolate, (double) _hist_.percentile(90))); \
+	hist->Set(String::NewFromUtf8(isolate, "p99"), Number::New(isolate, (double) _hist_.percentile(99))); \
+	hist->Set(String::NewFromUtf8(isolate, "p999"), Number::New(isolate, (double) _hist_.percentile(99.9))); \
+	ret->Set(String::NewFromUtf8(isolate, _name_), hist); \
+	if(args[0]->BooleanValue()) \
+		_hist_.reset();
+	
+	SETHIST("rx_dispatch", obj->latency_->rx_dispatch)
+	SETHIST("tx_queue", obj->latency_->tx_queue)
+	
+#undef SETHIST
+	
+	args.GetReturnValue().Set(ret);
+}
+
+void Tuntap::aeadPeer(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	std::string err_str;
+	std::string cipher_str = "chacha20-poly1305";
+	std::string addr_str;
+	Aead::cipher_e cipher;
+	Local<Object> main_obj;
+	Local<Value> tx_key;
+	Local<Value> rx_key;
+	uint8_t addr[16];
+	int addr_len = 0;
+	bool dft = false;
+	uint32_t id;
+	
+	if(!obj->aead_) {
+		TT_THROW_TYPE("The aead option is not enabled");
+		return;
+	}
+	
+	if(!args[0]->IsNumber()) {
+		TT_THROW_TYPE("Wrong argument type");
+		return;
+	}
+	
+	id = args[0]->Uint32Value();
+	
+	if(!args[1]->IsObject()) {
+		obj->aead_->removePeer(id);
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	main_obj = args[1]->ToObject();
+	
+	TT_GETOPT_STR(main_obj, "cipher", cipher_str)
+	TT_GETOPT_STR(main_obj, "addr", addr_str)
+	TT_GETOPT(main_obj, "default", dft, ToBoolean)
+	tx_key = main_obj->Get(String::NewFromUtf8(isolate, "tx_key"));
+	rx_key = main_obj->Get(String::NewFromUtf8(isolate, "rx_key"));
+	
+	if(!Aead::parseCipher(cipher_str, &cipher)) {
+		TT_THROW_TYPE("Unknown cipher");
+		return;
+	}
+	
+	if(
+		!node::Buffer::HasInstance(tx_key) ||
+		!node::Buffer::HasInstance(rx_key) ||
+		node::Buffer::Length(tx_key) != node::Buffer::Length(rx_key)
+	) {
+		TT_THROW_TYPE("tx_key and rx_key must be buffers of the same length");
+		return;
+	}
+	
+	if(addr_str.size() > 0) {
+		if(uv_inet_pton(AF_INET, addr_str.c_str(), addr) == 0)
+			addr_len = 4;
+		else if(uv_inet_pton(AF_INET6, addr_str.c_str(), addr) == 0)
+			addr_len = 16;
+		else {
+			TT_THROW_TYPE("Invalid peer address");
+			return;
+		}
+	}
+	
+	if(!obj->aead_->setPeer(
+		id,
+		cipher,
+		reinterpret_cast<uint8_t*>(node::Buffer::Data(tx_key)),
+		reinterpret_cast<uint8_t*>(node::Buffer::Data(rx_key)),
+		node::Buffer::Length(tx_key),
+		addr,
+		addr_len,
+		dft,
+		&err_str
+	)) {
+		TT_THROW_TYPE(err_str.c_str());
+		return;
+	}
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+/*
+ * compress(buffer, frame, min_size) : writes a compressed frame of buffer
+ * into frame, and returns its size, or 0 if the buffer should be sent as is.
+ */
+void Tuntap::compress(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	int min_size = LZ4_DFT_MIN_SIZE;
+	size_t size;
+	int ret = 0;
+	
+	if(!node::Buffer::HasInstance(args[0]) || !node::Buffer::HasInstance(args[1])) {
+		TT_THROW_TYPE("Wrong argument type");
+		return;
+	}
+	
+	if(args[2]->IsNumber())
+		min_size = args[2]->Int32Value();
+	
+	size = node::Buffer::Length(args[0]);
+	if(node::Buffer::Length(args[1]) >= size + LZ4_FRAME_HDR) {
+		ret = lz4Frame(
+			reinterpret_cast<uint8_t*>(node::Buffer::Data(args[0])),
+			size,
+			reinterpret_cast<uint8_t*>(node::Buffer::Data(args[1])),
+			min_size
+		);
+	}
+	
+	args.GetReturnValue().Set(Integer::New(isolate, ret));
+}
+
+/*
+ * decompress(frame, start, end, buffer) : decompresses the LZ4 block found
+ * between start and end into buffer. Returns its size, or -1 if invalid.
+ */
+void Tuntap::decompress(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	uint32_t start;
+	uint32_t end;
+	int ret;
+	
+	if(!node::Buffer::HasInstance(args[0]) || !node::Buffer::HasInstance(args[3])) {
+		TT_THROW_TYPE("Wrong argument type");
+		return;
+	}
+	
+	start = args[1]->Uint32Value();
+	end = args[2]->Uint32Value();
+	if(start > end || end > node::Buffer::Length(args[0])) {
+		TT_THROW_TYPE("Invalid range");
+		return;
+	}
+	
+	ret = lz4Decompress(
+		reinterpret_cast<uint8_t*>(node::Buffer::Data(args[0])) + start,
+		end - start,
+		reinterpret_cast<uint8_t*>(node::Buffer::Data(args[3])),
+		node::Buffer::Length(args[3])
+	);
+	
+	args.GetReturnValue().Set(Integer::New(isolate, ret));
+}
+
+/*
+ * ring(options | false) : switches the reads to a pair of SharedArrayBuffer
+ * rings, and returns them as { rx, tx }.
+ */
+void Tuntap::ring(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Local<SharedArrayBuffer> rx_sab;
+	Local<SharedArrayBuffer> tx_sab;
+	Local<Object> main_obj;
+	Local<Object> ret;
+	int slots = RING_DFT_SLOTS;
+	int slot_size = RING_DFT_SLOT_SIZE;
+	int interval = 1;
+	int pow2 = 1;
+	
+	obj->ring_stop();
+	
+	if(!args[0]->IsObject() && !args[0]->BooleanValue()) {
+		args.GetReturnValue().Set(Null(isolate));
+		return;
+	}
+	
+	if(args[0]->IsObject()) {
+		main_obj = args[0]->ToObject();
+		TT_GETOPT(main_obj, "slots", slots, ToInteger)
+		TT_GETOPT(main_obj, "slot_size", slot_size, ToInteger)
+		TT_GETOPT(main_obj, "interval", interval, ToInteger)
+	}
+	
+	if(slots < 1 || slots > RING_MAX_SLOTS || slot_size < 64 || slot_size > 0x10000) {
+		TT_THROW_TYPE("Invalid ring size");
+		return;
+	}
+	if(interval < 1)
+		interval = 1;
+	
+	while(pow2 < slots)
+		pow2 <<= 1;
+	slot_size = (slot_size + 63) & ~63;
+	
+	rx_sab = SharedArrayBuffer::New(isolate, Ring::bytes(pow2, slot_size));
+	tx_sab = SharedArrayBuffer::New(isolate, Ring::bytes(pow2, slot_size));
+	
+	obj->ring_ = new ring_t();
+	obj->ring_->rx = new Ring((uint8_t*) rx_sab->GetContents().Data(), pow2, slot_size);
+	obj->ring_->tx = new Ring((uint8_t*) tx_sab->GetContents().Data(), pow2, slot_size);
+	
+	/* Keeps the memory alive while the rings are in use */
+	obj->ring_->rx_sab.Reset(isolate, rx_sab);
+	obj->ring_->tx_sab.Reset(isolate, tx_sab);
+	
+	/* Resumes stalled reads and drains the write ring filled by workers */
+	obj->ring_->timer = new uv_timer_t;
+	uv_timer_init(obj->loop_, obj->ring_->timer);
+	obj->ring_->timer->data = obj;
+	uv_timer_start(obj->ring_->timer, ring_timer_cb, interval, interval);
+	uv_unref((uv_handle_t*) obj->ring_->timer);
+	
+	obj->set_read(true);
+	
+	ret = Object::New(isolate);
+	ret->Set(String::NewFromUtf8(isolate, "rx"), rx_sab);
+	ret->Set(String::NewFromUtf8(isolate, "tx"), tx_sab);
+	
+	args.GetReturnValue().Set(ret);
+}
+
+void Tuntap::ringWrite(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	int ret = 0;
+	
+	if(obj->ring_)
+		ret = obj->ring_drain();
+	
+	args.GetReturnValue().Set(Integer::New(isolate, ret));
+}
+
+void Tuntap::ring_timer_cb(uv_timer_t* handle) {
+	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+	
+	obj->ring_drain();
+}
+
+/*
+ * Writes the datagrams of the write ring, and resumes the reads if they were
+ * stalled by a full read ring. Returns the number of datagrams written.
+ */
+int Tuntap::ring_drain() {
+	ring_t *r = this->ring_;
+	uint8_t *data;
+	uint32_t flags;
+	int count = 0;
+	int size;
+	
+	/* Bounded, since a worker may keep producing meanwhile */
+	while(count < r->tx->getSlots() && this->fd >= 0 && (data = r->tx->peek(&size, &flags))) {
+		if(size <= 0)
+			r->tx_errors++;
+		else if(flags & RING_FLAG_RAW)
+			this->queue_write(new Buffer(data, size));
+		else
+			this->write_data(data, size);
+		
+		r->tx->release();
+		count++;
+	}
+	r->tx_packets += count;
+	
+	if(r->stalled && !r->rx->full()) {
+		r->stalled = false;
+		this->set_read(true);
+	}
+	
+	return(count);
+}
+
+void Tuntap::ring_stop() {
+	if(!this->ring_)
+		return;
+	
+	if(this->ring_->stalled)
+		this->set_read(true);
+	
+	uv_close((uv_handle_t*) this->ring_->timer, uv_free_cb<uv_timer_t>);
+	this->ring_->rx_sab.Reset();
+	this->ring_->tx_sab.Reset();
+	delete this->ring_->rx;
+	delete this->ring_->tx;
+	delete this->ring_;
+	this->ring_ = NULL;
+}
+
+static bool shaperPrefixParse(const std::string &str, uint8_t *addr, int *len, int *family) {
+	std::string ip = str;
+	size_t pos = str.find('/');
+	int max;
+	
+	if(pos != std::string::npos)
+		ip = str.substr(0, pos);
+	
+	memset(addr, 0, 16);
+	if(!(*family = inetParseAddr(ip, addr)))
+		return(false);
+	
+	max = *family == 4 ? 32 : 128;
+	*len = pos != std::string::npos ? atoi(str.c_str() + pos + 1) : max;
+	
+	return(*len >= 0 && *len <= max);
+}
+
+static int shaperProto(Local<Value> val) {
+	String::Utf8Value str(val->ToString());
+	
+	if(val->IsNumber())
+		return(val->Int32Value());
+	if(strcmp(*str, "tcp") == 0)
+		return(INET_PROTO_TCP);
+	if(strcmp(*str, "udp") == 0)
+		return(INET_PROTO_UDP);
+	if(strcmp(*str, "icmp") == 0)
+		return(INET_PROTO_ICMP);
+	if(strcmp(*str, "icmpv6") == 0)
+		return(INET_PROTO_ICMPV6);
+	
+	return(-1);
+}
+
+/*
+ * shaper({ classes, rules, default } | false) : replaces the shaper of the
+ * write path. The rates are given in bits per second.
+ */
+void Tuntap::shaper(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Shaper *shaper;
+	Shaper::rule_t rule;
+	std::string err_str;
+	std::string addr_str;
+	Local<Object> main_obj;
+	Local<Object> item;
+	Local<Value> val;
+	Local<Array> arr;
+	unsigned int i;
+	
+	obj->shaper_stop();
+	
+	if(!args[0]->IsObject()) {
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	main_obj = args[0]->ToObject();
+	shaper = new Shaper();
+	
+	val = main_obj->Get(String::NewFromUtf8(isolate, "classes"));
+	if(val->IsArray()) {
+		arr = val.As<Array>();
+		for(i = 0 ; i < arr->Length() ; i++) {
+			uint32_t id = 0;
+			uint32_t parent = 0;
+			double rate = 0;
+			double ceil = 0;
+			int burst = 0;
+			int cburst = 0;
+			int limit = 0;
+			
+			if(!arr->Get(i)->IsObject())
+				continue;
+			item = arr->Get(i)->ToObject();
+			TT_GETOPT(item, "id", id, ToInteger)
+			TT_GETOPT(item, "parent", parent, ToInteger)
+			TT_GETOPT(item, "rate", rate, ToInteger)
+			TT_GETOPT(item, "ceil", ceil, ToInteger)
+			TT_GETOPT(item, "burst", burst, ToInteger)
+			TT_GETOPT(item, "cburst", cburst, ToInteger)
+			TT_GETOPT(item, "limit", limit, ToInteger)
+			
+			if(!shaper->addClass(id, parent, rate / 8, ceil / 8, burst, cburst, limit, &err_str)) {
+				delete shaper;
+				TT_THROW_TYPE(err_str.c_str());
+				return;
+			}
+		}
+	}
+	
+	val = main_obj->Get(String::NewFromUtf8(isolate, "rules"));
+	if(val->IsArray()) {
+		arr = val.As<Array>();
+		for(i = 0 ; i < arr->Length() ; i++) {
+			uint32_t id = 0;
+			
+			if(!arr->Get(i)->IsObject())
+				continue;
+			item = arr->Get(i)->ToObject();
+			rule = Shaper::rule_t();
+			TT_GETOPT(item, "class", id, ToInteger)
+			TT_GETOPT(item, "mark", rule.mark, ToInteger)
+			TT_GETOPT(item, "dscp", rule.dscp, ToInteger)
+			TT_GETOPT(item, "sport", rule.sport, ToInteger)
+			TT_GETOPT(item, "dport", rule.dport, ToInteger)
+			
+			val = item->Get(String::NewFromUtf8(isolate, "proto"));
+			if(!val->IsUndefined() && (rule.proto = shaperProto(val)) < 0)
+				err_str = "Unknown protocol";
+			
+			addr_str.clear();
+			TT_GETOPT_STR(item, "src", addr_str)
+			if(addr_str.size() > 0 && !shaperPrefixParse(addr_str, rule.src, &rule.src_len, &rule.family))
+				err_str = "Invalid source prefix";
+			
+			addr_str.clear();
+			TT_GETOPT_STR(item, "dst", addr_str)
+			if(addr_str.size() > 0 && !shaperPrefixParse(addr_str, rule.dst, &rule.dst_len, &rule.family))
+				err_str = "Invalid destination prefix";
+			
+			if(err_str.size() > 0 || !shaper->addRule(id, rule, &err_str)) {
+				delete shaper;
+				TT_THROW_TYPE(err_str.c_str());
+				return;
+			}
+		}
+	}
+	
+	val = main_obj->Get(String::NewFromUtf8(isolate, "default"));
+	if(!val->IsUndefined() && !shaper->setDefault(val->Uint32Value(), &err_str)) {
+		delete shaper;
+		TT_THROW_TYPE(err_str.c_str());
+		return;
+	}
+	
+	obj->shaper_ = shaper;
+	obj->shaper_timer_ = new uv_timer_t;
+	uv_timer_init(obj->loop_, obj->shaper_timer_);
+	obj->shaper_timer_->data = obj;
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+void Tuntap::capture(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Capture::opts_t opts;
+	std::string err_str;
+	Local<Object> main_obj;
+	
+	if(!args[0]->IsObject()) {
+		if(args[0]->BooleanValue()) {
+			TT_THROW_TYPE("Invalid argument type");
+			return;
+		}
+		
+		if(obj->capture_) {
+			delete obj->capture_;
+			obj->capture_ = NULL;
+		}
+		
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	main_obj = args[0]->ToObject();
+	
+	TT_GETOPT_STR(main_obj, "path", opts.path)
+	TT_GETOPT(main_obj, "snaplen", opts.snaplen, ToInteger)
+	TT_GETOPT(main_obj, "sample", opts.sample, ToInteger)
+	TT_GETOPT(main_obj, "ring_size", opts.ring_size, ToInteger)
+	TT_GETOPT(main_obj, "direct", opts.direct, ToBoolean)
+	TT_GETOPT(main_obj, "rx", opts.rx, ToBoolean)
+	TT_GETOPT(main_obj, "tx", opts.tx, ToBoolean)
+	
+	if(opts.path.size() == 0) {
+		TT_THROW_TYPE("A capture path is needed");
+		return;
+	}
+	
+	opts.itf_name = obj->itf_opts.itf_name;
+	if(obj->itf_opts.mode == tuntap_itf_opts_t::MODE_TAP)
+		opts.linktype = CAPTURE_LINKTYPE_ETHERNET;
+	else
+		opts.linktype = CAPTURE_LINKTYPE_RAW;
+	
+	if(!obj->capture_)
+		obj->capture_ = new Capture();
+	
+	if(!obj->capture_->start(opts, &err_str)) {
+		delete obj->capture_;
+		obj->capture_ = NULL;
+		TT_THROW(err_str.c_str());
+		return;
+	}
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+void Tuntap::objset(Handle<Object> obj) {
+	Local<Array> keys_arr;
+	Local<Value> key;
+	Local<Value> val;
+	
+	keys_arr = obj->GetPropertyNames();
+	for (unsigned int i = 0, limiti = keys_arr->Length(); i < limiti; i++) {
+		key = keys_arr->Get(i);
+		val = obj->Get(key);
+		String::Utf8Value key_str(key->ToString());
+		String::Utf8Value val_str(val->ToString());
+		
+		if(strcmp(*key_str, "type") == 0) {
+			if(strcmp(*val_str, "tun") == 0) {
+				this->itf_opts.mode = tuntap_itf_opts_t::MODE_TUN;
+			}
+			else if(strcmp(*val_str, "tap") == 0) {
+				this->itf_opts.mode = tuntap_itf_opts_t::MODE_TAP;
+			}
+		}
+		else if(strcmp(*key_str, "name") == 0) {
+			this->itf_opts.itf_name = *val_str;
+		}
+		else if(strcmp(*key_str, "backend") == 0) {
+			this->itf_opts.backend = tuntapItfBackend(*val_str);
+		}
+		else if(strcmp(*key_str, "loopback") == 0) {
+			this->loopbackset(val);
+		}
+		else if(strcmp(*key_str, "addr") == 0) {
+			this->itf_opts.addr = *val_str;
+		}
+		else if(strcmp(*key_str, "mask") == 0) {
+			this->itf_opts.mask = *val_str;
+		}
+		else if(strcmp(*key_str, "dest") == 0) {
+			this->itf_opts.dest = *val_str;
+		}
+		else if(strcmp(*key_str, "mtu") == 0) {
+			this->itf_opts.mtu = val->ToInteger()->Value();
+			if(this->itf_opts.mtu <= 50)
+				this->itf_opts.mtu = 50;
+		}
+		else if(strcmp(*key_str, "persist") == 0) {
+			this->itf_opts.is_persistant = val->ToBoolean()->Value();
+		}
+		else if(strcmp(*key_str, "up") == 0) {
+			this->itf_opts.is_up = val->ToBoolean()->Value();
+		}
+		else if(strcmp(*key_str, "running") == 0) {
+			this->itf_opts.is_running = val->ToBoolean()->Value();
+		}
+		else if(strcmp(*key_str, "ethtype_comp") == 0) {
+			String::Utf8Value val_str(val->ToString());
+			
+			if(strcmp(*val_str, "none") == 0)
+				this->itf_opts.ethtype_comp = TUNTAP_ETCOMP_NONE;
+			else if(strcmp(*val_str, "half") == 0)
+				this->itf_opts.ethtype_comp = TUNTAP_ETCOMP_HALF;
+			else if(strcmp(*val_str, "full") == 0)
+				this->itf_opts.ethtype_comp = TUNTAP_ETCOMP_FULL;
+		}
+		else if(strcmp(*key_str, "frag") == 0) {
+			this->fragset(val);
+		}
+		else if(strcmp(*key_str, "gro") == 0) {
+			this->groset(val);
+		}
+		else if(strcmp(*key_str, "gso") == 0) {
+			this->offload.configureGso(val->BooleanValue());
+		}
+		else if(strcmp(*key_str, "busy_poll") == 0) {
+			this->pollset(val);
+		}
+		else if(strcmp(*key_str, "fd") == 0) {
+			this->adopt_fd = val->ToInteger()->Value();
+		}
+		else if(strcmp(*key_str, "multi_queue") == 0) {
+			this->itf_opts.is_multi_queue = val->ToBoolean()->Value();
+		}
+		else if(strcmp(*key_str, "napi") == 0) {
+			this->itf_opts.is_napi = val->ToBoolean()->Value();
+		}
+		else if(strcmp(*key_str, "napi_frags") == 0) {
+			this->itf_opts.is_napi_frags = val->ToBoolean()->Value();
+		}
+		else if(strcmp(*key_str, "reactor") == 0) {
+			this->use_reactor = val->BooleanValue();
+		}
+		else if(strcmp(*key_str, "lean") == 0) {
+			this->lean = val->BooleanValue();
+			if(this->lean && this->read_buff) {
+				delete[] this->read_buff;
+				this->read_buff = NULL;
+			}
+		}
+		else if(strcmp(*key_str, "fq_codel") == 0) {
+			this->fqset(val);
+		}
+		else if(strcmp(*key_str, "sndbuf") == 0) {
+			this->itf_opts.sndbuf = val->ToInteger()->Value();
+		}
+		else if(strcmp(*key_str, "txqueuelen") == 0) {
+			this->itf_opts.txqueuelen = val->ToInteger()->Value();
+		}
+		else if(strcmp(*key_str, "autotune") == 0) {
+			this->autotuneset(val);
+		}
+		else if(strcmp(*key_str, "coalesce") == 0) {
+			this->coalesceset(val);
+		}
+		else if(strcmp(*key_str, "aead") == 0) {
+			if(val->BooleanValue() && !this->aead_) {
+				this->aead_ = new Aead();
+			}
+			else if(!val->BooleanValue() && this->aead_) {
+				delete this->aead_;
+				this->aead_ = NULL;
+			}
+		}
+		else if(strcmp(*key_str, "read_batch") == 0) {
+			this->read_batch = val->ToInteger()->Value();
+			if(this->read_batch < 1)
+				this->read_batch = 1;
+			else if(this->read_batch > TUNTAP_MAX_READ_BATCH)
+				this->read_batch = TUNTAP_MAX_READ_BATCH;
+		}
+		else if(strcmp(*key_str, "timestamps") == 0) {
+			this->timestamps = val->ToBoolean()->Value();
+			if(this->timestamps && !this->latency_)
+				this->latency_ = new latency_t();
+		}
+	}
+}
+
+void Tuntap::fragset(Handle<Value> val) {
+	Isolate* isolate = Isolate::GetCurrent();
+	Local<Object> obj;
+	int mtu = 0;
+	int datagrams = 0;
+	int timeout = 0;
+	int max_size = 0;
+	bool icmp = false;
+	
+	if(!val->IsObject()) {
+		if(val->BooleanValue())
+			this->ipfrag.configure(0, 0, 0, 0, false);
+		else
+			this->ipfrag.clear();
+		return;
+	}
+	
+	obj = val->ToObject();
+	
+	TT_GETOPT(obj, "mtu", mtu, ToInteger)
+	TT_GETOPT(obj, "datagrams", datagrams, ToInteger)
+	TT_GETOPT(obj, "timeout", timeout, ToInteger)
+	TT_GETOPT(obj, "max_size", max_size, ToInteger)
+	TT_GETOPT(obj, "icmp", icmp, ToBoolean)
+	
+	this->ipfrag.configure(mtu, datagrams, timeout, max_size, icmp);
+}
+
+void Tuntap::loopbackset(Handle<Value> val) {
+	Isolate* isolate = Isolate::GetCurrent();
+	std::string wire;
+	double latency = 0;
+	double jitter = 0;
+	double loss = 0;
+	Local<Object> obj;
+	
+	if(!val->IsObject()) {
+		this->itf_opts.backend = val->BooleanValue() ? &tuntapItfLoopback : &tuntapItfKernel;
+		if(val->IsString())
+			this->itf_opts.loopback.wire = *String::Utf8Value(val->ToString());
+		return;
+	}
+	
+	this->itf_opts.backend = &tuntapItfLoopback;
+	
+	obj = val->ToObject();
+	
+	TT_GETOPT_STR(obj, "wire", wire)
+	TT_GETOPT(obj, "seed", this->itf_opts.loopback.seed, ToInteger)
+	
+	val = obj->Get(String::NewFromUtf8(isolate, "latency"));
+	if(val->IsNumber())
+		latency = val->NumberValue();
+	
+	val = obj->Get(String::NewFromUtf8(isolate, "jitter"));
+	if(val->IsNumber())
+		jitter = val->NumberValue();
+	
+	val = obj->Get(String::NewFromUtf8(isolate, "loss"));
+	if(val->IsNumber())
+		loss = val->NumberValue();
+	
+	/* Given in milliseconds */
+	this->itf_opts.loopback.wire = wire;
+	this->itf_opts.loopback.latency = latency > 0 ? (uint64_t) (latency * 1000000) : 0;
+	this->itf_opts.loopback.jitter = jitter > 0 ? (uint64_t) (jitter * 1000000) : 0;
+	this->itf_opts.loopback.loss = loss < 0 ? 0 : loss > 1 ? 1 : loss;
+}
+
+void Tuntap::groset(Handle<Value> val) {
+	Isolate* isolate = Isolate::GetCurrent();
+	int max_size = 0;
+	
+	if(val->IsObject())
+		TT_GETOPT(val->ToObject(), "max_size", max_size, ToInteger)
+	
+	this->offload.configureGro(val->IsObject() || val->BooleanValue(), max_size);
+}
+
+void Tuntap::pollset(Handle<Value> val) {
+	Isolate* isolate = Isolate::GetCurrent();
+	Local<Object> obj;
+	std::string mode = "adaptive";
+	
+	this->poll_.busy = false;
+	this->poll_.window_start = 0;
+	this->poll_.window_packets = 0;
+	
+	if(!val->IsObject()) {
+		if(val->BooleanValue())
+			this->poll_.mode = busy_poll_t::POLL_ADAPTIVE;
+		else
+			this->poll_.mode = busy_poll_t::POLL_EVENT;
+		return;
+	}
+	
+	obj = val->ToObject();
+	
+	TT_GETOPT_STR(obj, "mode", mode)
+	TT_GETOPT(obj, "budget", this->poll_.budget, ToInteger)
+	TT_GETOPT(obj, "eagain", this->poll_.eagain, ToInteger)
+	TT_GETOPT(obj, "rate_high", this->poll_.rate_high, ToInteger)
+	TT_GETOPT(obj, "rate_low", this->poll_.rate_low, ToInteger)
+	
+	if(mode == "busy")
+		this->poll_.mode = busy_poll_t::POLL_BUSY;
+	else if(mode == "event")
+		this->poll_.mode = busy_poll_t::POLL_EVENT;
+	else
+		this->poll_.mode = busy_poll_t::POLL_ADAPTIVE;
+	
+	if(this->poll_.budget <= 0)
+		this->poll_.budget = TUNTAP_DFT_POLL_BUDGET;
+	if(this->poll_.eagain <= 0)
+		this->poll_.eagain = TUNTAP_DFT_POLL_EAGAIN;
+	if(this->poll_.rate_low > this->poll_.rate_high)
+		this->poll_.rate_low = this->poll_.rate_high;
+	
+	this->poll_.busy = (this->poll_.mode == busy_poll_t::POLL_BUSY);
+}
+
+void Tuntap::uv_event_cb(uv_poll_t* handle, int status, int events) {
+	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+	int count = 0;
+	
+	if(events & UV_READABLE) {
+		count = obj->do_read();
+	}
+	
+	if((events & UV_WRITABLE) && obj->fd >= 0) {
+		obj->do_write();
+	}
+	
+	if(obj->poll_.mode != busy_poll_t::POLL_EVENT && (events & UV_READABLE))
+		obj->busy_poll(count);
+}
+
+/*
+ * NAPI-like polling : under load, keep reading the device without going back
+ * to the event loop, until the time budget is spent or the device stays
+ * empty for a few reads.
+ */
+void Tuntap::busy_poll(int count) {
+	uint64_t now = uv_hrtime();
+	uint64_t deadline = now + (uint64_t) this->poll_.budget * 1000;
+	int idle = 0;
+	
+	this->poll_.wakeups++;
+	this->poll_update(count, now);
+	
+	while(
+		this->poll_.busy &&
+		this->fd >= 0 &&
+		this->is_reading &&
+		idle < this->poll_.eagain &&
+		now < deadline
+	) {
+		count = this->do_read();
+		if(this->fd >= 0 && this->write_queued() > 0)
+			this->do_write();
+		
+		idle = count > 0 ? 0 : idle + 1;
+		now = uv_hrtime();
+		
+		this->poll_.busy_rounds++;
+		this->poll_.busy_packets += count;
+		this->poll_update(count, now);
+	}
+}
+
+void Tuntap::poll_update(int count, uint64_t now) {
+	bool busy;
+	
+	this->poll_.window_packets += count;
+	
+	if(now - this->poll_.window_start < TUNTAP_POLL_WINDOW)
+		return;
+	
+	this->poll_.rate = this->poll_.window_packets * 1e9 / (now - this->poll_.window_start);
+	this->poll_.window_start = now;
+	this->poll_.window_packets = 0;
+	
+	if(this->poll_.mode != busy_poll_t::POLL_ADAPTIVE)
+		return;
+	
+	if(this->poll_.busy)
+		busy = this->poll_.rate >= this->poll_.rate_low;
+	else
+		busy = this->poll_.rate >= this->poll_.rate_high;
+	
+	if(busy != this->poll_.busy) {
+		this->poll_.busy = busy;
+		this->poll_.switches++;
+	}
+}
+
+void Tuntap::set_read(bool r) {
+	if(r != this->is_reading) {
+		this->is_reading = r;
+		if(this->reactor_entry_)
+			this->reactor_->update(this->reactor_entry_);
+		else if(this->uv_handle_)
+			uv_poll_start(
+				this->uv_handle_,
+				(this->is_reading ? UV_READABLE : 0) | (this->is_writing ? UV_WRITABLE : 0),
+				uv_event_cb
+			);
+	}
+}
+
+void Tuntap::set_write(bool w) {
+	if(w != this->is_writing) {
+		this->is_writing = w;
+		if(this->reactor_entry_)
+			this->reactor_->update(this->reactor_entry_);
+		else if(this->uv_handle_)
+			uv_poll_start(
+				this->uv_handle_,
+				(this->is_reading ? UV_READABLE : 0) | (this->is_writing ? UV_WRITABLE : 0),
+				uv_event_cb
+			);
+	}
+}
+
+
+int Tuntap::l3_offset() const {
+	if(this->itf_opts.mode == tuntap_itf_opts_t::MODE_TAP)
+		return(INET_TAP_L3_OFF);
+	
+	return(INET_TUN_L3_OFF);
+}
+
+/*
+ * `drained` is set when the round ended on an empty device, and left unset
+ * when it stopped on a full ring or on the batch size.
+ */
+int Tuntap::do_read(bool *drained) {
+	Isolate* isolate = Isolate::GetCurrent();
+	HandleScope scope(isolate);
+	
+	if(drained)
+		*drained = false;
+	
+	/* The application reads by itself until the device is empty : only tell it there is data */
+	if(this->pull_mode) {
+		if(drained)
+			*drained = true;
+		this->set_read(false);
+		node::MakeCallback(isolate, this->handle(isolate), "_on_available", 0, NULL);
+		return(0);
+	}
+	
+	return(this->do_read_push(drained));
+}
+
+int Tuntap::do_read_push(bool *drained) {
+	Isolate* isolate = Isolate::GetCurrent();
+	HandleScope scope(isolate);
+	uint64_t times[TUNTAP_MAX_READ_BATCH];
+	uint16_t vlan_ids[TUNTAP_MAX_READ_BATCH];
+	BufPool::Lease rbuff(this->read_buff, this->itf_opts.mtu + this->l3_offset());
+	Offload::out_t outs[2];
+	Local<Array> buffers;
+	Local<Array> vlan_buffers;
+	Local<ArrayBuffer> ids_buff;
+	Local<ArrayBuffer> times_buff;
+	Local<Value> times_arr;
+	uint64_t now = 0;
+	uint8_t *data;
+	bool end = false;
+	int count = 0;
+	int ring_count = 0;
+	int vlan_count = 0;
+	int reads = 0;
+	int nout;
+	int vid;
+	int size;
+	int ret;
+	int i;
+	int j;
+	
+	for(i = 0 ; this->fd >= 0 ; i++) {
+		ret = 0;
+		
+		if(!end && i < this->read_batch) {
+			/* The datagrams stay in the device until the ring has room */
+			if(this->ring_ && this->ring_->rx->full()) {
+				this->ring_->stalled = true;
+				this->ring_->stalls++;
+				this->set_read(false);
+			}
+			else {
+				ret = read(this->fd, rbuff.data, this->itf_opts.mtu + this->l3_offset());
+				if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+					this->stats_.rx_errors++;
+				if(ret <= 0 && drained)
+					*drained = true;
+			}
+		}
+		
+		if(ret <= 0) {
+			/* The end of the round releases the segment held by GRO */
+			end = true;
+			if(!this->offload.groEnabled() || (nout = this->offload.groFlush(outs)) == 0)
+				break;
+		}
+		else {
+			reads++;
+			
+			if(this->timestamps)
+				now = uv_hrtime();
+			
+			this->stats_.rx_packets++;
+			this->stats_.rx_bytes += ret;
+			
+			if(this->capture_)
+				this->capture_->packet(rbuff.data, ret, true);
+			
+			if(this->neighbor_ && this->neighbor_->process(this->fd, rbuff.data, ret))
+				continue;
+			
+			data = rbuff.data;
+			size = ret;
+			
+			if(this->ipfrag.enabled()) {
+				data = this->ipfrag.reassemble(data, size, this->l3_offset(), &size);
+				if(!data)
+					continue;
+			}
+			
+			if(this->flows_)
+				this->flows_->packet(data, size, this->l3_offset(), FlowMeter::DIR_READ, uv_now(this->loop_));
+			
+			if(this->offload.groEnabled()) {
+				nout = this->offload.groPush(data, size, this->l3_offset(), outs);
+			}
+			else {
+				outs[0].data = data;
+				outs[0].size = size;
+				nout = 1;
+			}
+		}
+		
+		for(j = 0 ; j < nout ; j++) {
+			data = outs[j].data;
+			size = outs[j].size;
+			vid = VLAN_PASS;
+			
+			if(this->vlan_ && (vid = this->vlan_->demux(&data, &size)) == VLAN_DROP)
+				continue;
+			
+			data = this->read_stage(data, &size);
+			if(!data)
+				continue;
+			
+			/* The frames of the joined VLANs all go in a single callback */
+			if(vid >= 0) {
+				if(vlan_count == 0)
+					vlan_buffers = Array::New(isolate);
+				
+				vlan_buffers->Set(vlan_count, this->make_read_buffer(data, size));
+				vlan_ids[vlan_count] = vid;
+				vlan_count++;
+				continue;
+			}
+			
+			if(this->ring_) {
+				if(this->ring_->rx->push(data, size, this->aead_ ? RING_FLAG_SEALED : 0))
+					ring_count++;
+				continue;
+			}
+			
+			if(this->coalesce_) {
+				this->coalesce_append(data, size);
+				continue;
+			}
+			
+			/* Plain reads keep the historical single datagram callback */
+			if(this->read_batch == 1 && !this->timestamps) {
+				this->emit_read(data, size);
+				return(1);
+			}
+			
+			if(count == 0)
+				buffers = Array::New(isolate);
+			
+			buffers->Set(count, this->make_read_buffer(data, size));
+			times[count] = now;
+			count++;
+		}
+	}
+	
+	
+	if(ring_count > 0) {
+		this->ring_->rx_packets += ring_count;
+		
+		Local<Value> ring_argv[1] = {
+			Integer::New(isolate, ring_count)
+		};
+		
+		node::MakeCallback(
+			isolate,
+			this->handle(isolate),
+			"_on_ring",
+			1,
+			ring_argv
+		);
+	}
+	
+	if(vlan_count > 0) {
+		ids_buff = ArrayBuffer::New(isolate, vlan_count * sizeof(uint16_t));
+		memcpy(ids_buff->GetContents().Data(), vlan_ids, vlan_count * sizeof(uint16_t));
+		
+		Local<Value> vlan_argv[2] = {
+			vlan_buffers,
+			Uint16Array::New(ids_buff, 0, vlan_count)
+		};
+		
+		node::MakeCallback(
+			isolate,
+			this->handle(isolate),
+			"_on_vlan_batch",
+			2,
+			vlan_argv
+		);
+	}
+	
+	if(count == 0)
+		return(reads);
+	
+	if(this->timestamps) {
+		times_buff = ArrayBuffer::New(isolate, count * sizeof(double));
+		for(i = 0 ; i < count ; i++)
+			((double*) times_buff->GetContents().Data())[i] = times[i];
+		times_arr = Float64Array::New(times_buff, 0, count);
+	}
+	else {
+		times_arr = Undefined(isolate);
+	}
+	
+	const int argc = 2;
+	Local<Value> argv[argc] = {
+		buffers,
+		times_arr
+	};
+	
+	node::MakeCallback(
+		isolate,
+		this->handle(isolate),
+		"_on_read_batch",
+		argc,
+		argv
+	);
+	
+	if(this->timestamps) {
+		now = uv_hrtime();
+		for(i = 0 ; i < count ; i++)
+			this->latency_->rx_dispatch.record(now - times[i]);
+	}
+	
+	return(reads);
+}
+
+/* The size needed by read_into() for a datagram of the MTU, or a reassembled one */
+int Tuntap::read_into_room() const {
+	int room = this->itf_opts.mtu + this->l3_offset();
+	
+	if(this->ipfrag.enabled() && this->ipfrag.reassembledMaxSize(this->l3_offset()) > room)
+		room = this->ipfrag.reassembledMaxSize(this->l3_offset());
+	
+	if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_HALF)
+		room -= 2;
+	else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_FULL)
+		room -= 3;
+	
+	if(this->aead_)
+		room += AEAD_OVERHEAD;
+	
+	return(room);
+}
+
+/*
+ * Reads a single datagram into `out`, staged as it would be for a 'data'
+ * event. Returns its size, or 0 when the device is empty. Without any stage
+ * that needs the whole datagram, it is read in place, the device header
+ * being compressed through readv(), so that it is never copied.
+ */
+int Tuntap::read_into(uint8_t *out, int room) {
+	int max = this->itf_opts.mtu + this->l3_offset();
+	struct iovec iov[2];
+	uint8_t hdr[4];
+	uint8_t *data;
+	int size;
+	int ret = 0;
+	
+	while(this->fd >= 0) {
+		if(this->ipfrag.enabled() || this->aead_ || this->capture_ || this->flows_ || this->neighbor_) {
+			BufPool::Lease rbuff(this->read_buff, max);
+			
+			ret = read(this->fd, rbuff.data, max);
+			if(ret <= 0)
+				break;
+			
+			this->stats_.rx_packets++;
+			this->stats_.rx_bytes += ret;
+			
+			if(this->capture_)
+				this->capture_->packet(rbuff.data, ret, true);
+			
+			if(this->neighbor_ && this->neighbor_->process(this->fd, rbuff.data, ret))
+				continue;
+			
+			data = rbuff.data;
+			size = ret;
+			
+			if(this->ipfrag.enabled()) {
+				data = this->ipfrag.reassemble(data, size, this->l3_offset(), &size);
+				if(!data)
+					continue;
+			}
+			
+			if(this->flows_)
+				this->flows_->packet(data, size, this->l3_offset(), FlowMeter::DIR_READ, uv_now(this->loop_));
+			
+			data = this->read_stage(data, &size);
+			if(!data)
+				continue;
+			
+			/* Reassembled datagrams may be bigger than the MTU */
+			if(size > room) {
+				this->stats_.rx_errors++;
+				continue;
+			}
+			
+			memcpy(out, data, size);
+			return(size);
+		}
+		
+		if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_HALF) {
+			iov[0].iov_base = hdr;
+			iov[0].iov_len = 2;
+			iov[1].iov_base = out;
+			iov[1].iov_len = room;
+			ret = readv(this->fd, iov, 2);
+			size = ret - 2;
+		}
+		else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_FULL) {
+			iov[0].iov_base = hdr;
+			iov[0].iov_len = 4;
+			iov[1].iov_base = out + 1;
+			iov[1].iov_len = room - 1;
+			ret = readv(this->fd, iov, 2);
+			size = ret - 3;
+			if(ret >= 4)
+				out[0] = EtherTypes::getId(be32toh(*(uint32_t*) hdr));
+		}
+		else {
+			ret = read(this->fd, out, room);
+			size = ret;
+		}
+		
+		if(ret <= 0)
+			break;
+		
+		this->stats_.rx_packets++;
+		this->stats_.rx_bytes += ret;
+		
+		if(size <= 0) {
+			this->stats_.rx_errors++;
+			continue;
+		}
+		
+		return(size);
+	}
+	
+	if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		this->stats_.rx_errors++;
+	
+	return(0);
+}
+
+/*
+ * Turns a raw datagram into what is delivered to javascript : ethertype
+ * compression, then encryption. Returns NULL when the datagram is dropped.
+ */
+uint8_t *Tuntap::read_stage(uint8_t *data, int *size) {
+	int l3_off = this->l3_offset();
+	uint8_t *l3 = data + l3_off;
+	int l3_size = *size - l3_off;
+	
+	data = this->read_comp(data, size);
+	
+	if(this->aead_)
+		data = this->aead_->seal(data, *size, l3, l3_size, size);
+	
+	return(data);
+}
+
+uint8_t *Tuntap::read_comp(uint8_t *data, int *size) {
+	if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_HALF) {
+		*size -= 2;
+		return(data + 2);
+	}
+	else if(this->itf_opts.ethtype_comp == TUNTAP_ETCOMP_FULL) {
+		uint8_t etval = EtherTypes::getId(be32toh(*(uint32_t*) data));
+		data[3] = etval;
+		*size -= 3;
+		return(data + 3);
+	}
+	
+	/* Also matches TUNTAP_ETCOMP_NONE */
+	return(data);
+}
+
+Local<Object> Tuntap::make_read_buffer(uint8_t *data, int size) {
+	Isolate* isolate = Isolate::GetCurrent();
+	EscapableHandleScope scope(isolate);
+	
+	Local<Object> ret_buff;
+	
+	ret_buff = node::Buffer::Copy(isolate, (char*) data, size).ToLocalChecked();
+	
+	return(scope.Escape(ret_buff));
+}
+
+/*
+ * Coalescing : the datagrams are appended to a single chunk, each one
+ * prefixed by its length on 2 bytes (little endian, as tuntap.demuxer
+ * expects), and the chunk is delivered when it is big enough or when its
+ * first datagram is too old.
+ */
+void Tuntap::coalesce_append(uint8_t *data, int size) {
+	coalesce_t *co = this->coalesce_;
+	uint64_t now = uv_hrtime();
+	int ret;
+	
+	if(size > 0xFFFF) {
+		this->stats_.rx_errors++;
+		return;
+	}
+	
+	if(co->used == 0) {
+		co->first = now;
+		uv_timer_start(co->timer, coalesce_timer_cb, (co->delay + 999) / 1000, 0);
+	}
+	
+	if(co->compress && (ret = lz4Frame(data, size, co->data + co->used, LZ4_DFT_MIN_SIZE)) > 0) {
+		co->compressed++;
+		co->saved += size + 2 - ret;
+		co->used += ret;
+	}
+	else {
+		co->data[co->used] = size;
+		co->data[co->used + 1] = size >> 8;
+		memcpy(co->data + co->used + 2, data, size);
+		co->used += size + 2;
+	}
+	co->chunk_packets++;
+	
+	if(co->used >= co->limit || now - co->first >= (uint64_t) co->delay * 1000)
+		this->coalesce_flush();
+}
+
+void Tuntap::coalesce_flush() {
+	Isolate* isolate = Isolate::GetCurrent();
+	HandleScope scope(isolate);
+	coalesce_t *co = this->coalesce_;
+	Local<Object> ret_buff;
+	
+	if(!co || co->used == 0)
+		return;
+	
+	uv_timer_stop(co->timer);
+	
+	ret_buff = node::Buffer::Copy(isolate, (char*) co->data, co->used).ToLocalChecked();
+	
+	co->chunks++;
+	co->packets += co->chunk_packets;
+	co->chunk_packets = 0;
+	co->used = 0;
+	
+	const int argc = 1;
+	Local<Value> argv[argc] = {
+		ret_buff
+	};
+	
+	node::MakeCallback(
+		isolate,
+		this->handle(isolate),
+		"_on_read",
+		argc,
+		argv
+	);
+}
+
+void Tuntap::coalesce_timer_cb(uv_timer_t* handle) {
+	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+	
+	obj->coalesce_flush();
+}
+
+void Tuntap::fqset(Handle<Value> val) {
+	Isolate* isolate = Isolate::GetCurrent();
+	FqCodel::opts_t opts;
+	FqCodel *old = this->fq_;
+	Local<Object> obj;
+	Buffer *wbuff;
+	
+	if(val->IsObject()) {
+		obj = val->ToObject();
+		TT_GETOPT(obj, "flows", opts.flows, ToInteger)
+		TT_GETOPT(obj, "limit", opts.limit, ToInteger)
+		TT_GETOPT(obj, "quantum", opts.quantum, ToInteger)
+		TT_GETOPT(obj, "target", opts.target, ToInteger)
+		TT_GETOPT(obj, "interval", opts.interval, ToInteger)
+		TT_GETOPT(obj, "ecn", opts.ecn, ToBoolean)
+	}
+	
+	if(opts.flows < 1)
+		opts.flows = 1;
+	if(opts.limit < 1)
+		opts.limit = 1;
+	if(opts.quantum < 64)
+		opts.quantum = 64;
+	
+	this->fq_ = NULL;
+	if(val->IsObject() || val->BooleanValue())
+		this->fq_ = new FqCodel(opts, fq_free_cb);
+	
+	/* The queued datagrams move to the new queue */
+	if(old) {
+		while((wbuff = static_cast<Buffer*>(old->drain())))
+			this->write_enqueue(wbuff);
+		delete old;
+	}
+}
+
+void Tuntap::autotuneset(Handle<Value> val) {
+	Isolate* isolate = Isolate::GetCurrent();
+	Autotune::opts_t opts;
+	Local<Object> obj;
+	
+	this->autotune_stop();
+	
+	if(val->IsObject()) {
+		obj = val->ToObject();
+		TT_GETOPT(obj, "interval", opts.interval, ToInteger)
+		TT_GETOPT(obj, "calm", opts.calm, ToInteger)
+		TT_GETOPT(obj, "sndbuf_min", opts.sndbuf_min, ToInteger)
+		TT_GETOPT(obj, "sndbuf_max", opts.sndbuf_max, ToInteger)
+		TT_GETOPT(obj, "txqueuelen_min", opts.txqueuelen_min, ToInteger)
+		TT_GETOPT(obj, "txqueuelen_max", opts.txqueuelen_max, ToInteger)
+	}
+	else if(!val->BooleanValue()) {
+		return;
+	}
+	
+	if(opts.interval < 10)
+		opts.interval = 10;
+	if(opts.calm < 1)
+		opts.calm = 1;
+	if(opts.sndbuf_min < 2048)
+		opts.sndbuf_min = 2048;
+	if(opts.sndbuf_max < opts.sndbuf_min)
+		opts.sndbuf_max = opts.sndbuf_min;
+	if(opts.txqueuelen_min < 1)
+		opts.txqueuelen_min = 1;
+	if(opts.txqueuelen_max < opts.txqueuelen_min)
+		opts.txqueuelen_max = opts.txqueuelen_min;
+	
+	this->autotune_ = new Autotune(opts);
+	this->autotune_timer_ = new uv_timer_t;
+	uv_timer_init(this->loop_, this->autotune_timer_);
+	this->autotune_timer_->data = this;
+	uv_unref((uv_handle_t*) this->autotune_timer_);
+	
+	if(this->fd >= 0)
+		this->autotune_start();
+}
+
+void Tuntap::coalesceset(Handle<Value> val) {
+	Isolate* isolate = Isolate::GetCurrent();
+	Local<Object> obj;
+	int size = TUNTAP_DFT_COALESCE_SIZE;
+	int delay = TUNTAP_DFT_COALESCE_DELAY;
+	bool compress = false;
+	
+	if(val->IsObject()) {
+		obj = val->ToObject();
+		TT_GETOPT(obj, "size", size, ToInteger)
+		TT_GETOPT(obj, "delay", delay, ToInteger)
+		TT_GETOPT(obj, "compress", compress, ToBoolean)
+	}
+	else if(!val->BooleanValue()) {
+		if(this->coalesce_) {
+			this->coalesce_flush();
+			delete[] this->coalesce_->data;
+			uv_close((uv_handle_t*) this->coalesce_->timer, uv_free_cb<uv_timer_t>);
+			delete this->coalesce_;
+			this->coalesce_ = NULL;
+		}
+		return;
+	}
+	
+	if(size < 2)
+		size = 2;
+	if(delay < 1)
+		delay = 1;
+	
+	if(!this->coalesce_) {
+		this->coalesce_ = new coalesce_t();
+		this->coalesce_->timer = new uv_timer_t;
+		uv_timer_init(this->loop_, this->coalesce_->timer);
+		this->coalesce_->timer->data = this;
+	}
+	else {
+		this->coalesce_flush();
+		delete[] this->coalesce_->data;
+	}
+	
+	/* A full chunk may still receive one more datagram of the biggest size */
+	this->coalesce_->data = new uint8_t[size + 2 + 0xFFFF];
+	this->coalesce_->limit = size;
+	this->coalesce_->delay = delay;
+	this->coalesce_->compress = compress;
+}
+
+void Tuntap::emit_read(uint8_t *data, int size) {
+	Isolate* isolate = Isolate::GetCurrent();
+	HandleScope scope(isolate);
+	
+	Local<Object> ret_buff = this->make_read_buffer(data, size);
+	
+	const int argc = 1;
+	Local<Value> argv[argc] = {
+		ret_buff
+	};
+	
+	node::MakeCallback(
+		isolate,
+		this->handle(isolate),
+		"_on_read",
+		argc,
+		argv
+	);
+}
+
+void Tuntap::queue_write(Buffer *wbuff, uint32_t mark) {
+	uint8_t ptb[INET_TAP_L3_OFF + 1280];
+	int l3_off = this->l3_offset();
+	Shaper::class_t *cls = NULL;
+	uint8_t *data;
+	Buffer *frag;
+	int size;
+	int i;
+	
+	if(this->flows_)
+		this->flows_->packet(wbuff->data, wbuff->size, l3_off, FlowMeter::DIR_WRITE, uv_now(this->loop_));
+	
+	/* The fragments of a datagram all go to its class */
+	if(this->shaper_)
+		cls = this->shaper_->classify(wbuff->data, wbuff->size, l3_off, mark);
+	
+	/* The segments of a TCP segment too big for the device, as for fragments */
+	if(this->offload.gsoCheck(wbuff->data, wbuff->size, l3_off, this->itf_opts.mtu)) {
+		for(i = 0 ; ; i++) {
+			frag = new Buffer(this->offload.segmentMaxSize(l3_off, this->itf_opts.mtu));
+			frag->size = this->offload.segment(wbuff->data, wbuff->size, l3_off, this->itf_opts.mtu, i, frag->data);
+			if(frag->size <= 0) {
+				delete frag;
+				break;
+			}
+			this->push_write(frag, cls);
+		}
+		delete wbuff;
+		if(cls)
+			this->shaper_run();
+		return;
+	}
+	
+	if(this->ipfrag.enabled()) {
+		switch(this->ipfrag.check(wbuff->data, wbuff->size, l3_off, this->itf_opts.mtu)) {
+			case IpFrag::FRAG_SPLIT:
+				for(i = 0 ; ; i++) {
+					frag = new Buffer(this->ipfrag.fragmentMaxSize(l3_off, this->itf_opts.mtu));
+					frag->size = this->ipfrag.fragment(wbuff->data, wbuff->size, l3_off, this->itf_opts.mtu, i, frag->data);
+					if(frag->size <= 0) {
+						delete frag;
+						break;
+					}
+					this->push_write(frag, cls);
+				}
+				delete wbuff;
+				if(cls)
+					this->shaper_run();
+				return;
+			
+			case IpFrag::FRAG_TOO_BIG:
+				this->stats_.tx_dropped++;
+				if(this->ipfrag.icmpEnabled()) {
+					size = this->ipfrag.makePtb(wbuff->data, wbuff->size, l3_off, this->itf_opts.mtu, ptb);
+					delete wbuff;
+					if(size > 0 && (data = this->read_stage(ptb, &size)))
+						this->emit_read(data, size);
+				}
+				else {
+					delete wbuff;
+				}
+				return;
+			
+			case IpFrag::FRAG_PASS:
+				break;
+		}
+	}
+	
+	this->push_write(wbuff, cls);
+	if(cls)
+		this->shaper_run();
+}
+
+void Tuntap::push_write(Buffer *wbuff, Shaper::class_t *cls) {
+	if(this->timestamps)
+		wbuff->queued = uv_hrtime();
+	
+	if(cls) {
+		if(!this->shaper_->enqueue(cls, wbuff, wbuff->size)) {
+			this->stats_.tx_dropped++;
+			delete wbuff;
+		}
+		return;
+	}
+	
+	this->write_enqueue(wbuff);
+}
+
+void Tuntap::write_enqueue(Buffer *wbuff) {
+	uint64_t overlimit;
+	
+	if(this->fq_) {
+		/* Over the limit, fq_codel drops from the biggest flow */
+		overlimit = this->fq_->getStats().overlimit;
+		this->fq_->enqueue(wbuff, wbuff->data, wbuff->size, this->l3_offset(), uv_hrtime());
+		this->stats_.tx_dropped += this->fq_->getStats().overlimit - overlimit;
+	}
+	else {
+		if(!this->writ_buff)
+			this->writ_buff = new std::deque<Buffer*>();
+		this->writ_buff->push_back(wbuff);
+	}
+	
+	this->set_write(true);
+}
+
+size_t Tuntap::write_queued() const {
+	return(
+		(this->writ_buff ? this->writ_buff->size() : 0) +
+		(this->fq_ ? this->fq_->getBacklog() : 0)
+	);
+}
+
+void Tuntap::fq_free_cb(void *pkt) {
+	delete static_cast<Buffer*>(pkt);
+}
+
+/*
+ * Moves the datagrams allowed by the shaper to the write queue, and arms the
+ * timer for the next one.
+ */
+void Tuntap::shaper_run() {
+	uint64_t now = uv_hrtime();
+	uint64_t next;
+	Buffer *wbuff;
+	int count = 0;
+	
+	while((wbuff = static_cast<Buffer*>(this->shaper_->dequeue(now)))) {
+		this->write_enqueue(wbuff);
+		count++;
+	}
+	
+	next = this->shaper_->nextTime(now);
+	if(next)
+		uv_timer_start(this->shaper_timer_, shaper_timer_cb, (next - now + 999999) / 1000000, 0);
+	else
+		uv_timer_stop(this->shaper_timer_);
+}
+
+/* Parses a number or a [ min, max ] range */
+static void generatorRange(Local<Value> val, int *min, int *max) {
+	Local<Array> arr;
+	
+	if(val->IsNumber()) {
+		*min = *max = val->Int32Value();
+	}
+	else if(val->IsArray()) {
+		arr = val.As<Array>();
+		if(arr->Length() == 2) {
+			*min = arr->Get(0)->Int32Value();
+			*max = arr->Get(1)->Int32Value();
+		}
+	}
+}
+
+/*
+ * generate(options | false) : starts the traffic generator on the device,
+ * after stopping the previous one.
+ */
+void Tuntap::generate(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Generator::opts_t opts;
+	std::string err_str;
+	std::string str;
+	Local<Object> main_obj;
+	Local<Value> val;
+	int src_family = 0;
+	int dst_family = 0;
+	
+	if(obj->generator_)
+		obj->generator_->stop();
+	
+	if(!args[0]->IsObject()) {
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	if(obj->fd == -1) {
+		TT_THROW_TYPE("Object is closed and cannot be written!");
+		return;
+	}
+	
+	main_obj = args[0]->ToObject();
+	
+	TT_GETOPT_STR(main_obj, "pcap", opts.pcap)
+	
+	str.clear();
+	TT_GETOPT_STR(main_obj, "src", str)
+	if(str.size() > 0 && !(src_family = inetParseAddr(str, opts.src)))
+		err_str = "Invalid source address";
+	
+	str.clear();
+	TT_GETOPT_STR(main_obj, "dst", str)
+	if(str.size() > 0 && !(dst_family = inetParseAddr(str, opts.dst)))
+		err_str = "Invalid destination address";
+	
+	if(src_family == dst_family)
+		opts.family = src_family;
+	
+	str.clear();
+	TT_GETOPT_STR(main_obj, "mac_src", str)
+	if(str.size() > 0 && !inetParseMac(str, opts.mac_src))
+		err_str = "Invalid source MAC address";
+	
+	str.clear();
+	TT_GETOPT_STR(main_obj, "mac_dst", str)
+	if(str.size() > 0 && !inetParseMac(str, opts.mac_dst))
+		err_str = "Invalid destination MAC address";
+	
+	val = main_obj->Get(String::NewFromUtf8(isolate, "proto"));
+	if(!val->IsUndefined())
+		opts.proto = shaperProto(val);
+	
+	generatorRange(main_obj->Get(String::NewFromUtf8(isolate, "sport")), &opts.sport_min, &opts.sport_max);
+	generatorRange(main_obj->Get(String::NewFromUtf8(isolate, "dport")), &opts.dport_min, &opts.dport_max);
+	generatorRange(main_obj->Get(String::NewFromUtf8(isolate, "size")), &opts.size_min, &opts.size_max);
+	
+	TT_GETOPT(main_obj, "src_count", opts.src_count, ToInteger)
+	TT_GETOPT(main_obj, "dst_count", opts.dst_count, ToInteger)
+	TT_GETOPT(main_obj, "ttl", opts.ttl, ToInteger)
+	TT_GETOPT(main_obj, "tos", opts.tos, ToInteger)
+	TT_GETOPT(main_obj, "random", opts.random, ToBoolean)
+	TT_GETOPT(main_obj, "checksum", opts.checksum, ToBoolean)
+	TT_GETOPT(main_obj, "loops", opts.loops, ToInteger)
+	TT_GETOPT(main_obj, "count", opts.count, ToInteger)
+	TT_GETOPT(main_obj, "duration", opts.duration, ToInteger)
+	
+	val = main_obj->Get(String::NewFromUtf8(isolate, "speed"));
+	if(val->IsNumber())
+		opts.speed = val->NumberValue();
+	
+	val = main_obj->Get(String::NewFromUtf8(isolate, "rate"));
+	if(val->IsNumber())
+		opts.rate = val->NumberValue();
+	
+	if(err_str.size() > 0) {
+		TT_THROW_TYPE(err_str.c_str());
+		return;
+	}
+	
+	if(!obj->generator_) {
+		obj->generator_ = new Generator();
+		obj->generator_async_ = new uv_async_t;
+		uv_async_init(obj->loop_, obj->generator_async_, generator_done_cb);
+		obj->generator_async_->data = obj;
+		uv_unref((uv_handle_t*) obj->generator_async_);
+	}
+	
+	if(
+		!obj->generator_->configure(opts, obj->l3_offset(), &err_str) ||
+		!obj->generator_->start(obj->fd, obj->generator_async_, &err_str)
+	) {
+		TT_THROW_TYPE(err_str.c_str());
+		return;
+	}
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+void Tuntap::generator_done_cb(uv_async_t* handle) {
+	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+	Isolate* isolate = obj->isolate_;
+	HandleScope scope(isolate);
+	Local<Value> argv[1];
+	
+	/* The capture file could not be loaded by the thread */
+	if(obj->generator_->getError().size() > 0) {
+		argv[0] = Exception::Error(String::NewFromUtf8(isolate, obj->generator_->getError().c_str()));
+		node::MakeCallback(isolate, obj->handle(isolate), "_on_error", 1, argv);
+		return;
+	}
+	
+	node::MakeCallback(isolate, obj->handle(isolate), "_on_generated", 0, NULL);
+}
+
+/*
+ * flows(options | false) : meters the flows read from and written to the
+ * device, replacing the previous flow meter. Without options, the flows
+ * still active are exported before the meter goes.
+ */
+void Tuntap::flows(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	FlowMeter::opts_t opts;
+	FlowMeter *meter;
+	std::string err_str;
+	Local<Object> main_obj;
+	int interval = 1000;
+	int batch = FLOWMETER_DFT_BATCH;
+	
+	if(obj->flows_) {
+		obj->flows_->expire(uv_now(obj->loop_), true);
+		obj->flows_deliver();
+		obj->flows_stop();
+	}
+	
+	if(!args[0]->IsObject()) {
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	main_obj = args[0]->ToObject();
+	
+	TT_GETOPT(main_obj, "entries", opts.entries, ToInteger)
+	TT_GETOPT(main_obj, "sampling", opts.sampling, ToInteger)
+	TT_GETOPT(main_obj, "active", opts.active, ToInteger)
+	TT_GETOPT(main_obj, "idle", opts.idle, ToInteger)
+	TT_GETOPT(main_obj, "domain", opts.domain, ToInteger)
+	TT_GETOPT(main_obj, "records", opts.records, ToBoolean)
+	TT_GETOPT_STR(main_obj, "collector", opts.collector)
+	TT_GETOPT(main_obj, "interval", interval, ToInteger)
+	TT_GETOPT(main_obj, "batch", batch, ToInteger)
+	
+	if(opts.entries <= 0 || opts.entries > (1 << 24) || opts.active <= 0 || opts.idle <= 0 || interval <= 0 || batch <= 0) {
+		isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate, "Invalid flow meter options")));
+		return;
+	}
+	
+	meter = new FlowMeter();
+	if(!meter->configure(opts, uv_now(obj->loop_), &err_str)) {
+		delete meter;
+		TT_THROW_TYPE(err_str.c_str());
+		return;
+	}
+	
+	obj->flows_ = meter;
+	obj->flows_batch = batch;
+	obj->flows_timer_ = new uv_timer_t;
+	uv_timer_init(obj->loop_, obj->flows_timer_);
+	obj->flows_timer_->data = obj;
+	uv_timer_start(obj->flows_timer_, flows_timer_cb, interval, interval);
+	uv_unref((uv_handle_t*) obj->flows_timer_);
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+/* flushFlows() : exports all the flows now */
+void Tuntap::flushFlows(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	
+	if(obj->flows_) {
+		obj->flows_->expire(uv_now(obj->loop_), true);
+		obj->flows_deliver();
+	}
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+void Tuntap::flows_timer_cb(uv_timer_t* handle) {
+	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+	
+	obj->flows_->expire(uv_now(obj->loop_), false);
+	obj->flows_deliver();
+}
+
+/* The exported records go to javascript by batches of at most flows_batch */
+void Tuntap::flows_deliver() {
+	Isolate* isolate = this->isolate_;
+	HandleScope scope(isolate);
+	std::vector<uint8_t> records;
+	
+	while(this->flows_ && this->flows_->takeRecords(&records, this->flows_batch) > 0) {
+		Local<Value> argv[1] = {
+			this->make_read_buffer(&records[0], records.size())
+		};
+		
+		node::MakeCallback(isolate, this->handle(isolate), "_on_flows", 1, argv);
+	}
+}
+
+void Tuntap::flows_stop() {
+	if(!this->flows_)
+		return;
+	
+	uv_close((uv_handle_t*) this->flows_timer_, uv_free_cb<uv_timer_t>);
+	delete this->flows_;
+	this->flows_ = NULL;
+	this->flows_timer_ = NULL;
+}
+
+void Tuntap::autotune_start() {
+	this->autotune_->reset();
+	uv_timer_start(this->autotune_timer_, autotune_timer_cb, this->autotune_->getOpts().interval, this->autotune_->getOpts().interval);
+}
+
+void Tuntap::autotune_stop() {
+	if(!this->autotune_)
+		return;
+	
+	uv_close((uv_handle_t*) this->autotune_timer_, uv_free_cb<uv_timer_t>);
+	delete this->autotune_;
+	this->autotune_ = NULL;
+	this->autotune_timer_ = NULL;
+}
+
+/* Samples the kernel counters, then applies and reports the adjustments */
+void Tuntap::autotune_timer_cb(uv_timer_t* handle) {
+	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+	Isolate* isolate = obj->isolate_;
+	HandleScope scope(isolate);
+	std::vector<tuntap_itf_opts_t::option_e> options(1, tuntap_itf_opts_t::OPT_TXQUEUELEN);
+	Autotune::change_t changes[2];
+	Autotune::sample_t sample;
+	tuntap_itf_stats_t ks;
+	Local<Object> event;
+	bool ok;
+	int count;
+	
+	if(obj->fd < 0 || !tuntapItfStats(obj->itf_opts, obj->fd, &ks) || (sample.sndbuf = tuntapItfGetSndbuf(obj->itf_opts, obj->fd)) < 0)
+		return;
+	
+	sample.txqueuelen = ks.txqueuelen;
+	sample.rx_dropped = ks.rx_dropped + ks.rx_over_errors;
+	sample.tx_dropped = ks.tx_dropped + ks.tx_fifo_errors;
+	sample.write_eagain = obj->stats_.tx_eagain;
+	sample.write_queued = obj->write_queued();
+	
+	count = obj->autotune_->step(sample, changes);
+	
+	for(int i = 0 ; i < count && obj->fd >= 0 && obj->autotune_ ; i++) {
+		if(changes[i].param == Autotune::PARAM_SNDBUF) {
+			ok = tuntapItfSetSndbuf(obj->itf_opts, obj->fd, changes[i].to, NULL);
+			if(ok)
+				obj->itf_opts.sndbuf = changes[i].to;
+		}
+		else {
+			obj->itf_opts.txqueuelen = changes[i].to;
+			ok = tuntapItfSet(options, obj->itf_opts, obj->fd, NULL);
+		}
+		
+		if(!ok) {
+			obj->autotune_->failed();
+			continue;
+		}
+		
+		event = Object::New(isolate);
+		event->Set(String::NewFromUtf8(isolate, "param"), String::NewFromUtf8(isolate, changes[i].param == Autotune::PARAM_SNDBUF ? "sndbuf" : "txqueuelen"));
+		event->Set(String::NewFromUtf8(isolate, "from"), Integer::New(isolate, changes[i].from));
+		event->Set(String::NewFromUtf8(isolate, "to"), Integer::New(isolate, changes[i].to));
+		event->Set(String::NewFromUtf8(isolate, "reason"), String::NewFromUtf8(isolate, changes[i].reason));
+		
+		Local<Value> argv[1] = {
+			event
+		};
+		
+		node::MakeCallback(isolate, obj->handle(isolate), "_on_tune", 1, argv);
+	}
+}
+
+/*
+ * neighbors(options | false) : answers natively, in tap mode, the ARP
+ * requests and neighbor solicitations for the given addresses, replacing
+ * the previous ones.
+ */
+void Tuntap::neighbors(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Neighbor *neighbor;
+	Local<Object> main_obj;
+	Local<Object> item;
+	Local<Value> val;
+	Local<Array> arr;
+	std::string ip_str;
+	std::string mac_str;
+	uint8_t addr[16];
+	uint8_t mac[6];
+	int proxy_max = NEIGHBOR_DFT_PROXY_MAX;
+	int family;
+	bool router;
+	unsigned int i;
+	int pass;
+	
+	if(obj->neighbor_)
+		delete obj->neighbor_;
+	obj->neighbor_ = NULL;
+	
+	if(!args[0]->IsObject()) {
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	if(obj->itf_opts.mode != tuntap_itf_opts_t::MODE_TAP) {
+		TT_THROW_TYPE("The neighbor responder needs a tap interface");
+		return;
+	}
+	
+	main_obj = args[0]->ToObject();
+	neighbor = new Neighbor();
+	
+	TT_GETOPT(main_obj, "proxy_max", proxy_max, ToInteger)
+	neighbor->setProxyMax(proxy_max);
+	
+	for(pass = 0 ; pass < 2 ; pass++) {
+		val = main_obj->Get(String::NewFromUtf8(isolate, pass == 0 ? "addresses" : "proxy"));
+		if(!val->IsArray())
+			continue;
+		
+		arr = val.As<Array>();
+		for(i = 0 ; i < arr->Length() ; i++) {
+			if(!arr->Get(i)->IsObject())
+				continue;
+			item = arr->Get(i)->ToObject();
+			
+			ip_str.clear();
+			mac_str.clear();
+			router = false;
+			TT_GETOPT_STR(item, "ip", ip_str)
+			TT_GETOPT_STR(item, "mac", mac_str)
+			TT_GETOPT(item, "router", router, ToBoolean)
+			
+			if(!(family = inetParseAddr(ip_str, addr)) || !inetParseMac(mac_str, mac)) {
+				delete neighbor;
+				TT_THROW_TYPE("Invalid neighbor address");
+				return;
+			}
+			
+			if(pass == 0)
+				neighbor->add(addr, family == 4 ? 4 : 16, mac, router);
+			else
+				neighbor->addProxy(addr, family == 4 ? 4 : 16, mac);
+		}
+	}
+	
+	obj->neighbor_ = neighbor;
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+/*
+ * proxyNeighbor(ip, mac | false) : adds, updates or removes a proxy entry.
+ * Returns false when the entry cannot be added (too many entries) or was
+ * not there.
+ */
+void Tuntap::proxyNeighbor(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	uint8_t addr[16];
+	uint8_t mac[6];
+	int family;
+	bool ret;
+	
+	if(!obj->neighbor_) {
+		TT_THROW_TYPE("The neighbor responder is not enabled");
+		return;
+	}
+	
+	if(!args[0]->IsString() || !(family = inetParseAddr(*String::Utf8Value(args[0]), addr))) {
+		TT_THROW_TYPE("Invalid neighbor address");
+		return;
+	}
+	
+	if(args[1]->IsString()) {
+		if(!inetParseMac(*String::Utf8Value(args[1]), mac)) {
+			TT_THROW_TYPE("Invalid neighbor MAC address");
+			return;
+		}
+		ret = obj->neighbor_->addProxy(addr, family == 4 ? 4 : 16, mac);
+	}
+	else {
+		ret = obj->neighbor_->removeProxy(addr, family == 4 ? 4 : 16);
+	}
+	
+	args.GetReturnValue().Set(Boolean::New(isolate, ret));
+}
+
+/*
+ * vlans(options | false) : demultiplexes, in tap mode, the frames of the
+ * given 802.1Q VLANs, which are delivered without their tag by
+ * _on_vlan_batch() callbacks, replacing the previous ones.
+ */
+void Tuntap::vlans(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Local<Object> main_obj;
+	Local<Value> val;
+	Local<Array> arr;
+	std::vector<int> ids;
+	std::string others = "pass";
+	int priority = 0;
+	int vid;
+	
+	if(!args[0]->IsObject()) {
+		if(obj->vlan_)
+			delete obj->vlan_;
+		obj->vlan_ = NULL;
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	if(obj->itf_opts.mode != tuntap_itf_opts_t::MODE_TAP) {
+		TT_THROW_TYPE("The VLAN demultiplexer needs a tap interface");
+		return;
+	}
+	
+	main_obj = args[0]->ToObject();
+	
+	TT_GETOPT_STR(main_obj, "others", others)
+	TT_GETOPT(main_obj, "priority", priority, ToInteger)
+	
+	if(others != "pass" && others != "drop") {
+		TT_THROW_TYPE("Invalid others option (pass or drop)");
+		return;
+	}
+	
+	if(priority < 0 || priority > 7) {
+		isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate, "The priority must be between 0 and 7")));
+		return;
+	}
+	
+	val = main_obj->Get(String::NewFromUtf8(isolate, "ids"));
+	if(val->IsArray()) {
+		arr = val.As<Array>();
+		for(unsigned int i = 0 ; i < arr->Length() ; i++) {
+			vid = arr->Get(i)->Int32Value();
+			if(vid <= 0 || vid >= VLAN_IDS - 1) {
+				isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate, "The VLAN ids must be between 1 and 4094")));
+				return;
+			}
+			ids.push_back(vid);
+		}
+	}
+	
+	if(!obj->vlan_)
+		obj->vlan_ = new Vlan();
+	
+	obj->vlan_->configure(others == "drop", priority);
+	obj->vlan_->setIds(ids);
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+/* writeVlan(id, buffer | buffers) : writes frames to a joined VLAN, tagging them */
+void Tuntap::writeVlan(const FunctionCallbackInfo<Value>& args) {
+	Isolate* isolate = args.GetIsolate();
+	HandleScope scope(isolate);
+	Tuntap *obj = ObjectWrap::Unwrap<Tuntap>(args.This());
+	Local<Array> buffers;
+	Local<Value> in_buff;
+	int vid;
+	
+	if(obj->fd == -1) {
+		TT_THROW_TYPE("Object is closed and cannot be written!");
+		return;
+	}
+	
+	vid = args[0]->Int32Value();
+	if(!obj->vlan_ || !obj->vlan_->joined(vid)) {
+		TT_THROW_TYPE("Not a joined VLAN");
+		return;
+	}
+	
+	if(node::Buffer::HasInstance(args[1])) {
+		obj->write_data(
+			reinterpret_cast<unsigned char*>(node::Buffer::Data(args[1])),
+			node::Buffer::Length(args[1]),
+			0,
+			vid
+		);
+		args.GetReturnValue().Set(args.This());
+		return;
+	}
+	
+	if(!args[1]->IsArray()) {
+		TT_THROW_TYPE("Wrong argument type");
+		return;
+	}
+	
+	buffers = args[1].As<Array>();
+	
+	for(unsigned int i = 0, limiti = buffers->Length(); i < limiti; i++) {
+		in_buff = buffers->Get(i);
+		
+		if(!node::Buffer::HasInstance(in_buff)) {
+			TT_THROW_TYPE("Wrong argument type");
+			return;
+		}
+		
+		obj->write_data(
+			reinterpret_cast<unsigned char*>(node::Buffer::Data(in_buff)),
+			node::Buffer::Length(in_buff),
+			0,
+			vid
+		);
+	}
+	
+	args.GetReturnValue().Set(args.This());
+}
+
+void Tuntap::shaper_timer_cb(uv_timer_t* handle) {
+	Tuntap *obj = static_cast<Tuntap*>(handle->data);
+	
+	obj->shaper_run();
+}
+
+/* The datagrams still queued are written without shaping */
+void Tuntap::shaper_stop() {
+	Buffer *wbuff;
+	
+	if(!this->shaper_)
+		return;
+	
+	while((wbuff = static_cast<Buffer*>(this->shaper_->drain()))) {
+		if(this->fd >= 0)
+			this->write_enqueue(wbuff);
+		else
+			delete wbuff;
+	}
+	
+	uv_close((uv_handle_t*) this->shaper_timer_, uv_free_cb<uv_timer_t>);
+	delete this->shaper_;
+	this->shaper_ = NULL;
+	this->shaper_timer_ = NULL;
+}
+
+/* Returns -EAGAIN when the device is full, the datagram staying queued */
+int Tuntap::do_write() {
+	Buffer *cur;
+	uint64_t dropped;
+	int ret;
+	
+	/* The datagrams left in the FIFO were queued before fq_codel was set */
+	if(this->writ_buff && this->writ_buff->size() > 0) {
+		cur = this->writ_buff->front();
+		this->writ_buff->pop_front();
+	}
+	else if(this->fq_) {
+		/* The datagrams dropped by CoDel count as interface drops too */
+		dropped = this->fq_->getStats().dropped;
+		cur = static_cast<Buffer*>(this->fq_->dequeue(uv_hrtime()));
+		this->stats_.tx_dropped += this->fq_->getStats().dropped - dropped;
+	}
+	else {
+		cur = NULL;
+	}
+	
+	if(!cur) {
+		this->set_write(false);
+		return(0);
+	}
+	
+	ret = write(this->fd, cur->data, cur->size);
+	if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		this->stats_.tx_eagain++;
+		if(!this->writ_buff)
+			this->writ_buff = new std::deque<Buffer*>();
+		this->writ_buff->push_front(cur);
+		return(-EAGAIN);
+	}
+	else if(ret != cur->size) {
+		this->stats_.tx_errors++;
+	}
+	else {
+		this->stats_.tx_packets++;
+		this->stats_.tx_bytes += ret;
+		
+		if(this->timestamps && cur->queued)
+			this->latency_->tx_queue.record(uv_hrtime() - cur->queued);
+		
+		if(this->capture_)
+			this->capture_->packet(cur->data, cur->size, false);
+	}
+	
+	delete cur;
+	
+	if(this->write_queued() == 0) {
+		this->set_write(false);
+		
+		/* Idle interfaces keep no queue in lean mode */
+		if(this->lean && this->writ_buff) {
+			delete this->writ_buff;
+			this->writ_buff = NULL;
+		}
+	}
+	
+	return(0);
 }
@@ -24,25 +24,40 @@
 
 #include "tuntap-itf/tuntap-itf.hh"
 
+#define TUNTAP_MAX_READ_BATCH		256
+
+#define TUNTAP_DFT_POLL_BUDGET		50
+#define TUNTAP_DFT_POLL_EAGAIN		4
+#define TUNTAP_DFT_POLL_RATE_HIGH	20000
+#define TUNTAP_DFT_POLL_RATE_LOW	5000
+#define TUNTAP_POLL_WINDOW		10000000
+
+#define TUNTAP_DFT_COALESCE_SIZE	16384
+#define TUNTAP_DFT_COALESCE_DELAY	1000
+
 class Tuntap : public node::ObjectWrap {
+	friend class Reactor;
+	
 	public:
 		static void Init(v8::Handle<v8::Object> module);
 		
 	private:
-		Tuntap();
+		Tuntap(v8::Isolate* isolate);
 		~Tuntap();
 		
 		struct Buffer {
 			Buffer();
 			
 			Buffer(int size_in) :
-					size(size_in)
+					size(size_in),
+					queued(0)
 				{
 				this->data = new uint8_t[size_in];
 			}
 			
 			Buffer(uint8_t *data_in, int size_in, bool copy = true) :
-					size(size_in)
+					size(size_in),
+					queued(0)
 				{
 				this->size = size_in;
 				if(copy) {
@@ -55,44 +70,261 @@ class Tuntap : public node::ObjectWrap {
 			}
 			
 			~Buffer() {
-				delete this->data;
+				delete[] this->data;
 			}
 			
 			uint8_t *data;
 			int size;
+			uint64_t queued;
+		};
+		
+		struct stats_t {
+			uint64_t rx_packets;
+			uint64_t rx_bytes;
+			uint64_t rx_errors;
+			uint64_t tx_packets;
+			uint64_t tx_bytes;
+			uint64_t tx_errors;
+			uint64_t tx_dropped;
+			uint64_t tx_eagain;
+		};
+		
+		struct busy_poll_t {
+			busy_poll_t() :
+				mode(POLL_EVENT),
+				budget(TUNTAP_DFT_POLL_BUDGET),
+				eagain(TUNTAP_DFT_POLL_EAGAIN),
+				rate_high(TUNTAP_DFT_POLL_RATE_HIGH),
+				rate_low(TUNTAP_DFT_POLL_RATE_LOW),
+				busy(false),
+				window_start(0),
+				window_packets(0),
+				rate(0),
+				wakeups(0),
+				busy_rounds(0),
+				busy_packets(0),
+				switches(0)
+			{}
+			
+			enum {
+				POLL_EVENT,
+				POLL_ADAPTIVE,
+				POLL_BUSY,
+			} mode;
+			
+			int budget;
+			int eagain;
+			int rate_high;
+			int rate_low;
+			
+			bool busy;
+			uint64_t window_start;
+			uint64_t window_packets;
+			double rate;
+			
+			uint64_t wakeups;
+			uint64_t busy_rounds;
+			uint64_t busy_packets;
+			uint64_t switches;
+		};
+		
+		struct coalesce_t {
+			coalesce_t() :
+				data(NULL),
+				used(0),
+				limit(TUNTAP_DFT_COALESCE_SIZE),
+				delay(TUNTAP_DFT_COALESCE_DELAY),
+				first(0),
+				timer(NULL),
+				compress(false),
+				chunk_packets(0),
+				chunks(0),
+				packets(0),
+				compressed(0),
+				saved(0)
+			{}
+			
+			uint8_t *data;
+			int used;
+			int limit;
+			int delay;
+			uint64_t first;
+			uv_timer_t *timer;
+			bool compress;
+			
+			uint64_t chunk_packets;
+			uint64_t chunks;
+			uint64_t packets;
+			uint64_t compressed;
+			uint64_t saved;
+		};
+		
+		struct ring_t {
+			ring_t() :
+				rx(NULL),
+				tx(NULL),
+				timer(NULL),
+				stalled(false),
+				rx_packets(0),
+				tx_packets(0),
+				tx_errors(0),
+				stalls(0)
+			{}
+			
+			Ring *rx;
+			Ring *tx;
+			v8::Persistent<v8::SharedArrayBuffer> rx_sab;
+			v8::Persistent<v8::SharedArrayBuffer> tx_sab;
+			uv_timer_t *timer;
+			bool stalled;
+			
+			uint64_t rx_packets;
+			uint64_t tx_packets;
+			uint64_t tx_errors;
+			uint64_t stalls;
+		};
+		
+		struct latency_t {
+			Histogram rx_dispatch;
+			Histogram tx_queue;
 		};
 		
 		bool construct(v8::Handle<v8::Object> main_obj, std::string &error);
 		void objset(v8::Handle<v8::Object> obj);
+		void fragset(v8::Handle<v8::Value> val);
+		void groset(v8::Handle<v8::Value> val);
+		void loopbackset(v8::Handle<v8::Value> val);
+		void pollset(v8::Handle<v8::Value> val);
+		void coalesceset(v8::Handle<v8::Value> val);
+		void fqset(v8::Handle<v8::Value> val);
+		void autotuneset(v8::Handle<v8::Value> val);
 		static void writeBuffer(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void writeBuffers(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void open(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void close(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void set(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void unset(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void stopRead(const v8::FunctionCallbackInfo<v8::Value>& args);
 		static void startRead(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void stats(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void capture(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void latency(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void detach(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void aeadPeer(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void compress(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void decompress(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void ring(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void ringWrite(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void shaper(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void pull(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void readInto(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void readManyInto(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void generate(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void flows(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void flushFlows(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void neighbors(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void proxyNeighbor(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void vlans(const v8::FunctionCallbackInfo<v8::Value>& args);
+		static void writeVlan(const v8::FunctionCallbackInfo<v8::Value>& args);
 		
 		static void uv_event_cb(uv_poll_t* handle, int status, int events);
+		static void coalesce_timer_cb(uv_timer_t* handle);
+		static void ring_timer_cb(uv_timer_t* handle);
+		static void shaper_timer_cb(uv_timer_t* handle);
+		static void generator_done_cb(uv_async_t* handle);
+		static void flows_timer_cb(uv_timer_t* handle);
+		static void autotune_timer_cb(uv_timer_t* handle);
+		static void fq_free_cb(void *pkt);
+		
+		template <typename T>
+		static void uv_free_cb(uv_handle_t* handle) {
+			delete reinterpret_cast<T*>(handle);
+		}
 		
 		static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
-		static v8::Persistent<v8::Function> constructor;
+		static void constructor_cleanup(void *arg);
+		static void env_cleanup(void *arg);
+		
+		void dispose();
+		void release(bool close_fd);
 		
 		void set_read(bool r);
 		void set_write(bool w);
 		
-		void do_read();
-		void do_write();
+		int l3_offset() const;
+		
+		int do_read(bool *drained = NULL);
+		int do_read_push(bool *drained);
+		int read_into(uint8_t *out, int room);
+		int read_into_room() const;
+		int do_write();
+		void busy_poll(int count);
+		void poll_update(int count, uint64_t now);
+		uint8_t *read_stage(uint8_t *data, int *size);
+		uint8_t *read_comp(uint8_t *data, int *size);
+		v8::Local<v8::Object> make_read_buffer(uint8_t *data, int size);
+		void coalesce_append(uint8_t *data, int size);
+		void coalesce_flush();
+		void emit_read(uint8_t *data, int size);
+		int ring_drain();
+		void ring_stop();
+		void write_data(unsigned char *data, size_t data_length, uint32_t mark = 0, int vlan = -1);
+		void queue_write(Buffer *wbuff, uint32_t mark = 0);
+		void push_write(Buffer *wbuff, Shaper::class_t *cls);
+		void write_enqueue(Buffer *wbuff);
+		size_t write_queued() const;
+		void shaper_run();
+		void shaper_stop();
+		void flows_deliver();
+		void flows_stop();
+		void autotune_start();
+		void autotune_stop();
+		
+		v8::Isolate* isolate_;
+		uv_loop_t* loop_;
 		
 		int fd;
+		int adopt_fd;
 		
 		tuntap_itf_opts_t itf_opts;
 		
+		IpFrag ipfrag;
+		Offload offload;
+		Capture *capture_;
+		latency_t *latency_;
+		coalesce_t *coalesce_;
+		Aead *aead_;
+		ring_t *ring_;
+		Shaper *shaper_;
+		uv_timer_t *shaper_timer_;
+		FqCodel *fq_;
+		Generator *generator_;
+		uv_async_t *generator_async_;
+		FlowMeter *flows_;
+		uv_timer_t *flows_timer_;
+		int flows_batch;
+		Neighbor *neighbor_;
+		Autotune *autotune_;
+		uv_timer_t *autotune_timer_;
+		Vlan *vlan_;
+		Reactor *reactor_;
+		Reactor::entry_t *reactor_entry_;
+		bool use_reactor;
+		bool lean;
+		bool pull_mode;
+		busy_poll_t poll_;
+		stats_t stats_;
+		
+		int read_batch;
+		bool timestamps;
+		
 		unsigned char *read_buff;
-		std::deque<Buffer*> writ_buff;
+		std::deque<Buffer*> *writ_buff;
 		bool is_reading;
 		bool is_writing;
 		
-		uv_poll_t uv_handle_;
+		uv_poll_t *uv_handle_;
+		bool disposed;
 };
 
 #endif
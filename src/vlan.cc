@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "module.hh"
+
+#define VLAN_ETH_ADDRS			12
+
+Vlan::Vlan() :
+	drop_others(false),
+	priority(0)
+{
+	memset(this->counters, 0, sizeof(this->counters));
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+
+Vlan::~Vlan() {
+	this->setIds(std::vector<int>());
+}
+
+void Vlan::configure(bool drop_others, int priority) {
+	this->drop_others = drop_others;
+	this->priority = priority & 0x07;
+}
+
+void Vlan::setIds(const std::vector<int> &ids) {
+	std::vector<bool> keep(VLAN_IDS, false);
+	size_t i;
+	int vid;
+	
+	for(i = 0 ; i < ids.size() ; i++) {
+		if(ids[i] > 0 && ids[i] < VLAN_IDS - 1)
+			keep[ids[i]] = true;
+	}
+	
+	for(i = 0 ; i < this->ids.size() ; i++) {
+		vid = this->ids[i];
+		if(!keep[vid]) {
+			delete this->counters[vid];
+			this->counters[vid] = NULL;
+		}
+	}
+	
+	this->ids.clear();
+	for(vid = 1 ; vid < VLAN_IDS - 1 ; vid++) {
+		if(!keep[vid])
+			continue;
+		
+		if(!this->counters[vid]) {
+			this->counters[vid] = new counters_t();
+			this->counters[vid]->rx_packets = 0;
+			this->counters[vid]->tx_packets = 0;
+		}
+		this->ids.push_back(vid);
+	}
+}
+
+int Vlan::demux(uint8_t **data, int *size) {
+	uint8_t *frame = *data;
+	int vid;
+	
+	if(*size < INET_TAP_L3_OFF + VLAN_TAG_LEN || inetRead16(frame + INET_TAP_L3_OFF - 2) != INET_ETHTYPE_VLAN)
+		return(VLAN_PASS);
+	
+	vid = inetRead16(frame + INET_TAP_L3_OFF) & 0x0FFF;
+	
+	if(!this->joined(vid)) {
+		if(vid == 0 || !this->drop_others) {
+			this->stats.rx_passed++;
+			return(VLAN_PASS);
+		}
+		
+		this->stats.rx_dropped++;
+		return(VLAN_DROP);
+	}
+	
+	/* The inner ethertype goes to the packet information header too */
+	memcpy(frame + 2, frame + INET_TAP_L3_OFF + 2, 2);
+	memmove(frame + VLAN_TAG_LEN, frame, INET_PI_LEN + VLAN_ETH_ADDRS);
+	
+	*data = frame + VLAN_TAG_LEN;
+	*size -= VLAN_TAG_LEN;
+	
+	this->stats.rx_tagged++;
+	this->counters[vid]->rx_packets++;
+	
+	return(vid);
+}
+
+bool Vlan::tag(const uint8_t *data, int size, int vid, uint8_t *out) {
+	if(size < INET_TAP_L3_OFF || !this->joined(vid)) {
+		this->stats.tx_errors++;
+		return(false);
+	}
+	
+	memcpy(out, data, INET_PI_LEN + VLAN_ETH_ADDRS);
+	/* The packet information header follows the new ethertype, as demux() does */
+	inetWrite16(out + 2, INET_ETHTYPE_VLAN);
+	inetWrite16(out + INET_PI_LEN + VLAN_ETH_ADDRS, INET_ETHTYPE_VLAN);
+	inetWrite16(out + INET_TAP_L3_OFF, (this->priority << 13) | vid);
+	memcpy(out + INET_TAP_L3_OFF + 2, data + INET_PI_LEN + VLAN_ETH_ADDRS, size - INET_PI_LEN - VLAN_ETH_ADDRS);
+	
+	this->stats.tx_tagged++;
+	this->counters[vid]->tx_packets++;
+	
+	return(true);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2010-2014 BinarySEC SAS
+ * Tuntap binding for nodejs [http://www.binarysec.com]
+ * 
+ * This file is part of Gate.js.
+ * 
+ * Gate.js is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _H_NODETUNTAP_VLAN
+#define _H_NODETUNTAP_VLAN
+
+#define VLAN_TAG_LEN			4
+#define VLAN_IDS			4096
+#define VLAN_PASS			-1
+#define VLAN_DROP			-2
+
+/*
+ * 802.1Q demultiplexer, for tap devices. The frames read with the tag of a
+ * joined VLAN get their tag stripped in place, and are delivered apart with
+ * the VLAN id. The untagged frames are left alone, as are those of the other
+ * VLANs unless they are dropped. The frames written to a VLAN get its tag
+ * inserted, with the configured priority.
+ * 
+ * Only the 0x8100 tags are handled : priority tagged frames (VLAN 0) and
+ * stacked tags (0x88A8 outer tags) go through as untagged frames.
+ */
+class Vlan {
+	public:
+		struct stats_t {
+			uint64_t rx_tagged;
+			uint64_t rx_passed;
+			uint64_t rx_dropped;
+			uint64_t tx_tagged;
+			uint64_t tx_errors;
+		};
+		
+		/* Counters of a joined VLAN */
+		struct counters_t {
+			uint64_t rx_packets;
+			uint64_t tx_packets;
+		};
+		
+		Vlan();
+		~Vlan();
+		
+		void configure(bool drop_others, int priority);
+		
+		/* Joins the given VLANs (1 to 4094) only, the counters of those kept going on */
+		void setIds(const std::vector<int> &ids);
+		bool joined(int vid) const { return(vid > 0 && vid < VLAN_IDS - 1 && this->counters[vid] != NULL); }
+		
+		/*
+		 * Strips the tag of a frame of a joined VLAN, moving `*data` and `*size`,
+		 * and returns the VLAN id. Returns VLAN_PASS or VLAN_DROP otherwise.
+		 */
+		int demux(uint8_t **data, int *size);
+		
+		/* Copies a frame to `out`, with the tag of `vid` inserted. False if too short */
+		bool tag(const uint8_t *data, int size, int vid, uint8_t *out);
+		
+		const std::vector<int> &getIds() const { return(this->ids); }
+		const counters_t &getCounters(int vid) const { return(*this->counters[vid]); }
+		const stats_t &getStats() const { return(this->stats); }
+		
+	private:
+		counters_t *counters[VLAN_IDS];
+		std::vector<int> ids;
+		bool drop_others;
+		int priority;
+		
+		stats_t stats;
+};
+
+#endif